@@ -1,3 +1,44 @@
+/******************************************************************************
+ *  FILE
+ *      Calc_CRC.h
+ *
+ *  DESCRIPTION
+ *      Header file for the CRC-CCITT (polynomial 0x1021) calculation of the
+ *      meter frames
+ *
+ ******************************************************************************/
+
+#ifndef __CALC_CRC_H__
+#define __CALC_CRC_H__
+
+/*============================================================================*
+ *  SDK Header Files
+ *============================================================================*/
+
 #include <types.h>
 
+/*============================================================================*
+ *  Public Definitions
+ *============================================================================*/
+
+/* Initial value of the CRC of a frame */
+#define CRC_CCITT_SEED              (0xFFFF)
+
+/* Define CRC_NIBBLE_TABLE to use a 16 entry table, processing a byte in two
+ * steps, instead of the 256 entry table
+ */
+
+/*============================================================================*
+ *  Public Function Prototypes
+ *============================================================================*/
+
+/* This function adds a byte to a running CRC */
+extern uint16 crc_update_crc(uint16 crc, uint8 byte);
+
+/* This function adds a buffer to a running CRC, starting from 'initial_crc'.
+ * The CRC of a frame received in parts is the CRC of each part in turn,
+ * starting from CRC_CCITT_SEED
+ */
 extern unsigned short crc_calculate_crc (unsigned short initial_crc, const unsigned char *buffer, unsigned short length);
+
+#endif /* __CALC_CRC_H__ */
@@ -73,6 +73,28 @@
 #define GAP_CONN_PARAM_TIMEOUT                   (30 * SECOND)
 
 
+/* Build profiles. At most one of these is defined in the project DEFS:
+ *  BUILD_PROFILE_PTS        - production behaviour plus the PTS work arounds,
+ *                             which are switched on through the user CS key.
+ *  BUILD_PROFILE_SIMULATION - a short button press adds simulated glucose
+ *                             records instead of downloading the meter.
+ * When neither is defined the production profile is built, which carries no
+ * PTS code at all.
+ */
+#if defined(BUILD_PROFILE_PTS) && defined(BUILD_PROFILE_SIMULATION)
+#error "Only one build profile can be selected"
+#endif
+
+#ifdef BUILD_PROFILE_PTS
+#define ENABLE_PTS_WORKAROUNDS
+#endif /* BUILD_PROFILE_PTS */
+
+#ifdef BUILD_PROFILE_SIMULATION
+#define ENABLE_SIMULATED_READINGS
+#endif /* BUILD_PROFILE_SIMULATION */
+
+#ifdef ENABLE_PTS_WORKAROUNDS
+
 /* CS KEY Index for PTS */
 /* Application have eight CS keys for its use. Index for these keys : [0-7]
  * First CS key will be used for PTS test cases which require application
@@ -92,6 +114,8 @@
 /* Bit1 will be used for generating context in every record */
 #define PTS_GENERATE_CONTEXT_EVERY_RECORD_MASK   (0x0002)
 
+#endif /* ENABLE_PTS_WORKAROUNDS */
+
 /* Timer value for remote device to re-encrypt the link using old keys */
 #define BONDING_CHANCE_TIMER                     (30*SECOND)
 
@@ -156,11 +180,13 @@ typedef enum
  *  Public Data Declarations
  *============================================================================*/
 
+#ifdef ENABLE_PTS_WORKAROUNDS
 /* These boolean variabled will be used for enabling PTS test case specific
  * code.
  */
 extern bool g_pts_generate_context_every_record;
 extern bool g_pts_abort_test;
+#endif /* ENABLE_PTS_WORKAROUNDS */
 
 
 
@@ -197,4 +223,19 @@ extern uint16 GetAppConnectedUcid(void);
 
 /* This function checks if the link is encrypted or not. */
 extern bool AppIsLinkEncrypted(void);
+
+/* This function selects the connection parameters for bulk transfers or the
+ * low power ones.
+ */
+extern void AppSetBulkTransfer(bool bulk);
+
+/* This function returns the highest glucose record sequence number the 
+ * collector has acknowledged.
+ */
+extern uint16 AppGetSyncedSeqNum(void);
+
+/* This function records that the collector has acknowledged the glucose 
+ * records up to a sequence number.
+ */
+extern void AppSetSyncedSeqNum(uint16 seq_num);
 #endif /* __APP_GATT_H__ */
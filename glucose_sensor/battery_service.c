@@ -277,7 +277,7 @@ extern void BatteryHandleAccessWrite(GATT_ACCESS_IND_T *p_ind)
                 if(AppIsDeviceBonded())
                 {
                      Nvm_Write((uint16 *)&client_config,
-                              sizeof(client_config),
+                              SIZEOF_WORDS(client_config),
                               g_batt_data.nvm_offset + 
                               BATTERY_NVM_LEVEL_CLIENT_CONFIG_OFFSET);
                 }
@@ -379,7 +379,7 @@ extern void BatteryReadDataFromNVM(bool bonded, uint16 *p_offset)
 
         /* Read battery level client configuration */
         Nvm_Read((uint16 *)&g_batt_data.level_client_config,
-                   sizeof(g_batt_data.level_client_config),
+                   SIZEOF_WORDS(g_batt_data.level_client_config),
                    *p_offset + 
                    BATTERY_NVM_LEVEL_CLIENT_CONFIG_OFFSET);
 
@@ -439,8 +439,12 @@ extern void BatteryBondingNotify(bool bond_status)
              
         batt_offset =  g_batt_data.nvm_offset + 
                                   BATTERY_NVM_LEVEL_CLIENT_CONFIG_OFFSET;
-        Nvm_Write((uint16 *)&batt_client_config, sizeof(batt_client_config),
-                                                              batt_offset);
+        Nvm_BeginTransaction();
+
+        Nvm_Write((uint16 *)&batt_client_config, 
+                  SIZEOF_WORDS(batt_client_config), batt_offset);
+
+        Nvm_CommitTransaction();
     }
 
 }
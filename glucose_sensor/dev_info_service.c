@@ -99,7 +99,7 @@ static bool getSystemId(SYSTEM_ID_T * sys_id)
     {
         /* Manufacturer identifier */
         sys_id->word[0] = (SYSTEM_ID_FIXED_CONSTANT >> 8);
-        sys_id->word[1] = SYSTEM_ID_FIXED_CONSTANT;
+        sys_id->word[1] = (SYSTEM_ID_FIXED_CONSTANT & 0xFF);
         sys_id->word[2] = (bdaddr.lap >> 16);
         sys_id->word[3] = (bdaddr.lap >> 8);
         sys_id->word[4] = bdaddr.lap;
@@ -63,6 +63,21 @@
 #define PREFERRED_SUPERVISION_TIMEOUT       0x03e8 /* 10 seconds */
 
 
+/* Connection parameters requested while a RACP procedure reports a bulk of
+ * stored records. A short interval without slave latency lets several 
+ * notifications go in every connection event. The low power parameters 
+ * above are requested again once the procedure completes.
+ */
+#define BULK_MAX_CON_INTERVAL               0x0018 /* 30 ms */
+#define BULK_MIN_CON_INTERVAL               0x000c /* 15 ms */
+#define BULK_SLAVE_LATENCY                  0x0000
+#define BULK_SUPERVISION_TIMEOUT            PREFERRED_SUPERVISION_TIMEOUT
+
+/* Minimum number of records reported for the bulk connection parameters to
+ * be requested. Fewer records go quickly enough at the low power parameters.
+ */
+#define BULK_TRANSFER_MIN_RECORDS           10
+
 /* Max num of connection parameter update that we send in one connection*/
 #define MAX_NUM_CONN_PARAM_UPDATE_REQS 2
 
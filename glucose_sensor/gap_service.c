@@ -105,7 +105,7 @@ static void updateDeviceName(uint16 length, uint8 *name);
 static void gapWriteDeviceNameToNvm(void)
 {
     /* Write device name length to NVM */
-    Nvm_Write(&g_gap_data.length, sizeof(g_gap_data.length), 
+    Nvm_Write(&g_gap_data.length, SIZEOF_WORDS(g_gap_data.length), 
               g_gap_data.nvm_offset + 
               GAP_NVM_DEVICE_LENGTH_OFFSET);
 
@@ -113,7 +113,8 @@ static void gapWriteDeviceNameToNvm(void)
      * Typecast of uint8 to uint16 or vice-versa shall not have any side 
      * affects as both types (uint8 and uint16) take one word memory on XAP
      */
-    Nvm_Write((uint16*)g_gap_data.p_dev_name, g_gap_data.length, 
+    Nvm_Write((uint16*)g_gap_data.p_dev_name, 
+              UINT8_ARRAY_WORDS(g_gap_data.length), 
               g_gap_data.nvm_offset + 
               GAP_NVM_DEVICE_NAME_OFFSET);
 }
@@ -277,7 +278,7 @@ extern void GapReadDataFromNVM(uint16 *p_offset)
     g_gap_data.nvm_offset = *p_offset;
 
     /* Read Device Length */
-    Nvm_Read(&g_gap_data.length, sizeof(g_gap_data.length), 
+    Nvm_Read(&g_gap_data.length, SIZEOF_WORDS(g_gap_data.length), 
              *p_offset + 
              GAP_NVM_DEVICE_LENGTH_OFFSET);
 
@@ -285,7 +286,8 @@ extern void GapReadDataFromNVM(uint16 *p_offset)
      * Typecast of uint8 to uint16 or vice-versa shall not have any side 
      * affects as both types (uint8 and uint16) take one word memory on XAP
      */
-    Nvm_Read((uint16*)g_gap_data.p_dev_name, g_gap_data.length, 
+    Nvm_Read((uint16*)g_gap_data.p_dev_name, 
+             UINT8_ARRAY_WORDS(g_gap_data.length), 
              *p_offset + 
              GAP_NVM_DEVICE_NAME_OFFSET);
 
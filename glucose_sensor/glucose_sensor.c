@@ -63,6 +63,12 @@ static void gsIdleTimerHandler(timer_id tid);
  */
 static void requestConnParamUpdate(timer_id tid);
 
+/* This function sends a connection parameter update request */
+static void sendConnParamUpdateReq(void);
+
+/* This function checks the connection parameters against the wanted ones */
+static bool connParamsComply(void);
+
 /* This function handles the signal LM_EV_CONNECTION_COMPLETE */
 static void handleSignalLmEvConnectionComplete(
                                      LM_EV_CONNECTION_COMPLETE_T *p_event_data);
@@ -128,12 +134,20 @@ static void appInitExit(void);
 /* Maximum number of timers 
  * Two timers have been kept for normal application operation,
  * one timer has been kept for buzzer sounding.
- * One timer will get used for PTS timer which we run to maintain 1 second gap
- * between two glucose measurement sending over the air.
- * This timer will get used only when PTS is running those test cases which
- * require application to keep sending glucose measurements for a long time 
+ * One timer will get used for the reply of the meter while its records are
+ * being downloaded.
+ * One timer is used by the glucose service to delete the records selected by
+ * an RACP Delete Stored Records procedure a slice at a time.
+ * PTS builds keep one more timer which we run to maintain a gap between two
+ * glucose measurements sent over the air. This timer will get used only when
+ * PTS is running those test cases which require application to keep sending
+ * glucose measurements for a long time.
  */
-#define MAX_APP_TIMERS                           (5)
+#ifdef ENABLE_PTS_WORKAROUNDS
+#define MAX_APP_TIMERS                           (7)
+#else
+#define MAX_APP_TIMERS                           (6)
+#endif /* ENABLE_PTS_WORKAROUNDS */
 
 /*============================================================================*
  *  Private Data
@@ -150,6 +164,7 @@ static uint16 app_timers[SIZEOF_APP_TIMER * MAX_APP_TIMERS];
 /* Glucose sensor application data structure */
 APP_DATA_T g_gs_data;
 
+#ifdef ENABLE_PTS_WORKAROUNDS
 /* PTS test case - 
  *      TC_CN_BV_06_C
  *      TC_CN_BV_07_C
@@ -182,6 +197,7 @@ bool g_pts_generate_context_every_record = FALSE;
  *      TC_SPE_BI_07_C
  */
 bool g_pts_abort_test = FALSE;
+#endif /* ENABLE_PTS_WORKAROUNDS */
 
 /*============================================================================*
  *  Private Function Implementations
@@ -205,6 +221,14 @@ static void gsDataInit(void)
     g_gs_data.app_tid = TIMER_INVALID;
     TimerDelete(g_gs_data.conn_param_update_tid);
     g_gs_data.conn_param_update_tid = TIMER_INVALID;
+    g_gs_data.conn_param_update_pending = FALSE;
+    g_gs_data.bulk_transfer = FALSE;
+
+    /* Only the bonded collector is remembered between connections */
+    if(!g_gs_data.bonded)
+    {
+        g_gs_data.synced_seq_num = 0;
+    }
 
     /* Delete the bonding chance timer */
     TimerDelete(g_gs_data.bonding_reattempt_tid);
@@ -251,6 +275,9 @@ static void readPersistentStore(void)
     uint16 nvm_offset = NVM_MAX_APP_MEMORY_WORDS;
     uint16 nvm_sanity = 0xffff;
 
+    /* Keep the NVM enabled until all the persistent data has been read */
+    Nvm_BeginTransaction();
+
     /* Read persistent storage to know if the device was last bonded 
      * to another device 
      */
@@ -260,12 +287,12 @@ static void readPersistentStore(void)
      * trigger undirected advertisements for any host to connect.
      */
 
-    Nvm_Read(&nvm_sanity, sizeof(nvm_sanity), NVM_OFFSET_SANITY_WORD);
+    Nvm_Read(&nvm_sanity, SIZEOF_WORDS(nvm_sanity), NVM_OFFSET_SANITY_WORD);
 
     if(nvm_sanity == NVM_SANITY_MAGIC)
     {
         /* Read bonded flag from NVM */
-        Nvm_Read((uint16 *)&g_gs_data.bonded,sizeof(g_gs_data.bonded),
+        Nvm_Read((uint16 *)&g_gs_data.bonded,SIZEOF_WORDS(g_gs_data.bonded),
                     NVM_OFFSET_BONDED_FLAG);
 
         if(g_gs_data.bonded)
@@ -275,8 +302,13 @@ static void readPersistentStore(void)
              * is set to TRUE. Read last bonded device address.
              */
             Nvm_Read((uint16 *)&g_gs_data.bonded_bd_addr, 
-                       sizeof(TYPED_BD_ADDR_T),
+                       SIZEOF_WORDS(TYPED_BD_ADDR_T),
                        NVM_OFFSET_BONDED_ADDR);
+
+            /* Read the last record the bonded collector has acknowledged */
+            Nvm_Read(&g_gs_data.synced_seq_num, 
+                     SIZEOF_WORDS(g_gs_data.synced_seq_num),
+                     NVM_OFFSET_SYNCED_SEQ_NUM);
         }
 
         else /* Case when we have only written NVM_SANITY_MAGIC to NVM but 
@@ -284,13 +316,14 @@ static void readPersistentStore(void)
               */
         {
             g_gs_data.bonded = FALSE;
+            g_gs_data.synced_seq_num = 0;
         }
 
         /* Read the diversifier associated with the presently bonded/last 
          * bonded device.
          */
         Nvm_Read(&g_gs_data.diversifier, 
-                 sizeof(g_gs_data.diversifier),
+                 SIZEOF_WORDS(g_gs_data.diversifier),
                  NVM_OFFSET_SM_DIV);
 
         /* If device is bonded and bonded address is resolvable then read the 
@@ -319,6 +352,11 @@ static void readPersistentStore(void)
          */
         BatteryReadDataFromNVM(g_gs_data.bonded, &nvm_offset);
 
+        /* Read the serial number of the meter and the newest record 
+         * downloaded from it
+         */
+        MeterReadDataFromNVM(&nvm_offset);
+
     }
     else /* NVM sanity check failed means either the device is being brought up 
           * for the first time or memory has got corrupted in which case 
@@ -329,14 +367,16 @@ static void readPersistentStore(void)
         nvm_sanity = NVM_SANITY_MAGIC;
 
         /* Write NVM Sanity word to the NVM */
-        Nvm_Write(&nvm_sanity, sizeof(nvm_sanity), NVM_OFFSET_SANITY_WORD);
+        Nvm_Write(&nvm_sanity, SIZEOF_WORDS(nvm_sanity), 
+                  NVM_OFFSET_SANITY_WORD);
 
         /* The device will not be bonded as it is coming up for the first time
          */
         g_gs_data.bonded = FALSE;
+        g_gs_data.synced_seq_num = 0;
 
         /* Write bonded status to NVM */
-        Nvm_Write((uint16 *)&g_gs_data.bonded, sizeof(g_gs_data.bonded), 
+        Nvm_Write((uint16 *)&g_gs_data.bonded, SIZEOF_WORDS(g_gs_data.bonded), 
                              NVM_OFFSET_BONDED_FLAG);
 
         /* When the application is coming up for the first time after flashing 
@@ -347,7 +387,7 @@ static void readPersistentStore(void)
 
         /* Write the same to NVM. */
         Nvm_Write(&g_gs_data.diversifier, 
-                  sizeof(g_gs_data.diversifier),
+                  SIZEOF_WORDS(g_gs_data.diversifier),
                   NVM_OFFSET_SM_DIV);
 
         /* Write device name and length to NVM for the first time. */
@@ -366,8 +406,13 @@ static void readPersistentStore(void)
 
         BatteryReadDataFromNVM(g_gs_data.bonded, &nvm_offset);
 
+        /* No record has been downloaded from the meter yet */
+        MeterInitWriteDataToNVM(&nvm_offset);
+
     }
 
+    Nvm_CommitTransaction();
+
 }
 
 
@@ -417,15 +462,47 @@ static void gsIdleTimerHandler(timer_id tid)
  *----------------------------------------------------------------------------*/
 static void requestConnParamUpdate(timer_id tid)
 {
-    ble_con_params app_pref_conn_param;
-
     if(g_gs_data.conn_param_update_tid == tid)
     {
         g_gs_data.conn_param_update_tid= TIMER_INVALID;
-        app_pref_conn_param.con_max_interval = PREFERRED_MAX_CON_INTERVAL;
-        app_pref_conn_param.con_min_interval = PREFERRED_MIN_CON_INTERVAL;
-        app_pref_conn_param.con_slave_latency = PREFERRED_SLAVE_LATENCY;
-        app_pref_conn_param.con_super_timeout = PREFERRED_SUPERVISION_TIMEOUT;
+        sendConnParamUpdateReq();
+    }
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      sendConnParamUpdateReq
+ *
+ *  DESCRIPTION
+ *      This function sends L2CAP_CONNECTION_PARAMETER_UPDATE_REQUEST with the
+ *      wanted connection parameters, unless the current ones comply or an
+ *      earlier request is still pending.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+static void sendConnParamUpdateReq(void)
+{
+    ble_con_params app_pref_conn_param;
+
+    if(!g_gs_data.conn_param_update_pending && !connParamsComply())
+    {
+        if(g_gs_data.bulk_transfer)
+        {
+            app_pref_conn_param.con_max_interval = BULK_MAX_CON_INTERVAL;
+            app_pref_conn_param.con_min_interval = BULK_MIN_CON_INTERVAL;
+            app_pref_conn_param.con_slave_latency = BULK_SLAVE_LATENCY;
+            app_pref_conn_param.con_super_timeout = BULK_SUPERVISION_TIMEOUT;
+        }
+        else
+        {
+            app_pref_conn_param.con_max_interval = PREFERRED_MAX_CON_INTERVAL;
+            app_pref_conn_param.con_min_interval = PREFERRED_MIN_CON_INTERVAL;
+            app_pref_conn_param.con_slave_latency = PREFERRED_SLAVE_LATENCY;
+            app_pref_conn_param.con_super_timeout = 
+                                                PREFERRED_SUPERVISION_TIMEOUT;
+        }
 
         if(LsConnectionParamUpdateReq(&(g_gs_data.con_bd_addr), 
                                      &app_pref_conn_param) != ls_err_none)
@@ -436,7 +513,38 @@ static void requestConnParamUpdate(timer_id tid)
             ReportPanic(app_panic_con_param_update);
         }
         g_gs_data.num_conn_update_req++;
+        g_gs_data.conn_param_update_pending = TRUE;
+    }
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      connParamsComply
+ *
+ *  DESCRIPTION
+ *      This function checks if the current connection parameters comply with
+ *      the wanted ones, the bulk transfer parameters during a bulk transfer 
+ *      or else the preferred low power parameters.
+ *
+ *  RETURNS/MODIFIES
+ *      TRUE if the parameters comply.
+ *
+ *----------------------------------------------------------------------------*/
+static bool connParamsComply(void)
+{
+    if(g_gs_data.bulk_transfer)
+    {
+        return (g_gs_data.conn_interval >= BULK_MIN_CON_INTERVAL &&
+                g_gs_data.conn_interval <= BULK_MAX_CON_INTERVAL &&
+                g_gs_data.conn_latency == BULK_SLAVE_LATENCY);
     }
+
+    return !(g_gs_data.conn_interval < PREFERRED_MIN_CON_INTERVAL ||
+             g_gs_data.conn_interval > PREFERRED_MAX_CON_INTERVAL
+#if PREFERRED_SLAVE_LATENCY
+             || g_gs_data.conn_latency < PREFERRED_SLAVE_LATENCY
+#endif
+            );
 }
 
 /*---------------------------------------------------------------------------
@@ -787,13 +895,7 @@ static void handleSignalLMEncryptionChange(LM_EVENT_T *p_event_data)
              * Update procedure
              */
             if((g_gs_data.conn_param_update_tid == TIMER_INVALID) &&
-                    (g_gs_data.conn_interval < PREFERRED_MIN_CON_INTERVAL ||
-                     g_gs_data.conn_interval > PREFERRED_MAX_CON_INTERVAL
-#if PREFERRED_SLAVE_LATENCY
-                     || g_gs_data.conn_latency < PREFERRED_SLAVE_LATENCY
-#endif
-                    )
-              )
+               !connParamsComply())
             {
                 /* Set the num of connection update attempts to zero */
                 g_gs_data.num_conn_update_req = 0;
@@ -903,7 +1005,7 @@ static void handleSignalSmKeysInd(SM_KEYS_IND_T *p_event_data)
 
             /* Write the new diversifier to NVM */
             Nvm_Write(&g_gs_data.diversifier,
-                      sizeof(g_gs_data.diversifier), 
+                      SIZEOF_WORDS(g_gs_data.diversifier), 
                       NVM_OFFSET_SM_DIV);
 
             /* Store IRK if the connected host is using random resolvable 
@@ -1003,15 +1105,28 @@ static void handleSignalSmSimplePairingCompleteInd(
                 g_gs_data.bonded = TRUE;
                 g_gs_data.bonded_bd_addr = p_event_data->bd_addr;
 
-                /* Store bonded host typed bd address to NVM */
+                /* The new collector has not acknowledged any record yet */
+                g_gs_data.synced_seq_num = 0;
+
+                /* Store bonded host typed bd address to NVM. The bonding 
+                 * data of the application and of the services is written 
+                 * in one NVM transaction.
+                 */
+                Nvm_BeginTransaction();
 
                 /* Write one word bonded flag */
-                Nvm_Write((uint16 *)&g_gs_data.bonded, sizeof(g_gs_data.bonded),
+                Nvm_Write((uint16 *)&g_gs_data.bonded, 
+                          SIZEOF_WORDS(g_gs_data.bonded),
                                      NVM_OFFSET_BONDED_FLAG);
 
                 /* Write typed bd address of bonded host */
                 Nvm_Write((uint16 *)&g_gs_data.bonded_bd_addr,
-                          sizeof(TYPED_BD_ADDR_T), NVM_OFFSET_BONDED_ADDR);
+                          SIZEOF_WORDS(TYPED_BD_ADDR_T), 
+                          NVM_OFFSET_BONDED_ADDR);
+
+                Nvm_Write(&g_gs_data.synced_seq_num, 
+                          SIZEOF_WORDS(g_gs_data.synced_seq_num),
+                          NVM_OFFSET_SYNCED_SEQ_NUM);
 
                 if(!GattIsAddressResolvableRandom(&g_gs_data.bonded_bd_addr))
                 {
@@ -1030,6 +1145,8 @@ static void handleSignalSmSimplePairingCompleteInd(
                 GlucoseBondingNotify(g_gs_data.bonded);
 
                 BatteryBondingNotify(g_gs_data.bonded);
+
+                Nvm_CommitTransaction();
             }
             else
             {
@@ -1100,6 +1217,8 @@ static void handleSignalLsConnUpdateSignalCfm(
              * only after Tgap(conn_param_timeout). Refer Bluetooth 4.0
              * spec Vol 3 Part C, Section 9.3.9 and profile spec.
              */
+            g_gs_data.conn_param_update_pending = FALSE;
+
             if (((p_event_data->status) != ls_err_none)
                 && (g_gs_data.num_conn_update_req < 
                                 MAX_NUM_CONN_PARAM_UPDATE_REQS))
@@ -1179,12 +1298,7 @@ static void handleSignalLsConnParamUpdateInd(
      * comply with application preferred parameters. If not, application shall 
      * trigger Connection parameter update procedure 
      */
-    if(g_gs_data.conn_interval < PREFERRED_MIN_CON_INTERVAL ||
-       g_gs_data.conn_interval > PREFERRED_MAX_CON_INTERVAL
-#if PREFERRED_SLAVE_LATENCY
-       || g_gs_data.conn_latency < PREFERRED_SLAVE_LATENCY
-#endif
-      )
+    if(!connParamsComply())
     {
         /* Delete timer if running */
         TimerDelete(g_gs_data.conn_param_update_tid);
@@ -1418,30 +1532,24 @@ extern void SetAppState(app_state new_state)
  *----------------------------------------------------------------------------*/
 extern void HandleShortButtonPress(void)
 {
-    /*Button was pressed */
-   /* static uint16 number = 0;*/
+#ifdef ENABLE_SIMULATED_READINGS
+    /* Number of simulated measurements taken so far */
+    static uint16 number = 0;
+#endif /* ENABLE_SIMULATED_READINGS */
+
+    /*sound Buzzer */
+    SoundBuzzer(beep_short);
 
-    /* Formulate and store glucose measurement. Measurements are always 
-     * fetched by collector once the notifications are configured for
+#ifdef ENABLE_SIMULATED_READINGS
+    /* Formulate and store a simulated glucose measurement. Measurements are
+     * always fetched by collector once the notifications are configured for
      * Glucose Measurement and Glucose Context Information 
      */
-   /* number++;
-
-    FormulateNAddGlucoseMeasData(number % 
-                        GLUCOSE_CONTEXT_REPEAT_CYCLE_LENGTH);
-
     number++;
-
-    FormulateNAddGlucoseMeasData(number % 
-                        GLUCOSE_CONTEXT_REPEAT_CYCLE_LENGTH);
-
-number++;
-
-    FormulateNAddGlucoseMeasData(number % 
-                        GLUCOSE_CONTEXT_REPEAT_CYCLE_LENGTH);  */  
-
-    /*sound Buzzer */
-    SoundBuzzer(beep_short);
+    FormulateNAddGlucoseMeasData(number % GLUCOSE_CONTEXT_REPEAT_CYCLE_LENGTH,
+                                 SIMULATED_READINGS_START_EPOCH + 
+                                 number * SIMULATED_READINGS_INTERVAL);
+#endif /* ENABLE_SIMULATED_READINGS */
 
     switch(g_gs_data.state)
     {
@@ -1486,10 +1594,11 @@ extern void HandleExtraLongButtonPress(timer_id tid)
 
         /* The device will no more be bonded */
         g_gs_data.bonded = FALSE;
+        g_gs_data.synced_seq_num = 0;
 
         /* Write bonded status to NVM */
         Nvm_Write((uint16*)&g_gs_data.bonded, 
-                  sizeof(g_gs_data.bonded), 
+                  SIZEOF_WORDS(g_gs_data.bonded), 
                   NVM_OFFSET_BONDED_FLAG);
 
 
@@ -1610,6 +1719,96 @@ extern uint16 GetAppConnectedUcid(void)
 }
 
 
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      AppSetBulkTransfer
+ *
+ *  DESCRIPTION
+ *      This function selects the connection parameters wanted: the bulk 
+ *      transfer parameters while a RACP procedure reports many records, the
+ *      preferred low power parameters otherwise. If the current parameters
+ *      do not comply, a connection parameter update is requested straight 
+ *      away, unless the timer of the connection parameter update procedure
+ *      is running, whose expiry requests the parameters then wanted. The 
+ *      requests of a change count towards the 
+ *      MAX_NUM_CONN_PARAM_UPDATE_REQS of the connection, so toggling the 
+ *      parameters does not let a collector which rejects them be asked 
+ *      again and again.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+extern void AppSetBulkTransfer(bool bulk)
+{
+    if(g_gs_data.bulk_transfer == bulk)
+    {
+        return;
+    }
+
+    g_gs_data.bulk_transfer = bulk;
+
+    /* A rejected request is only sent again after Tgap(conn_param_timeout).
+     * If an earlier request is pending, the parameters are checked again
+     * once the collector has applied it.
+     */
+    if((g_gs_data.state == app_connected_not_subscribed ||
+        g_gs_data.state == app_connected_and_subscribed) &&
+       g_gs_data.conn_param_update_tid == TIMER_INVALID &&
+       g_gs_data.num_conn_update_req < MAX_NUM_CONN_PARAM_UPDATE_REQS)
+    {
+        sendConnParamUpdateReq();
+    }
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      AppGetSyncedSeqNum
+ *
+ *  DESCRIPTION
+ *      This function returns the highest sequence number of the glucose 
+ *      records the collector has acknowledged, zero if it has not 
+ *      acknowledged any.
+ *
+ *  RETURNS/MODIFIES
+ *      Sequence number.
+ *
+ *----------------------------------------------------------------------------*/
+extern uint16 AppGetSyncedSeqNum(void)
+{
+    return g_gs_data.synced_seq_num;
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      AppSetSyncedSeqNum
+ *
+ *  DESCRIPTION
+ *      This function records that the collector has acknowledged the glucose
+ *      records up to 'seq_num'. It is written to NVM for the bonded 
+ *      collector, so that its next sync only reports newer records.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+extern void AppSetSyncedSeqNum(uint16 seq_num)
+{
+    if(g_gs_data.synced_seq_num == seq_num)
+    {
+        return;
+    }
+
+    g_gs_data.synced_seq_num = seq_num;
+
+    if(g_gs_data.bonded)
+    {
+        Nvm_Write(&g_gs_data.synced_seq_num, 
+                  SIZEOF_WORDS(g_gs_data.synced_seq_num),
+                  NVM_OFFSET_SYNCED_SEQ_NUM);
+    }
+}
+
 /*----------------------------------------------------------------------------*
  *  NAME
  *      DeleteIdleTimer
@@ -1696,7 +1895,9 @@ void AppInit(sleep_state LastSleepState)
 {
     uint16 gatt_database_length = 0;
     uint16 *p_gatt_database_pointer = NULL;
+#ifdef ENABLE_PTS_WORKAROUNDS
     uint16 pts_cskey = 0;
+#endif /* ENABLE_PTS_WORKAROUNDS */
 /*    DebugInit(0,NULL,NULL);*/
     /* uint8 message[]= {'a','p','p','s','t','a','r','t','e','d','\n','\r'}; 
     const uint8  message_len = (sizeof(message))/sizeof(uint8);*/
@@ -1757,7 +1958,8 @@ void AppInit(sleep_state LastSleepState)
 
     /* Initialize Glucose Sensor state */
     g_gs_data.state = app_init;
-g_pts_abort_test = TRUE;/*I added*/
+
+#ifdef ENABLE_PTS_WORKAROUNDS
     /* Read the project keyr file for user defined CS keys for PTS testcases */
     pts_cskey = CSReadUserKey(PTS_CS_KEY_INDEX);
     if(pts_cskey & PTS_ABORT_CS_KEY_MASK)
@@ -1771,6 +1973,7 @@ g_pts_abort_test = TRUE;/*I added*/
         /* CS key has been set for generating context in every record. */
         g_pts_generate_context_every_record = TRUE;
     }
+#endif /* ENABLE_PTS_WORKAROUNDS */
 
     /* Tell GATT about our database. We will get a GATT_ADD_DB_CFM event when
      * this has completed.
@@ -1778,8 +1981,6 @@ g_pts_abort_test = TRUE;/*I added*/
     p_gatt_database_pointer = GattGetDatabase(&gatt_database_length);
     GattAddDatabaseReq(gatt_database_length, p_gatt_database_pointer);
     /*HandleShortButtonPress();*/
-/*      char string[]="hello";*/
-    /*printForDebug(string);*/
      uartHandle();
      HandleShortButtonPress();
 }
@@ -1974,6 +2175,11 @@ bool AppProcessLmEvent(lm_event_code event_code, LM_EVENT_T *p_event_data)
                                                  p_event_data);
          /*   DebugWriteString("GATT_CHAR_VAL_NOT_CFM\n\r");*/
         break;
+
+        case GATT_CHAR_VAL_IND_CFM:
+            GlucoseHandleSignalGattCharValIndCfm((GATT_CHAR_VAL_IND_CFM_T *)
+                                                 p_event_data);
+        break;
         
         case LM_EV_NUMBER_COMPLETED_PACKETS:
             /* Do nothing */
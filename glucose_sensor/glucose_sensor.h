@@ -149,6 +149,21 @@ typedef struct
 
     /*Variable to store the current connection timeout value. */
     uint16                                      conn_timeout;
+
+    /* TRUE while the bulk transfer connection parameters are wanted instead
+     * of the preferred low power ones
+     */
+    bool                                        bulk_transfer;
+
+    /* TRUE while a connection parameter update request awaits its 
+     * confirmation
+     */
+    bool                                        conn_param_update_pending;
+
+    /* Highest sequence number of the glucose records the collector has 
+     * acknowledged. It is kept in NVM for the bonded collector.
+     */
+    uint16                                      synced_seq_num;
 } APP_DATA_T;
 
 /*============================================================================*
@@ -162,7 +177,7 @@ extern APP_DATA_T g_gs_data;
  *============================================================================*/
 
 /* Magic value to check the sanity of NVM region used by the application */
-#define NVM_SANITY_MAGIC               (0xAB01)
+#define NVM_SANITY_MAGIC               (0xAB04)
 
 /* NVM offset for NVM sanity word */
 #define NVM_OFFSET_SANITY_WORD         (0)
@@ -172,21 +187,27 @@ extern APP_DATA_T g_gs_data;
 
 /* NVM offset for bonded device bluetooth address */
 #define NVM_OFFSET_BONDED_ADDR         (NVM_OFFSET_BONDED_FLAG + \
-                                        sizeof(g_gs_data.bonded))
+                                        SIZEOF_WORDS(g_gs_data.bonded))
 
 /* NVM offset for diversifier */
 #define NVM_OFFSET_SM_DIV              (NVM_OFFSET_BONDED_ADDR + \
-                                        sizeof(g_gs_data.bonded_bd_addr))
+                                        SIZEOF_WORDS(g_gs_data.bonded_bd_addr))
 
 /* NVM offset for IRK */
 #define NVM_OFFSET_SM_IRK              (NVM_OFFSET_SM_DIV + \
-                                        sizeof(g_gs_data.diversifier))
+                                        SIZEOF_WORDS(g_gs_data.diversifier))
+
+/* NVM offset for the highest glucose record sequence number acknowledged by
+ * the bonded collector
+ */
+#define NVM_OFFSET_SYNCED_SEQ_NUM      (NVM_OFFSET_SM_IRK + \
+                                        MAX_WORDS_IRK)
 
 /* Number of words of NVM used by application. Memory used by supported 
  * services is not taken into consideration here.
  */
-#define NVM_MAX_APP_MEMORY_WORDS       (NVM_OFFSET_SM_IRK + \
-                                        MAX_WORDS_IRK)
+#define NVM_MAX_APP_MEMORY_WORDS       (NVM_OFFSET_SYNCED_SEQ_NUM + \
+                                        SIZEOF_WORDS(g_gs_data.synced_seq_num))
 
 
 
@@ -318,6 +318,12 @@ extern void InitGSHardware(void)
 
 
     PioEnablePWM(BUZZER_PWM_INDEX_0, FALSE);
+
+    /* TimerInit has deleted all the timers. The identifier left in the
+     * buzzer timer would otherwise delete the timer of another module on
+     * the next beep.
+     */
+    g_app_hw_data.buzzer_tid = TIMER_INVALID;
 #endif /* ENABLE_BUZZER */
 
     /* Change the I2C pull mode to pull down*/
@@ -330,13 +336,15 @@ extern void InitGSHardware(void)
  *
  *  DESCRIPTION
  *      This function formulates and adds Glucose measurement data to the
- *      glucose measurement queue.
+ *      glucose measurement queue. 'num' is the position of the measurement
+ *      in its GLUCOSE_CONTEXT_REPEAT_CYCLE_LENGTH cycle and 'epoch' its time
+ *      in seconds since 1970.
  *
  *  RETURNS/MODIFIES
  *      Nothing.
  *
  *----------------------------------------------------------------------------*/
-extern void FormulateNAddGlucoseMeasData(uint8 num)
+extern void FormulateNAddGlucoseMeasData(uint8 num, uint32 epoch)
 {
     uint8 mFlag = 0;
     uint8 cFlag = 0;
@@ -345,6 +353,7 @@ extern void FormulateNAddGlucoseMeasData(uint8 num)
     uint16 mLen = 0;
     uint16 cLen = 0;
     uint16 random_val = 0;
+    bool add_context = (num == 2);
 
     /* Fill glucose measurement data */
     mFlag = TIME_OFFSET_PRESENT |
@@ -400,8 +409,11 @@ extern void FormulateNAddGlucoseMeasData(uint8 num)
      * Add context information once in every 
      * GLUCOSE_CONTEXT_REPEAT_CYCLE_LENGTH measurements.
      */
-   /* if(g_pts_generate_context_every_record == TRUE || num == 2)*/
-    if(TRUE)
+#ifdef ENABLE_PTS_WORKAROUNDS
+    add_context = add_context || g_pts_generate_context_every_record;
+#endif /* ENABLE_PTS_WORKAROUNDS */
+
+    if(add_context)
     {
         /* Fill glucose context information data */
         mFlag |= CONTEXT_INFORMATION_PRESENT;
@@ -464,8 +476,8 @@ extern void FormulateNAddGlucoseMeasData(uint8 num)
         cData[cLen ++] = LE8_H(10);
     }
 
-  /*  AddGlucoseMeasurementToQueue(mFlag, mData, mLen,
-                                 cFlag, cData, cLen);*/
+    AddGlucoseMeasurementToQueue(mFlag, mData, mLen,
+                                 cFlag, cData, cLen, epoch);
 }
 
 
@@ -46,6 +46,15 @@
 #define PIO_DIRECTION_OUTPUT                     (TRUE)
 
 #define GLUCOSE_CONTEXT_REPEAT_CYCLE_LENGTH      (3)
+
+#ifdef ENABLE_SIMULATED_READINGS
+/* Time of the first simulated measurement, 2015-05-15 15:04:05 in seconds
+ * since 1970, and the time between simulated measurements in seconds
+ */
+#define SIMULATED_READINGS_START_EPOCH           (1431702245UL)
+#define SIMULATED_READINGS_INTERVAL              (300UL)
+#endif /* ENABLE_SIMULATED_READINGS */
+
 /*============================================================================*
  *  Public Data
  *============================================================================*/
@@ -172,7 +181,7 @@ extern void InitGSHardware(void);
 /* This function formulates and adds the glucose measurement data in measurement
  * queue.
  */
-extern void FormulateNAddGlucoseMeasData(uint8 num);
+extern void FormulateNAddGlucoseMeasData(uint8 num, uint32 epoch);
 
 /* This function initializes the application hardware data. */
 extern void AppHwDataInit(void);
@@ -20,12 +20,16 @@
 #include <bt_event_types.h>
 #include <timer.h>
 #include <ls_app_if.h>
+#ifdef ENABLE_RACP_STATS
+#include <time.h>
+#endif /* ENABLE_RACP_STATS */
 /*============================================================================*
  *  Local Header Files
  *============================================================================*/
 #include "glucose_service.h"
 #include "app_gatt_db.h"
 #include "nvm_access.h"
+#include "gap_conn_params.h"
 
 
 
@@ -33,61 +37,284 @@
  *  Private Data Declaration
  *============================================================================*/
 
+/* Number of words in the deleted measurements bitmap */
+#define MEAS_DELETED_MAP_WORDS  ((MAX_NUMBER_GLUCOSE_MEASUREMENTS + 15) >> 4)
+
+/* Number of words in the glucose record arena, two octets are packed in 
+ * each word.
+ */
+#define GLUCOSE_RECORD_ARENA_WORDS  (GLUCOSE_RECORD_ARENA_SIZE >> 1)
+
+/* Length of the stored glucose measurement header, the flags octet */
+#define MEAS_RECORD_HEADER_LEN      (1)
+
+/* Length of the base time in seconds since 1970 which follows the flags 
+ * octet of a measurement in the NVM record log. The time of a record in the
+ * record arena is kept in its index entry instead.
+ */
+#define MEAS_LOG_TIME_LEN           (4)
+
+/* Length of a user facing time operand of an RACP request, a date time */
+#define RACP_DATE_TIME_LEN          (7)
+
+/* Last year of a user facing time operand, as times in seconds since 1970 
+ * end on 2106-02-07 06:28:15, and the time at which that year starts. Later
+ * dates of the year wrap around to a time before it.
+ */
+#define RACP_MAX_YEAR               (2106)
+#define RACP_MAX_YEAR_START_TIME    (4102444800UL)
+
+/* Length of the stored glucose measurement context header, the flags octet */
+#define CONTEXT_RECORD_HEADER_LEN   (1)
+
+/* Maximum length of a record in the NVM record log, the stored measurement 
+ * with its base time followed by the stored context
+ */
+#define MAX_LEN_STORED_RECORD   (MEAS_RECORD_HEADER_LEN + \
+                                 MEAS_LOG_TIME_LEN + \
+                                 MAX_LEN_MEAS_OPTIONAL_FIELDS + \
+                                 CONTEXT_RECORD_HEADER_LEN + \
+                                 MAX_LEN_CONTEXT_OPTIONAL_FIELDS)
+
+/* Number of sequence numbers reserved in NVM at a time. The sequence number 
+ * stored in NVM is the last one reserved, so it is written once for every 
+ * SEQ_NUM_RESERVE_BLOCK measurements. After a reset the numbers reserved but 
+ * not used are skipped. It must not be more than NVM_RECORD_LOG_ENTRIES.
+ */
+#define SEQ_NUM_RESERVE_BLOCK       (16)
+
+/* Sequence number which follows 0xFFFF. The numbers below it are skipped, 
+ * so that 0 keeps marking the empty entries of the NVM record log and no 
+ * deleted record, and so that the record after 0xFFFF takes the log entry 
+ * after that of 0xFFFF rather than the entry of a record before it.
+ */
+#define SEQ_NUM_AFTER_WRAP \
+                    ((uint16)(0x10000UL % NVM_RECORD_LOG_ENTRIES))
+
+/* Number of sequence numbers of the NVM record log read at a time */
+#define NVM_RECORD_LOG_READ_WORDS   (8)
+
+/* Notifications per connection event which show that the firmware has 
+ * buffers free again after running out of them
+ */
+#define NOTIFY_WINDOW_MAX           (4)
+
+/* Number of records looked at each time the RACP Delete Stored Records 
+ * procedure runs. The procedure yields to the firmware in between, so an 
+ * abort or a radio event is handled without waiting for the whole deletion.
+ */
+#define DELETE_TASK_SLICE           (8)
+
+/* Time after which the RACP Delete Stored Records procedure carries on */
+#define DELETE_TASK_INTERVAL        (1 * MILLISECOND)
+
+/* Maximum length of a Glucose Measurement or Glucose Measurement Context 
+ * characteristic value
+ */
+#define MAX_LEN_RECORD_FIELDS   ((MAX_LEN_MEAS_FIELDS > \
+                                  MAX_LEN_CONTEXT_FIELDS) ? \
+                                  MAX_LEN_MEAS_FIELDS : MAX_LEN_CONTEXT_FIELDS)
+
 /* Application has to take care that it provides the same sequence number
  * to the glucose measurement and context which are related 
  * (i.e., which belong to the same patient record). 
+ *
+ * The measurement and the optional context of a record are stored back to 
+ * back in the record arena with their real lengths. This structure is the 
+ * index entry of the record.
+ *
+ * Records are stored in a compact form and the characteristic values are 
+ * only built when they are notified. The sequence number and the user 
+ * facing time are kept in the index entry only. A measurement is stored as 
+ * its flags and its optional fields (time offset, SFLOAT concentration, 
+ * type-sample location and sensor status annunciation). A context is stored
+ * as its flags and its optional fields.
  */
-typedef struct _glucose_measurement
+typedef struct _glucose_record
 {
     uint16      sequence_number;
 
-    uint16      meas_len;
-
-    bool        deleted;
+    /* User facing time of the measurement in seconds since 1970, that is its
+     * base time plus its time offset. RACP filters on the user facing time 
+     * search these.
+     */
+    uint32      user_time;
 
-    /* All fields of glucose measurement characteristic have to be supplied 
-     * by the application as an uint8 array, which can go upto maximum of 
-     * 7 octets 
+    /* Offset (in octets) of the stored glucose measurement in the record 
+     * arena
      */
-    uint8       meas_data[MAX_LEN_MEAS_FIELDS];
+    uint16      offset;
 
-}GLUCOSE_MEASUREMENT_T;
+    /* Length of the stored glucose measurement */
+    uint8       meas_len;
 
+    /* Length of the stored glucose measurement context, zero if there is no 
+     * context for this record
+     */
+    uint8       context_len;
 
-typedef struct _glucose_context
-{
-    uint16       sequence_number;
-    uint16       context_len;
-    uint8        context_data[MAX_LEN_CONTEXT_FIELDS];
-}GLUCOSE_CONTEXT_T;
+}GLUCOSE_RECORD_T;
 
 
 /* Circular queue for storing pending glucose measurement values */
 typedef struct _cqueue_glucose_measurement
 {
-    /* Circular queue buffer */
-    GLUCOSE_MEASUREMENT_T     gs_meas[MAX_NUMBER_GLUCOSE_MEASUREMENTS];
+    /* Circular queue buffer of record index entries */
+    GLUCOSE_RECORD_T          gs_records[MAX_NUMBER_GLUCOSE_MEASUREMENTS];
+
+    /* Record arena. It is used as a circular buffer of octets, records are
+     * appended at 'arena_end' and freed from the offset of the oldest record.
+     */
+    uint16                    arena[GLUCOSE_RECORD_ARENA_WORDS];
 
-    GLUCOSE_CONTEXT_T         gs_contexts[MAX_NUMBER_GLUCOSE_CONTEXT];
+    /* Offset (in octets) in the record arena following the latest record */
+    uint16                    arena_end;
 
     /* Starting index of circular queue carrying the oldest Glucose measurement 
      * value 
      */
-    uint8                     start_idx;
+    uint16                    start_idx;
+
+    /* Out-standing measurements in the queue, including deleted ones which 
+     * have not been compacted yet
+     */
+    uint16                    num;
+
+    /* Bitmap of deleted measurements, indexed by circular queue index. 
+     * Deleted measurements are never left at either end of the queue.
+     */
+    uint16                    deleted_map[MEAS_DELETED_MAP_WORDS];
+
+    /* Number of deleted measurements in the queue */
+    uint16                    num_deleted;
 
-    /* Out-standing measurements in the queue */
-    uint8                     num;
+    /* TRUE if the user facing times do not decrease from the oldest to the 
+     * latest record, so that they can be binary searched. Records from the
+     * meter are added oldest first, so this only gets cleared if the clock 
+     * of the meter has been set back.
+     */
+    bool                      time_sorted;
 
 } CQUEUE_GLUCOSE_MEASUREMENT_T;
 
+/* Measurements pending transmission are always a contiguous span of the
+ * circular queue, so only its first index and its length are stored.
+ */
 typedef struct _glucose_meas_pending
 {
-    uint8               cqueue_idx[MAX_NUMBER_GLUCOSE_MEASUREMENTS];
-    uint8               num;
-    uint8               current;
+    /* Circular queue index of the first pending measurement */
+    uint16              start_idx;
+
+    /* Number of measurements in the span */
+    uint16              num;
+
+    /* TRUE if the span holds measurements with a user facing time outside
+     * 'min_time' to 'max_time', which are skipped while sending
+     */
+    bool                filter_time;
+    uint32              min_time;
+    uint32              max_time;
 
 } GLUCOSE_MEAS_PENDING_T;
 
+/* Result of the last RACP report query. Collectors usually ask for the 
+ * number of records and then for the records with the same filter, so the 
+ * report reuses the span found by the count. The result is dropped whenever
+ * a record is added, deleted or moved.
+ */
+typedef struct _glucose_query_result
+{
+    /* TRUE if the result holds for the current measurement queue */
+    bool                valid;
+
+    /* Operator, filter type and operands of the query. Sequence number 
+     * operands are widened to 32 bits.
+     */
+    uint8               operator;
+    uint8               filter_type;
+    uint32              min_value;
+    uint32              max_value;
+
+    /* Span of the matching records, as positions in the measurement queue */
+    uint16              first;
+    uint16              end;
+
+    /* TRUE if every record in the span matches the filter */
+    bool                all_match;
+
+    /* Number of matching records which have not been deleted */
+    uint16              num_records;
+
+} GLUCOSE_QUERY_RESULT_T;
+
+/* Deletion of the records selected by an RACP Delete Stored Records 
+ * procedure. The records are deleted a slice at a time from a timer, so 
+ * that the procedure can be aborted in between.
+ */
+typedef struct _glucose_delete_task
+{
+    /* TRUE while selected records are still to be deleted */
+    bool                pending;
+
+    /* Timer which deletes the next slice of records */
+    timer_id            tid;
+
+    /* Connection on which the procedure was requested */
+    uint16              ucid;
+
+    /* Positions of the next record to be looked at and after the last 
+     * selected record, relative to the oldest record. They are moved along
+     * when new measurements overwrite the oldest records in between.
+     */
+    uint16              pos;
+    uint16              end;
+
+    /* TRUE if only the records whose user facing time lies between 
+     * 'min_time' and 'max_time' are deleted
+     */
+    bool                filter_time;
+    uint32              min_time;
+    uint32              max_time;
+
+} GLUCOSE_DELETE_TASK_T;
+
+/* A glucose measurement or context characteristic value of a pending 
+ * measurement, built from its stored form
+ */
+typedef struct _glucose_notify_tuple
+{
+    /* Position in the pending span of the measurement */
+    uint16              pos;
+
+    /* HANDLE_GLUCOSE_MEASUREMENT, HANDLE_GLUCOSE_MEASUREMENT_CONTEXT or 
+     * INVALID_ATT_HANDLE before the first value of the span
+     */
+    uint16              handle;
+
+    /* Characteristic value */
+    uint16              len;
+    uint8               data[MAX_LEN_RECORD_FIELDS];
+
+} GLUCOSE_NOTIFY_TUPLE_T;
+
+/* Cursor over the characteristic values of the pending span in the order 
+ * they are notified: each measurement, followed by its context if it has
+ * one and context notifications are enabled. The value following the last 
+ * notified one is built while the notification is in flight.
+ */
+typedef struct _glucose_notify_cursor
+{
+    /* The last notified value and the value following it */
+    GLUCOSE_NOTIFY_TUPLE_T  tuple[2];
+
+    /* Index in 'tuple' of the last notified value */
+    uint16                  last;
+
+    /* TRUE if the other tuple holds the value following the last one */
+    bool                    next_ready;
+
+} GLUCOSE_NOTIFY_CURSOR_T;
+
 typedef struct
 {
     /* Circular queue for storing Glucose measurement values */
@@ -120,37 +347,61 @@ typedef struct
     /* Boolean indicating a already in progress RACP procedure */
     bool                                racp_procedure_in_progress;
 
-    /* Boolean flag indicating if ABORT operation is in progress */
-    bool                                abort_racp_in_progress;
+    /* Records still to be deleted by the RACP procedure in progress */
+    GLUCOSE_DELETE_TASK_T               delete_task;
 
     uint16                              seq_num;
 
+    /* Last sequence number reserved in NVM */
+    uint16                              seq_num_reserved;
+
+#ifdef ENABLE_PTS_WORKAROUNDS
     /* Timer for PTS, it will be used to introduce one second gap between 
      * two measurement notifications.
      */
     timer_id                            pts_tid;
+#endif /* ENABLE_PTS_WORKAROUNDS */
 
-    /* Variable to store the last pending Glucose Measurement Record index. */
-    uint8                               last_idx;
+    /* Cursor over the notifications of the pending measurements */
+    GLUCOSE_NOTIFY_CURSOR_T             notify_cursor;
 
-    /* Variable to store the handle of the last sent Glucose Measurement Record 
-     * notification.
+    /* Result of the last report query */
+    GLUCOSE_QUERY_RESULT_T              query_result;
+
+    /* TRUE while a report of all the records, or of those since the last 
+     * sync, brings the collector up to date. The collector acknowledges the
+     * records up to 'sync_seq_num' by confirming the RACP response 
+     * indication.
      */
-    uint16                              last_handle;
+    bool                                sync_in_progress;
+    uint16                              sync_seq_num;
 
     /* The following variable will help implementing the flow control mechanism 
      * in the Glucose Sensor application.
      * The Current Flow Control procedure is:
      * The application will keep pumping notifications to the firmware as long 
      * as the firmware returns success in the notification confirmation events,
-     * As soon as the firmware returns a failure, the application will stop 
-     * sending notifications on notification confirmation and will send them only 
-     * on receving Radio Tx events.
+     * As soon as the firmware returns a failure, the application will send
+     * notifications in credits: each Radio Tx event grants 'notify_window' 
+     * notifications, which are sent one by one on their confirmations. The 
+     * window is halved when a notification fails and grows by one after each
+     * connection event in which all of it was accepted. Once a window of 
+     * NOTIFY_WINDOW_MAX has been accepted, the firmware has buffers free 
+     * again and the application goes back to pumping on confirmations.
      * The following variable, when set, will trigger the application to send 
      * notification only on Radio Tx events
      */
     bool                                has_notification_failed_before;
 
+    /* Estimate of the number of notifications the firmware can take per 
+     * connection event, and the number left in the current one
+     */
+    uint16                              notify_window;
+    uint16                              notify_credits;
+
+    /* TRUE while a notification is waiting for its confirmation */
+    bool                                notification_in_flight;
+
     /* The following variable will be used in implementing flow control in the 
      * application. The boolean variable will tell the application that it 
      * should resend the last notification on receiving Radio Tx event as the 
@@ -158,6 +409,11 @@ typedef struct
      */
     bool                                send_the_last_notification_again;
 
+#ifdef ENABLE_RACP_STATS
+    /* Throughput statistics of the last Report Stored Records procedure */
+    GLUCOSE_RACP_STATS_T                racp_stats;
+#endif /* ENABLE_RACP_STATS */
+
 }GLUCOSE_SERVICE_DATA_T;
 
 /*============================================================================*
@@ -166,10 +422,109 @@ typedef struct
 
 GLUCOSE_SERVICE_DATA_T g_glucose_data;
 
+/* Days in each month of a year which is not a leap year */
+static const uint8 g_days_in_month[12] =
+{
+    31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31
+};
+
+/*============================================================================*
+ *  Private Definitions
+ *============================================================================*/
+
+/* Index in the circular queue buffer of the record at position 'pos', where
+ * position 0 is the oldest stored record.
+ */
+#define MEAS_QUEUE_IDX(pos)     ((g_glucose_data.gs_meas_queue.start_idx + \
+                                  (pos)) % MAX_NUMBER_GLUCOSE_MEASUREMENTS)
+
+/* Sequence number of the record at position 'pos' */
+#define MEAS_QUEUE_SEQ_NUM(pos) (g_glucose_data.gs_meas_queue. \
+                                  gs_records[MEAS_QUEUE_IDX(pos)]. \
+                                  sequence_number)
+
+/* User facing time of the record at position 'pos' */
+#define MEAS_QUEUE_TIME(pos)    (g_glucose_data.gs_meas_queue. \
+                                  gs_records[MEAS_QUEUE_IDX(pos)]. \
+                                  user_time)
+
+/* Macros to test, set and clear the deleted flag of the measurement at 
+ * circular queue index 'idx'
+ */
+#define MEAS_IS_DELETED(idx)    (g_glucose_data.gs_meas_queue. \
+                                  deleted_map[(idx) >> 4] & \
+                                  (1u << ((idx) & 0xf)))
+
+#define MEAS_SET_DELETED(idx)   (g_glucose_data.gs_meas_queue. \
+                                  deleted_map[(idx) >> 4] |= \
+                                  (1u << ((idx) & 0xf)))
+
+#define MEAS_CLEAR_DELETED(idx) (g_glucose_data.gs_meas_queue. \
+                                  deleted_map[(idx) >> 4] &= \
+                                  ~(1u << ((idx) & 0xf)))
+
+/* Index in the circular queue buffer of the pending record at position 'pos'
+ * of the pending span.
+ */
+#define MEAS_PENDING_IDX(pos)   ((g_glucose_data.meas_pending.start_idx + \
+                                  (pos)) % MAX_NUMBER_GLUCOSE_MEASUREMENTS)
+
 /*============================================================================*
  *  Private Function Declarations
  *============================================================================*/
 
+/* This function returns the position of the first record of the latest lap
+ * of sequence numbers.
+ */
+static uint16 findMeasLapStart(void);
+
+/* This function returns the position of the first record of a span whose 
+ * sequence number is not less than the one supplied.
+ */
+static uint16 findMeasLowerBound(uint16 seq_num, uint16 low, uint16 high);
+
+/* This function returns the position of the first record of a span whose 
+ * sequence number is greater than the one supplied.
+ */
+static uint16 findMeasUpperBound(uint16 seq_num, uint16 low, uint16 high);
+
+/* This function returns the position of the first record which is newer 
+ * than the one with the sequence number supplied.
+ */
+static uint16 findMeasNewerThan(uint16 seq_num);
+
+/* This function finds the span of records matching a sequence number 
+ * filter.
+ */
+static void findMeasRangeBasedOnSeqNum(uint8 operator, uint16 min_seq_num,
+                                       uint16 max_seq_num, uint16 *p_first,
+                                       uint16 *p_end);
+
+/* This function returns the position of the first record whose user facing
+ * time is not less than the one supplied.
+ */
+static uint16 findMeasTimeLowerBound(uint32 user_time);
+
+/* This function returns the position of the first record whose user facing
+ * time is greater than the one supplied.
+ */
+static uint16 findMeasTimeUpperBound(uint32 user_time);
+
+/* This function finds the span of records matching a user facing time 
+ * filter.
+ */
+static bool findMeasRangeBasedOnTime(uint32 min_time, uint32 max_time,
+                                     uint16 *p_first, uint16 *p_end);
+
+/* This function reads the user facing time operands of an RACP filter. */
+static uint8 readTimeOperands(uint8 operator, uint8 *p_value, 
+                              uint16 size_value, uint32 *p_min_time, 
+                              uint32 *p_max_time);
+
+/* This function looks up the result of the last report query. */
+static bool queryResultHit(uint8 operator, uint8 filter_type, 
+                           uint32 min_value, uint32 max_value);
+
 /* This function sends the first or last record to the collector. */
 static void sendFirstOrLastMeasRecord(uint16 ucid, uint8 operator);
 
@@ -177,6 +532,15 @@ static void sendFirstOrLastMeasRecord(uint16 ucid, uint8 operator);
 static uint16 sendMeasBasedOnSeqNum(uint16 ucid, uint8 opcode, uint8 operator, 
                         uint16 min_seq_num, uint16 max_seq_num);
 
+/* This function checks a pending record against the time filter of the 
+ * request.
+ */
+static bool measPendingInTimeRange(uint16 pos);
+
+/* This function sends the Glucose measurements based on user facing time. */
+static uint16 sendMeasBasedOnTime(uint16 ucid, uint8 opcode, uint8 operator,
+                                  uint32 min_time, uint32 max_time);
+
 /* This function sends the GLucose Record access control point indication for 
  * number of stored records procedure.
  */
@@ -190,14 +554,112 @@ static void sendRACPResponseInd(uint16 ucid, uint8 req_code, uint8 res_value);
 /* This function handles the access request on RACP character. */
 static void handleRACP(GATT_ACCESS_IND_T *p_ind);
 
-/* This function deletes the measurement records from the queue based on 
+/* This function selects the measurement records to be deleted based on 
  * sequence number.
  */
 static void deleteMeasRecordsBasedOnSeqNum(uint8 operator, uint16 min_seq_num,
                                            uint16 max_seq_num);
 
-/* This function removed holes from the measurement queue.*/
-static void removeHolesFromMeasurementQueue(void);
+/* This function selects the measurement records to be deleted based on 
+ * user facing time.
+ */
+static void deleteMeasRecordsBasedOnTime(uint32 min_time, uint32 max_time);
+
+/* This function deletes the next slice of the selected records */
+static bool deleteTaskStep(void);
+
+/* This function deletes the next slice of the selected records, or ends the
+ * Delete Stored Records procedure once they have all been deleted.
+ */
+static void deleteTaskRun(void);
+
+/* This function is called on expiry of the timer of the delete task */
+static void deleteTaskTimerHandler(timer_id tid);
+
+/* This function stops deleting the selected records */
+static void deleteTaskStop(void);
+
+/* This function aborts the RACP procedure in progress */
+static void abortRACPProcedure(uint16 ucid);
+
+/* This function copies octets into the record arena */
+static void arenaWrite(uint16 offset, const uint8 *p_data, uint16 len);
+
+/* This function copies octets out of the record arena */
+static void arenaRead(uint16 offset, uint8 *p_data, uint16 len);
+
+/* This function returns the number of free octets in the record arena */
+static uint16 arenaFreeSpace(void);
+
+/* This function builds the glucose measurement or context characteristic 
+ * value of a record.
+ */
+static uint16 buildRecordValue(uint16 idx, uint16 handle, uint8 *p_data);
+
+/* This function restarts the notification cursor before the first pending 
+ * measurement
+ */
+static void notifyCursorReset(void);
+
+/* This function builds the characteristic value following 'p_prev' */
+static bool notifyCursorBuild(const GLUCOSE_NOTIFY_TUPLE_T *p_prev,
+                              GLUCOSE_NOTIFY_TUPLE_T *p_tuple);
+
+/* This function returns the value following the last notified one */
+static const GLUCOSE_NOTIFY_TUPLE_T *notifyCursorPeek(void);
+
+/* This function notifies the value following the last notified one */
+static void notifyCursorSendNext(uint16 ucid);
+
+/* This function marks a stored measurement as deleted */
+static void deleteMeasRecord(uint16 pos);
+
+/* This function drops the oldest measurement of the queue */
+static void dropOldestMeasRecord(void);
+
+/* This function drops deleted measurements from both ends of the queue */
+static void trimMeasQueue(void);
+
+/* This function counts the deleted measurements in a span of the queue */
+static uint16 countDeletedMeasRecords(uint16 pos, uint16 end);
+
+/* This function removes one deleted measurement from the middle of the 
+ * queue.
+ */
+static bool compactMeasQueueStep(void);
+
+/* This function adds a record to the end of the measurement queue and 
+ * reserves its place in the record arena.
+ */
+static uint16 allocRecord(uint16 seq_num, uint32 user_time, uint16 meas_len, 
+                          uint16 context_len);
+
+/* This function converts a time offset field to seconds */
+static uint32 timeOffsetToSeconds(const uint8 *p_offset);
+
+/* This function returns the user facing time of a measurement in the form
+ * it has in the NVM record log.
+ */
+static uint32 measUserFacingTime(const uint8 *p_meas);
+
+/* This function stores a record in the form it has in the NVM record log in 
+ * the measurement queue.
+ */
+static void storeRecord(uint16 seq_num, const uint8 *p_data, 
+                        uint16 meas_len, uint16 context_len);
+
+/* This function writes a record to the NVM record log */
+static void writeRecordToLog(uint16 seq_num, const uint8 *p_data, 
+                             uint16 meas_len, uint16 context_len);
+
+/* This function marks a deleted record as empty in the NVM record log */
+static void eraseRecordFromLog(uint16 seq_num);
+
+/* This function finds the last record written to the NVM record log */
+static uint16 findLastSeqNumInLog(void);
+
+/* This function restores the records of the NVM record log */
+static void readRecordLog(uint16 last_seq_num);
 
 /* This function sends the Glucose context of the current record. If there is 
  * no Glucose context present, it moves to the next record.
@@ -207,10 +669,12 @@ static void sendMeasContextOrMoveToNextRecord(uint16 ucid);
 /* This function send the measurement notifications. */
 static void sendMeasNotifications(uint16 ucid);
 
+#ifdef ENABLE_PTS_WORKAROUNDS
 /* This function is only for PTS test case. It sends glucose measurement 
  * notifications with a gap of 1 seconds between two notifications.
  */
 static void ptsSendMeasNotifications(timer_id tid);
+#endif /* ENABLE_PTS_WORKAROUNDS */
 
 /*============================================================================*
  *         Private Function Implementations
@@ -218,420 +682,2064 @@ static void ptsSendMeasNotifications(timer_id tid);
 
 /*----------------------------------------------------------------------------*
  *  NAME
- *      deleteMeasRecordsBasedOnSeqNum
+ *      findMeasLapStart
  *
  *  DESCRIPTION
- *      This function is used to delete glucose measurement records in range
+ *      This function does a binary search over the measurement queue for the
+ *      first record of the latest lap of sequence numbers. Records are only 
+ *      ever appended to the queue with an incremented sequence number, which
+ *      wraps from 0xFFFF to SEQ_NUM_AFTER_WRAP. So the queue holds the end of
+ *      the previous lap, whose sequence numbers are above the latest one, 
+ *      followed by the records of the latest lap, and the sequence numbers 
+ *      rise within each lap. Like in findMeasNewerThan, records are told 
+ *      apart by how far they are behind the latest sequence number: only 
+ *      those of the previous lap are further behind than the latest 
+ *      sequence number itself.
  *
  *  RETURNS/MODIFIES
- *      Nothing.
+ *      Position of the record relative to the oldest record, or the number 
+ *      of stored records if there is no such record.
  *
  *----------------------------------------------------------------------------*/
-static void deleteMeasRecordsBasedOnSeqNum(uint8 operator, uint16 min_seq_num,
-                                           uint16 max_seq_num)
+static uint16 findMeasLapStart(void)
 {
-    uint8 idx = g_glucose_data.gs_meas_queue.start_idx;
-    uint8 num_elements = g_glucose_data.gs_meas_queue.num;
-    uint16 start_idx_seq_num;
+    uint16 latest = g_glucose_data.seq_num;
+    uint16 low = 0;
+    uint16 high = g_glucose_data.gs_meas_queue.num;
+    uint16 mid;
 
-    /* Go through the list of measurements and mark it for deletion if the
-     * sequence number falls in range
-     */
-    while(num_elements)
+    while(low < high)
     {
-        start_idx_seq_num = g_glucose_data.gs_meas_queue
-                                          .gs_meas[idx].sequence_number;
+        mid = low + ((high - low) >> 1);
 
-        switch(operator)
+        if((uint16)(latest - MEAS_QUEUE_SEQ_NUM(mid)) > latest)
         {
-            case WITHIN_RANGE_OF:
-            {
-                /* Operator and operand validation */
-                if(start_idx_seq_num >= min_seq_num &&
-                    start_idx_seq_num <= max_seq_num)
-                {
-                    /* Set the deleted flag in measurement data */
-                    g_glucose_data.gs_meas_queue.gs_meas[idx].deleted = TRUE;
-                }
-            }
-            break;
-            case LESS_THAN_OR_EQUAL_TO:
-            {
-                /* min_seq_num won't get used in this case */
-                if(start_idx_seq_num <= max_seq_num)
-                {
-                    /* Set the deleted flag in measurement data */
-                    g_glucose_data.gs_meas_queue.gs_meas[idx].deleted = TRUE;
-                }
-            }
-            break;
-            case GREATER_THAN_OR_EQUAL_TO:
-            {
-                /*max_seq_num won't get used in this case */
-                if(start_idx_seq_num >= min_seq_num)
-                {
-                    /* Set the deleted flag in measurement data */
-                    g_glucose_data.gs_meas_queue.gs_meas[idx].deleted = TRUE;
-                }
-            }
-            break;
-            default:
-                /* Control should not come here */
-            break;
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
         }
-
-        idx = (idx + 1) % MAX_NUMBER_GLUCOSE_MEASUREMENTS;
-
-        num_elements--;
     }
 
+    return low;
 }
 
 /*----------------------------------------------------------------------------*
  *  NAME
- *      removeHolesFromMeasurementQueue
+ *      findMeasLowerBound
  *
  *  DESCRIPTION
- *      This function is removes holes from the measurement queue 
+ *      This function does a binary search over the records from position 
+ *      'low' up to 'high' for the first record whose sequence number is 
+ *      greater than or equal to 'seq_num'. The records must be of the same 
+ *      lap of sequence numbers, see findMeasLapStart.
  *
  *  RETURNS/MODIFIES
- *      Nothing.
+ *      Position of the record relative to the oldest record, or 'high' if 
+ *      there is no such record.
  *
  *----------------------------------------------------------------------------*/
-static void removeHolesFromMeasurementQueue(void)
+static uint16 findMeasLowerBound(uint16 seq_num, uint16 low, uint16 high)
 {
-    uint8 index = g_glucose_data.gs_meas_queue.start_idx;
-    uint8 num_of_elements = g_glucose_data.gs_meas_queue.num;
-
-    /* This will be final  start index after hole removal */
-    uint8 final_start = g_glucose_data.gs_meas_queue.start_idx;
+    uint16 mid;
 
-    /* Temporary index for  iteration*/
-    uint8 temp_index = g_glucose_data.gs_meas_queue.start_idx; 
-
-    uint8 final_num_of_elements = 0; /* Will be final num of elements after
-                                      * hole removal 
-                                      */
-    while(num_of_elements)
+    while(low < high)
     {
-        /* This loop body will be executed for all the elements in the array */
-        if(g_glucose_data.gs_meas_queue.gs_meas[index].deleted == TRUE )
+        mid = low + ((high - low) >> 1);
+
+        if(MEAS_QUEUE_SEQ_NUM(mid) < seq_num)
         {
-            /* This glucose measurement has been deleted */
-            /* don't do anything */
+            low = mid + 1;
         }
         else
         {
-            /* This measurement is present. Move it to first empty index
-             * in the final array 
-             */
-            g_glucose_data.gs_meas_queue.gs_meas[temp_index] = 
-                    g_glucose_data.gs_meas_queue.gs_meas[index];
-            /* Move the corresponding glucose measurement context also
-             * to right location. If context was not measured then also, this 
-             * assignment won't harm.
-             */
-            g_glucose_data.gs_meas_queue.gs_contexts[temp_index] = 
-                    g_glucose_data.gs_meas_queue.gs_contexts[index];
-
-            /* Move index further */
-            temp_index = (temp_index + 1) % MAX_NUMBER_GLUCOSE_MEASUREMENTS;
-
-            /* Increase the final num of elements*/
-            final_num_of_elements++;
+            high = mid;
         }
-        index = (index + 1) % MAX_NUMBER_GLUCOSE_MEASUREMENTS;
-        num_of_elements--;
     }
 
-    if(final_num_of_elements != 0)
-    {
-        /* There are non-deleted measurements */
-        g_glucose_data.gs_meas_queue.start_idx = final_start;
-        
-        g_glucose_data.gs_meas_queue.num = final_num_of_elements;
-    }
-    else
-    {
-        /* All measurements got deleted */
-        g_glucose_data.data_pending = FALSE;
-
-        g_glucose_data.gs_meas_queue.start_idx = 0;
-        g_glucose_data.gs_meas_queue.num = 0;
-    }
+    return low;
 }
+
 /*----------------------------------------------------------------------------*
  *  NAME
- *      sendFirstOrLastMeasRecord
+ *      findMeasUpperBound
  *
  *  DESCRIPTION
- *      This function is used to report First (Oldest) or Last (Latest) 
- *      measurement data to the collector.
- *      
+ *      This function does a binary search over the records from position 
+ *      'low' up to 'high' for the first record whose sequence number is 
+ *      greater than 'seq_num'. The records must be of the same lap of 
+ *      sequence numbers, see findMeasLapStart.
  *
  *  RETURNS/MODIFIES
- *      Nothing.
+ *      Position of the record relative to the oldest record, or 'high' if 
+ *      there is no such record.
  *
  *----------------------------------------------------------------------------*/
-static void sendFirstOrLastMeasRecord(uint16 ucid, uint8 operator)
+static uint16 findMeasUpperBound(uint16 seq_num, uint16 low, uint16 high)
 {
-    uint8 index;
-
-    /* Initialise measurement pending tx data */
-    g_glucose_data.meas_pending.num = 0;
-    g_glucose_data.meas_pending.current = 0;
+    uint16 mid;
 
-    /* Send data to collector */
-     if(operator == FIRST_RECORD) /* Oldest record */
-    {
-        index = g_glucose_data.gs_meas_queue.start_idx;
-    }
-    else /* LAST_RECORD or most Recent Record */
+    while(low < high)
     {
-        index = 
-              (g_glucose_data.gs_meas_queue.start_idx +
-              g_glucose_data.gs_meas_queue.num - 1) % 
-              MAX_NUMBER_GLUCOSE_MEASUREMENTS;
-    }
-
-    g_glucose_data.meas_pending.cqueue_idx[0] = index;
+        mid = low + ((high - low) >> 1);
 
-    g_glucose_data.meas_pending.num = 1;
+        if(MEAS_QUEUE_SEQ_NUM(mid) <= seq_num)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
 
+    return low;
 }
+
 /*----------------------------------------------------------------------------*
  *  NAME
- *      ptsSendMeasNotifications
+ *      findMeasNewerThan
  *
  *  DESCRIPTION
- *      This function will be used only for those PTS test cases which will be 
- *      writing ABORT on RACP and will send glucose measurement notifications
- *      upon expiry of a timer.
+ *      This function does a binary search over the measurement queue for the
+ *      first record which was added after the one with sequence number 
+ *      'seq_num'. Sequence numbers wrap around, so records are compared by 
+ *      how far they are behind the latest sequence number rather than by 
+ *      their value. A sequence number which is not behind the latest one 
+ *      at all has nothing newer than it.
  *
  *  RETURNS/MODIFIES
- *      Nothing.
+ *      Position of the record relative to the oldest record, or the number 
+ *      of stored records if there is no such record.
  *
  *----------------------------------------------------------------------------*/
-static void ptsSendMeasNotifications(timer_id tid)
+static uint16 findMeasNewerThan(uint16 seq_num)
 {
-    /* Send glucose notification */
-    if(tid == g_glucose_data.pts_tid)
+    uint16 newer = g_glucose_data.seq_num - seq_num;
+    uint16 low = 0;
+    uint16 high = g_glucose_data.gs_meas_queue.num;
+    uint16 mid;
+
+    while(low < high)
     {
-        sendMeasNotifications(GetAppConnectedUcid());
+        mid = low + ((high - low) >> 1);
+
+        if((uint16)(g_glucose_data.seq_num - MEAS_QUEUE_SEQ_NUM(mid)) >= 
+                                                                    newer)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
     }
-    /* Else Ignore. This may be due to some race condition */
+
+    return low;
 }
 
 /*----------------------------------------------------------------------------*
  *  NAME
- *      sendMeasContextOrMoveToNextRecord
+ *      findMeasRangeBasedOnSeqNum
  *
  *  DESCRIPTION
- *      If a Glucose Context is present for the current Glucose Record, the 
- *      application sends it otherwise it moves to the next record.
+ *      This function finds the contiguous span of stored records whose 
+ *      sequence number satisfies the RACP operator. 'min_seq_num' is used by
+ *      GREATER_THAN_OR_EQUAL_TO and WITHIN_RANGE_OF, 'max_seq_num' is used by
+ *      LESS_THAN_OR_EQUAL_TO and WITHIN_RANGE_OF. OPERATOR_SINCE_LAST_SYNC 
+ *      matches the records newer than the one numbered 'min_seq_num'.
+ *
+ *      Sequence numbers are compared by value within each lap, see 
+ *      findMeasLapStart. When the queue holds records of two laps and both 
+ *      have matches which are not adjacent, only those of the latest lap 
+ *      are taken, so that the span stays contiguous.
  *
  *  RETURNS/MODIFIES
- *      Nothing.
+ *      p_first - position of the first matching record
+ *      p_end   - position after the last matching record
  *
  *----------------------------------------------------------------------------*/
-static void sendMeasContextOrMoveToNextRecord(uint16 ucid)
+static void findMeasRangeBasedOnSeqNum(uint8 operator, uint16 min_seq_num,
+                                       uint16 max_seq_num, uint16 *p_first,
+                                       uint16 *p_end)
 {
-    uint8 idx;
-    /* Check if collector has not aborted the ongoing procedure */
-    if(!g_glucose_data.abort_racp_in_progress &&
-        g_glucose_data.racp_procedure_in_progress)
-    {
-        idx = g_glucose_data.
-                          meas_pending.cqueue_idx[g_glucose_data.last_idx];
+    uint16 num = g_glucose_data.gs_meas_queue.num;
+    uint16 lap;
+    uint16 first;
+    uint16 end;
 
-        /* If the application had sent a Glucose Measurement 
-         * notification, if there is context information 
-         * present for the same record, send it. Otherwise send 
-         * the next Glucose measurement notification
-         */
-        if((g_glucose_data.last_handle == HANDLE_GLUCOSE_MEASUREMENT) &&
-           (g_glucose_data.context_client_config == 
-                                          gatt_client_config_notification) &&
-           g_glucose_data.gs_meas_queue.gs_contexts[idx].context_len)
+    *p_first = 0;
+    *p_end = 0;
+
+    switch(operator)
+    {
+        case ALL_RECORDS:
         {
-            /* If context is present, Send that too */
-            GattCharValueNotification(ucid, 
-                    HANDLE_GLUCOSE_MEASUREMENT_CONTEXT,
-                    g_glucose_data.gs_meas_queue.gs_contexts[idx].context_len,
-                    g_glucose_data.gs_meas_queue.gs_contexts[idx].context_data);
-                 /*DebugWriteString("sendMeasContextOrMoveToNextRecord");*/
-            /* Reset the last stored handle.*/
-            g_glucose_data.last_handle = HANDLE_GLUCOSE_MEASUREMENT_CONTEXT;
+            *p_end = num;
+            return;
+        }
+
+        case OPERATOR_SINCE_LAST_SYNC:
+        {
+            *p_first = findMeasNewerThan(min_seq_num);
+            *p_end = num;
+            return;
+        }
+
+        case LESS_THAN_OR_EQUAL_TO:
+        {
+            min_seq_num = 0;
+        }
+        break;
+
+        case GREATER_THAN_OR_EQUAL_TO:
+        {
+            max_seq_num = 0xFFFF;
+        }
+        break;
+
+        case WITHIN_RANGE_OF:
+        {
+            if(min_seq_num > max_seq_num)
+            {
+                return;
+            }
+        }
+        break;
+
+        default:
+            /* Control should not come here */
+        return;
+    }
+
+    lap = findMeasLapStart();
+
+    /* Matches of the previous lap */
+    *p_first = findMeasLowerBound(min_seq_num, 0, lap);
+    *p_end = findMeasUpperBound(max_seq_num, *p_first, lap);
+
+    /* Matches of the latest lap */
+    first = findMeasLowerBound(min_seq_num, lap, num);
+    end = findMeasUpperBound(max_seq_num, first, num);
+
+    if(first < end)
+    {
+        if(*p_first == *p_end || *p_end != lap || first != lap)
+        {
+            *p_first = first;
+        }
+
+        *p_end = end;
+    }
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      deleteMeasRecordsBasedOnSeqNum
+ *
+ *  DESCRIPTION
+ *      This function selects the glucose measurement records in range for 
+ *      deletion. They are deleted by the delete task.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+static void deleteMeasRecordsBasedOnSeqNum(uint8 operator, uint16 min_seq_num,
+                                           uint16 max_seq_num)
+{
+    GLUCOSE_DELETE_TASK_T *p_task = &g_glucose_data.delete_task;
+    uint16 pos;
+    uint16 end;
+
+    /* Find the records with the sequence number in range */
+    findMeasRangeBasedOnSeqNum(operator, min_seq_num, max_seq_num, 
+                               &pos, &end);
+
+    if(pos < end)
+    {
+        p_task->pending = TRUE;
+        p_task->pos = pos;
+        p_task->end = end;
+        p_task->filter_time = FALSE;
+    }
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      findMeasTimeLowerBound
+ *
+ *  DESCRIPTION
+ *      This function does a binary search over the measurement queue for the
+ *      first record whose user facing time is greater than or equal to 
+ *      'user_time'. It is only used while the user facing times are sorted.
+ *
+ *  RETURNS/MODIFIES
+ *      Position of the record relative to the oldest record, or the number 
+ *      of stored records if there is no such record.
+ *
+ *----------------------------------------------------------------------------*/
+static uint16 findMeasTimeLowerBound(uint32 user_time)
+{
+    uint16 low = 0;
+    uint16 high = g_glucose_data.gs_meas_queue.num;
+    uint16 mid;
+
+    while(low < high)
+    {
+        mid = low + ((high - low) >> 1);
+
+        if(MEAS_QUEUE_TIME(mid) < user_time)
+        {
+            low = mid + 1;
         }
         else
         {
-            /* There is no context to be sent, move to the next record.*/
-                
-            /* Increment the pending data index.*/
-            g_glucose_data.meas_pending.current++;
-    
-            if(g_pts_abort_test)
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      findMeasTimeUpperBound
+ *
+ *  DESCRIPTION
+ *      This function does a binary search over the measurement queue for the
+ *      first record whose user facing time is greater than 'user_time'. It 
+ *      is only used while the user facing times are sorted.
+ *
+ *  RETURNS/MODIFIES
+ *      Position of the record relative to the oldest record, or the number 
+ *      of stored records if there is no such record.
+ *
+ *----------------------------------------------------------------------------*/
+static uint16 findMeasTimeUpperBound(uint32 user_time)
+{
+    uint16 low = 0;
+    uint16 high = g_glucose_data.gs_meas_queue.num;
+    uint16 mid;
+
+    while(low < high)
+    {
+        mid = low + ((high - low) >> 1);
+
+        if(MEAS_QUEUE_TIME(mid) <= user_time)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      findMeasRangeBasedOnTime
+ *
+ *  DESCRIPTION
+ *      This function finds the span of stored records whose user facing time
+ *      lies between 'min_time' and 'max_time'. While the times are sorted the
+ *      span is found by binary search and every record in it matches. 
+ *      Otherwise the queue is scanned for the first and the last matching 
+ *      records, and the span may hold records which do not match.
+ *
+ *  RETURNS/MODIFIES
+ *      p_first - position of the first matching record
+ *      p_end   - position after the last matching record
+ *      TRUE if every record in the span matches.
+ *
+ *----------------------------------------------------------------------------*/
+static bool findMeasRangeBasedOnTime(uint32 min_time, uint32 max_time,
+                                     uint16 *p_first, uint16 *p_end)
+{
+    uint32 user_time;
+    uint16 pos;
+
+    *p_first = 0;
+    *p_end = 0;
+
+    if(g_glucose_data.gs_meas_queue.time_sorted)
+    {
+        /* 'min_time' is not greater than 'max_time' */
+        *p_first = findMeasTimeLowerBound(min_time);
+        *p_end = findMeasTimeUpperBound(max_time);
+
+        return TRUE;
+    }
+
+    for(pos = 0; pos < g_glucose_data.gs_meas_queue.num; pos++)
+    {
+        user_time = MEAS_QUEUE_TIME(pos);
+
+        if(user_time >= min_time && user_time <= max_time &&
+           !MEAS_IS_DELETED(MEAS_QUEUE_IDX(pos)))
+        {
+            if(*p_end == 0)
             {
-                /* If PTS abort test case is running and project
-                 * keyr file has been configured accordingly, 
-                 * introduce one secong gap between glucose 
-                 * records. Start a one second timer and when it
-                 * expires, send the notification over the air.
-                 */
-                
-                 TimerDelete(g_glucose_data.pts_tid);
-                 g_glucose_data.pts_tid = TimerCreate(0.1*SECOND, 
-                                                       TRUE,
-                                                     ptsSendMeasNotifications);
+                *p_first = pos;
             }
-            else
+            *p_end = pos + 1;
+        }
+    }
+
+    return FALSE;
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      deleteMeasRecordsBasedOnTime
+ *
+ *  DESCRIPTION
+ *      This function selects the glucose measurement records whose user 
+ *      facing time lies between 'min_time' and 'max_time' for deletion. They 
+ *      are deleted by the delete task.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+static void deleteMeasRecordsBasedOnTime(uint32 min_time, uint32 max_time)
+{
+    GLUCOSE_DELETE_TASK_T *p_task = &g_glucose_data.delete_task;
+    uint16 pos;
+    uint16 end;
+    bool all_match;
+
+    all_match = findMeasRangeBasedOnTime(min_time, max_time, &pos, &end);
+
+    if(pos < end)
+    {
+        p_task->pending = TRUE;
+        p_task->pos = pos;
+        p_task->end = end;
+        p_task->filter_time = !all_match;
+        p_task->min_time = min_time;
+        p_task->max_time = max_time;
+    }
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      deleteTaskStep
+ *
+ *  DESCRIPTION
+ *      This function deletes the records selected for deletion among the 
+ *      next DELETE_TASK_SLICE records.
+ *
+ *  RETURNS/MODIFIES
+ *      Boolean TRUE if there are more records to be looked at
+ *              FALSE if all the selected records have been deleted
+ *
+ *----------------------------------------------------------------------------*/
+static bool deleteTaskStep(void)
+{
+    GLUCOSE_DELETE_TASK_T *p_task = &g_glucose_data.delete_task;
+    uint32 user_time;
+    uint16 pos = p_task->pos;
+    uint16 end = p_task->end;
+    uint16 num = 0;
+
+    if(!p_task->pending)
+    {
+        return FALSE;
+    }
+
+    /* Deleted records may have been dropped from the end of the queue */
+    if(end > g_glucose_data.gs_meas_queue.num)
+    {
+        end = g_glucose_data.gs_meas_queue.num;
+    }
+
+    /* The NVM record log entries of consecutive records are adjacent, so 
+     * their erasures are merged into few NVM writes.
+     */
+    Nvm_BeginTransaction();
+
+    for(; pos < end && num < DELETE_TASK_SLICE; pos++, num++)
+    {
+        user_time = MEAS_QUEUE_TIME(pos);
+
+        if(!p_task->filter_time || 
+           (user_time >= p_task->min_time && user_time <= p_task->max_time))
+        {
+            deleteMeasRecord(pos);
+        }
+    }
+
+    Nvm_CommitTransaction();
+
+    if(pos < end)
+    {
+        p_task->pos = pos;
+        p_task->end = end;
+        return TRUE;
+    }
+
+    p_task->pending = FALSE;
+
+    return FALSE;
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      deleteTaskRun
+ *
+ *  DESCRIPTION
+ *      This function deletes the next slice of the selected records. If more
+ *      records are left, it yields to the firmware and carries on from a 
+ *      timer. Otherwise it ends the Delete Stored Records procedure.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+static void deleteTaskRun(void)
+{
+    if(deleteTaskStep())
+    {
+        g_glucose_data.delete_task.tid = TimerCreate(DELETE_TASK_INTERVAL, 
+                                                     TRUE, 
+                                                     deleteTaskTimerHandler);
+    }
+    else
+    {
+        /* Drop the deleted records from the ends of the queue. Any deleted 
+         * records left in the middle are compacted later when the 
+         * application is idle, so the response is not delayed by moving 
+         * records around.
+         */
+        trimMeasQueue();
+
+        /* Send RACP response indication */
+        sendRACPResponseInd(g_glucose_data.delete_task.ucid, 
+                            DELETE_STORED_RECORDS, RESPONSE_CODE_SUCCESS);
+    }
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      deleteTaskTimerHandler
+ *
+ *  DESCRIPTION
+ *      This function is called on expiry of the timer of the delete task.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+static void deleteTaskTimerHandler(timer_id tid)
+{
+    if(tid == g_glucose_data.delete_task.tid)
+    {
+        g_glucose_data.delete_task.tid = TIMER_INVALID;
+        deleteTaskRun();
+    }
+    /* Else Ignore. This may be due to some race condition */
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      deleteTaskStop
+ *
+ *  DESCRIPTION
+ *      This function stops deleting the selected records. The records 
+ *      deleted so far stay deleted.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+static void deleteTaskStop(void)
+{
+    if(g_glucose_data.delete_task.pending)
+    {
+        TimerDelete(g_glucose_data.delete_task.tid);
+        g_glucose_data.delete_task.tid = TIMER_INVALID;
+        g_glucose_data.delete_task.pending = FALSE;
+
+        trimMeasQueue();
+    }
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      readTimeOperands
+ *
+ *  DESCRIPTION
+ *      This function reads the user facing time operands of an RACP request
+ *      with the operator 'operator'. 'p_value' points to the first operand, 
+ *      following the filter type, and 'size_value' is the length of the 
+ *      whole request. An operand is a date time, which is converted to 
+ *      seconds since 1970. An operator with a single operand leaves the 
+ *      other end of the range open.
+ *
+ *  RETURNS/MODIFIES
+ *      RESPONSE_CODE_SUCCESS, or INVALID_OPERAND if the operands are 
+ *      malformed, are not dates or do not fit in 32 bits.
+ *
+ *----------------------------------------------------------------------------*/
+static uint8 readTimeOperands(uint8 operator, uint8 *p_value, 
+                              uint16 size_value, uint32 *p_min_time, 
+                              uint32 *p_max_time)
+{
+    TIME_UNIX_CONV tm;
+    uint32 user_time[2];
+    uint16 num = (operator == WITHIN_RANGE_OF) ? 2 : 1;
+    uint16 i;
+    bool leap_day;
+
+    /* Opcode, operator and filter type followed by the date times */
+    if(size_value != 3 + num * RACP_DATE_TIME_LEN)
+    {
+        return INVALID_OPERAND;
+    }
+
+    for(i = 0; i < num; i++)
+    {
+        tm.tm_year = BufReadUint16(&p_value);
+        tm.tm_mon = BufReadUint8(&p_value);
+        tm.tm_mday = BufReadUint8(&p_value);
+        tm.tm_hour = BufReadUint8(&p_value);
+        tm.tm_min = BufReadUint8(&p_value);
+        tm.tm_sec = BufReadUint8(&p_value);
+
+        if(tm.tm_year < 1970 || tm.tm_year > RACP_MAX_YEAR ||
+           tm.tm_mon < 1 || tm.tm_mon > 12 || tm.tm_mday < 1 || 
+           tm.tm_hour > 23 || tm.tm_min > 59 || tm.tm_sec > 59)
+        {
+            return INVALID_OPERAND;
+        }
+
+        /* The day has to be in the month, with 29th February in leap 
+         * years only
+         */
+        leap_day = (tm.tm_mon == 2 && tm.tm_year % 4 == 0 &&
+                    (tm.tm_year % 100 != 0 || tm.tm_year % 400 == 0));
+
+        if(tm.tm_mday > g_days_in_month[tm.tm_mon - 1] + leap_day)
+        {
+            return INVALID_OPERAND;
+        }
+
+        user_time[i] = calcEpoch(&tm);
+
+        if(tm.tm_year == RACP_MAX_YEAR && 
+           user_time[i] < RACP_MAX_YEAR_START_TIME)
+        {
+            /* The time has wrapped around */
+            return INVALID_OPERAND;
+        }
+    }
+
+    *p_min_time = 0;
+    *p_max_time = 0xffffffffUL;
+
+    if(operator == LESS_THAN_OR_EQUAL_TO)
+    {
+        *p_max_time = user_time[0];
+    }
+    else
+    {
+        *p_min_time = user_time[0];
+
+        if(operator == WITHIN_RANGE_OF)
+        {
+            *p_max_time = user_time[1];
+
+            if(*p_min_time > *p_max_time)
             {
-                sendMeasNotifications(ucid);
+                return INVALID_OPERAND;
             }
         }
     }
-    else if(g_glucose_data.abort_racp_in_progress)
+
+    return RESPONSE_CODE_SUCCESS;
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      arenaWrite
+ *
+ *  DESCRIPTION
+ *      This function copies 'len' octets into the record arena starting at 
+ *      octet 'offset', packing two octets in each word. The copy wraps 
+ *      around the end of the arena.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+static void arenaWrite(uint16 offset, const uint8 *p_data, uint16 len)
+{
+    uint16 *p_word;
+
+    while(len--)
+    {
+        p_word = &g_glucose_data.gs_meas_queue.arena[offset >> 1];
+
+        if(offset & 1)
+        {
+            *p_word = (*p_word & 0x00ff) | ((uint16)(*p_data++) << 8);
+        }
+        else
+        {
+            *p_word = (*p_word & 0xff00) | (*p_data++ & 0x00ff);
+        }
+
+        offset = (offset + 1) % GLUCOSE_RECORD_ARENA_SIZE;
+    }
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      arenaRead
+ *
+ *  DESCRIPTION
+ *      This function copies 'len' octets out of the record arena starting at
+ *      octet 'offset'. The copy wraps around the end of the arena.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+static void arenaRead(uint16 offset, uint8 *p_data, uint16 len)
+{
+    uint16 word;
+
+    while(len--)
+    {
+        word = g_glucose_data.gs_meas_queue.arena[offset >> 1];
+
+        *p_data++ = (offset & 1) ? (word >> 8) : (word & 0x00ff);
+
+        offset = (offset + 1) % GLUCOSE_RECORD_ARENA_SIZE;
+    }
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      arenaFreeSpace
+ *
+ *  DESCRIPTION
+ *      This function returns the number of octets between the end of the 
+ *      latest record and the start of the oldest record in the record arena.
+ *      Octets of deleted records which lie between these are not free until
+ *      the oldest record moves past them.
+ *
+ *  RETURNS/MODIFIES
+ *      Number of free octets.
+ *
+ *----------------------------------------------------------------------------*/
+static uint16 arenaFreeSpace(void)
+{
+    uint16 head;
+
+    if(g_glucose_data.gs_meas_queue.num == 0)
+    {
+        return GLUCOSE_RECORD_ARENA_SIZE;
+    }
+
+    head = g_glucose_data.gs_meas_queue.
+                    gs_records[g_glucose_data.gs_meas_queue.start_idx].offset;
+
+    return (head + GLUCOSE_RECORD_ARENA_SIZE - 
+            g_glucose_data.gs_meas_queue.arena_end) % 
+                                                GLUCOSE_RECORD_ARENA_SIZE;
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      buildRecordValue
+ *
+ *  DESCRIPTION
+ *      This function builds the glucose measurement (or the glucose 
+ *      measurement context, depending on 'handle') characteristic value of 
+ *      the record at circular queue index 'idx' from its stored form.
+ *
+ *  RETURNS/MODIFIES
+ *      Length of the characteristic value written to 'p_data'.
+ *
+ *----------------------------------------------------------------------------*/
+static uint16 buildRecordValue(uint16 idx, uint16 handle, uint8 *p_data)
+{
+    GLUCOSE_RECORD_T *p_record = &g_glucose_data.gs_meas_queue.gs_records[idx];
+    uint8 header[MEAS_RECORD_HEADER_LEN + 2];
+    TIME_UNIX_CONV tm;
+    uint32 epoch = p_record->user_time;
+    uint16 offset = p_record->offset;
+    uint16 optional_len;
+    uint16 len = 0;
+
+    if(handle == HANDLE_GLUCOSE_MEASUREMENT)
+    {
+        arenaRead(offset, header, MEAS_RECORD_HEADER_LEN);
+
+        if(header[0] & TIME_OFFSET_PRESENT)
+        {
+            /* The base time is the user facing time less the time offset, 
+             * which is the first optional field in minutes
+             */
+            arenaRead((offset + MEAS_RECORD_HEADER_LEN) % 
+                      GLUCOSE_RECORD_ARENA_SIZE, 
+                      &header[MEAS_RECORD_HEADER_LEN], 2);
+            epoch -= timeOffsetToSeconds(&header[MEAS_RECORD_HEADER_LEN]);
+        }
+
+        calcDate(&tm, epoch);
+
+        /* Flags and sequence number */
+        p_data[len ++] = header[0];
+        p_data[len ++] = LE8_L(p_record->sequence_number);
+        p_data[len ++] = LE8_H(p_record->sequence_number);
+
+        /* Base time */
+        p_data[len ++] = LE8_L(tm.tm_year); /* Year */
+        p_data[len ++] = LE8_H(tm.tm_year);
+        p_data[len ++] = tm.tm_mon;         /* Month 0 to 12 */
+        p_data[len ++] = tm.tm_mday;        /* Day   1 to 31 */
+        p_data[len ++] = tm.tm_hour;        /* Hour  0 to 23 */
+        p_data[len ++] = tm.tm_min;         /* Min   0 to 59 */
+        p_data[len ++] = tm.tm_sec;         /* Secs  0 to 59 */
+
+        offset += MEAS_RECORD_HEADER_LEN;
+        optional_len = p_record->meas_len - MEAS_RECORD_HEADER_LEN;
+    }
+    else
+    {
+        /* The context follows the measurement */
+        offset = (offset + p_record->meas_len) % GLUCOSE_RECORD_ARENA_SIZE;
+
+        /* Flags and sequence number */
+        arenaRead(offset, p_data, CONTEXT_RECORD_HEADER_LEN);
+        len += CONTEXT_RECORD_HEADER_LEN;
+        p_data[len ++] = LE8_L(p_record->sequence_number);
+        p_data[len ++] = LE8_H(p_record->sequence_number);
+
+        offset += CONTEXT_RECORD_HEADER_LEN;
+        optional_len = p_record->context_len - CONTEXT_RECORD_HEADER_LEN;
+    }
+
+    /* Optional fields are stored as they are notified */
+    arenaRead(offset % GLUCOSE_RECORD_ARENA_SIZE, p_data + len, optional_len);
+    len += optional_len;
+
+    return len;
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      notifyCursorReset
+ *
+ *  DESCRIPTION
+ *      This function restarts the notification cursor before the first 
+ *      measurement of the pending span.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+static void notifyCursorReset(void)
+{
+    GLUCOSE_NOTIFY_CURSOR_T *p_cursor = &g_glucose_data.notify_cursor;
+
+    p_cursor->last = 0;
+    p_cursor->tuple[0].pos = 0;
+    p_cursor->tuple[0].handle = INVALID_ATT_HANDLE;
+    p_cursor->next_ready = FALSE;
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      notifyCursorBuild
+ *
+ *  DESCRIPTION
+ *      This function builds the characteristic value following 'p_prev' in 
+ *      the pending span. That is the context of the same measurement if 
+ *      'p_prev' is a measurement with a context and context notifications
+ *      are enabled, otherwise the next measurement which has not been 
+ *      deleted.
+ *
+ *  RETURNS/MODIFIES
+ *      FALSE if 'p_prev' is the last value of the span.
+ *
+ *----------------------------------------------------------------------------*/
+static bool notifyCursorBuild(const GLUCOSE_NOTIFY_TUPLE_T *p_prev,
+                              GLUCOSE_NOTIFY_TUPLE_T *p_tuple)
+{
+    uint16 pos = p_prev->pos;
+    uint16 handle = HANDLE_GLUCOSE_MEASUREMENT;
+
+    if((p_prev->handle == HANDLE_GLUCOSE_MEASUREMENT) &&
+       (g_glucose_data.context_client_config == 
+                                          gatt_client_config_notification) &&
+       g_glucose_data.gs_meas_queue.gs_records[MEAS_PENDING_IDX(pos)].
+                                                               context_len)
+    {
+        handle = HANDLE_GLUCOSE_MEASUREMENT_CONTEXT;
+    }
+    else
+    {
+        if(p_prev->handle != INVALID_ATT_HANDLE)
+        {
+            pos++;
+        }
+
+        /* Skip the records which have been deleted but not compacted yet, 
+         * and those outside the time filter of the request
+         */
+        while(pos < g_glucose_data.meas_pending.num && 
+              (MEAS_IS_DELETED(MEAS_PENDING_IDX(pos)) ||
+               (g_glucose_data.meas_pending.filter_time &&
+                !measPendingInTimeRange(pos))))
+        {
+            pos++;
+        }
+
+        if(pos >= g_glucose_data.meas_pending.num)
+        {
+            return FALSE;
+        }
+    }
+
+    p_tuple->pos = pos;
+    p_tuple->handle = handle;
+    p_tuple->len = buildRecordValue(MEAS_PENDING_IDX(pos), handle, 
+                                    p_tuple->data);
+
+    return TRUE;
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      notifyCursorPeek
+ *
+ *  DESCRIPTION
+ *      This function returns the characteristic value following the last 
+ *      notified one, building it if it has not been built yet.
+ *
+ *  RETURNS/MODIFIES
+ *      The value, or NULL at the end of the pending span.
+ *
+ *----------------------------------------------------------------------------*/
+static const GLUCOSE_NOTIFY_TUPLE_T *notifyCursorPeek(void)
+{
+    GLUCOSE_NOTIFY_CURSOR_T *p_cursor = &g_glucose_data.notify_cursor;
+    GLUCOSE_NOTIFY_TUPLE_T *p_next = &p_cursor->tuple[!p_cursor->last];
+
+    if(!p_cursor->next_ready)
+    {
+        p_cursor->next_ready = 
+                notifyCursorBuild(&p_cursor->tuple[p_cursor->last], p_next);
+    }
+
+    return p_cursor->next_ready ? p_next : NULL;
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      notifyCursorSendNext
+ *
+ *  DESCRIPTION
+ *      This function moves the cursor to the characteristic value following
+ *      the last notified one and notifies it. The value after it is built 
+ *      straight away, so that it is ready when the notification is 
+ *      confirmed. The caller checks there is a next value.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+static void notifyCursorSendNext(uint16 ucid)
+{
+    GLUCOSE_NOTIFY_CURSOR_T *p_cursor = &g_glucose_data.notify_cursor;
+    const GLUCOSE_NOTIFY_TUPLE_T *p_tuple;
+
+    p_cursor->last = !p_cursor->last;
+    p_cursor->next_ready = FALSE;
+    p_tuple = &p_cursor->tuple[p_cursor->last];
+
+    GattCharValueNotification(ucid, p_tuple->handle, p_tuple->len, 
+                              p_tuple->data);
+    g_glucose_data.notification_in_flight = TRUE;
+
+    notifyCursorPeek();
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      deleteMeasRecord
+ *
+ *  DESCRIPTION
+ *      This function marks the measurement at position 'pos' as deleted. The
+ *      measurement stays in the queue until it is trimmed from one of its
+ *      ends or compacted away in idle time. Its entry of the NVM record log 
+ *      is erased straight away.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+static void deleteMeasRecord(uint16 pos)
+{
+    uint16 idx = MEAS_QUEUE_IDX(pos);
+
+    if(!MEAS_IS_DELETED(idx))
+    {
+        MEAS_SET_DELETED(idx);
+        g_glucose_data.gs_meas_queue.num_deleted++;
+
+        /* The matching records have changed */
+        g_glucose_data.query_result.valid = FALSE;
+
+        /* The measurement shall not be restored after a power loss */
+        eraseRecordFromLog(
+                g_glucose_data.gs_meas_queue.gs_records[idx].sequence_number);
+    }
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      dropOldestMeasRecord
+ *
+ *  DESCRIPTION
+ *      This function drops the oldest measurement of the queue. If it has 
+ *      been deleted, its deleted flag is cleared so that the new record
+ *      written in its place does not take it over. If it is the first 
+ *      measurement of the pending span, the span and the notification
+ *      cursor move past it, so that a report in progress carries on with the
+ *      measurements which are left rather than with the new records written
+ *      over the old ones.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+static void dropOldestMeasRecord(void)
+{
+    GLUCOSE_NOTIFY_CURSOR_T *p_cursor = &g_glucose_data.notify_cursor;
+    GLUCOSE_NOTIFY_TUPLE_T *p_last = &p_cursor->tuple[p_cursor->last];
+    GLUCOSE_NOTIFY_TUPLE_T *p_next = &p_cursor->tuple[!p_cursor->last];
+    GLUCOSE_DELETE_TASK_T *p_task = &g_glucose_data.delete_task;
+    uint16 idx = g_glucose_data.gs_meas_queue.start_idx;
+
+    if(MEAS_IS_DELETED(idx))
+    {
+        MEAS_CLEAR_DELETED(idx);
+        g_glucose_data.gs_meas_queue.num_deleted--;
+    }
+
+    if(g_glucose_data.meas_pending.num &&
+       g_glucose_data.meas_pending.start_idx == idx)
+    {
+        g_glucose_data.meas_pending.start_idx = 
+                                (idx + 1) % MAX_NUMBER_GLUCOSE_MEASUREMENTS;
+        g_glucose_data.meas_pending.num--;
+
+        /* Positions in the span are relative to its first measurement. If 
+         * the last notified value is of the dropped measurement, the cursor
+         * restarts before the new first one.
+         */
+        if(p_last->pos)
+        {
+            p_last->pos--;
+        }
+        else
+        {
+            p_last->handle = INVALID_ATT_HANDLE;
+        }
+
+        if(p_cursor->next_ready)
+        {
+            if(p_next->pos)
+            {
+                p_next->pos--;
+            }
+            else
+            {
+                p_cursor->next_ready = FALSE;
+            }
+        }
+    }
+
+    /* The records selected for deletion move down by one place */
+    if(p_task->pending)
+    {
+        if(p_task->pos)
+        {
+            p_task->pos--;
+        }
+
+        if(p_task->end)
+        {
+            p_task->end--;
+        }
+    }
+
+    g_glucose_data.gs_meas_queue.start_idx = 
+                                (idx + 1) % MAX_NUMBER_GLUCOSE_MEASUREMENTS;
+    g_glucose_data.gs_meas_queue.num--;
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      trimMeasQueue
+ *
+ *  DESCRIPTION
+ *      This function drops the deleted measurements at the start and at the 
+ *      end of the measurement queue. This only moves the queue boundaries, 
+ *      so deleting the oldest or the latest records never costs a copy.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+static void trimMeasQueue(void)
+{
+    uint16 idx;
+
+    while(g_glucose_data.gs_meas_queue.num_deleted)
+    {
+        idx = g_glucose_data.gs_meas_queue.start_idx;
+
+        if(!MEAS_IS_DELETED(idx))
+        {
+            break;
+        }
+
+        dropOldestMeasRecord();
+    }
+
+    while(g_glucose_data.gs_meas_queue.num_deleted)
+    {
+        idx = MEAS_QUEUE_IDX(g_glucose_data.gs_meas_queue.num - 1);
+
+        if(!MEAS_IS_DELETED(idx))
+        {
+            break;
+        }
+
+        MEAS_CLEAR_DELETED(idx);
+        g_glucose_data.gs_meas_queue.num_deleted--;
+        g_glucose_data.gs_meas_queue.num--;
+    }
+
+    if(g_glucose_data.gs_meas_queue.num == 0)
+    {
+        /* All measurements got deleted */
+        g_glucose_data.data_pending = FALSE;
+
+        g_glucose_data.gs_meas_queue.start_idx = 0;
+    }
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      countDeletedMeasRecords
+ *
+ *  DESCRIPTION
+ *      This function counts the deleted measurements between positions 
+ *      'pos' and 'end' of the measurement queue, a bitmap word at a time.
+ *
+ *  RETURNS/MODIFIES
+ *      Number of deleted measurements in the span.
+ *
+ *----------------------------------------------------------------------------*/
+static uint16 countDeletedMeasRecords(uint16 pos, uint16 end)
+{
+    uint16 idx;
+    uint16 len;
+    uint16 bits;
+    uint16 word;
+    uint16 count = 0;
+
+    if(g_glucose_data.gs_meas_queue.num_deleted == 0 || pos >= end)
+    {
+        return 0;
+    }
+
+    idx = MEAS_QUEUE_IDX(pos);
+    len = end - pos;
+
+    while(len)
+    {
+        /* Number of bits of the current bitmap word in the span */
+        bits = 16 - (idx & 0xf);
+        if(bits > len)
+        {
+            bits = len;
+        }
+        if(bits > MAX_NUMBER_GLUCOSE_MEASUREMENTS - idx)
+        {
+            bits = MAX_NUMBER_GLUCOSE_MEASUREMENTS - idx;
+        }
+
+        word = g_glucose_data.gs_meas_queue.deleted_map[idx >> 4] >> 
+                                                                (idx & 0xf);
+        if(bits < 16)
+        {
+            word &= (1u << bits) - 1;
+        }
+
+        while(word)
+        {
+            /* Clear the lowest set bit */
+            word &= word - 1;
+            count++;
+        }
+
+        idx = (idx + bits) % MAX_NUMBER_GLUCOSE_MEASUREMENTS;
+        len -= bits;
+    }
+
+    return count;
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      compactMeasQueueStep
+ *
+ *  DESCRIPTION
+ *      This function removes the deleted measurement nearest to either end 
+ *      of the measurement queue by moving the index entries between it and
+ *      that end by one place. Each call does a bounded amount of work, so the 
+ *      queue is compacted incrementally when the application is idle. The
+ *      arena octets of the deleted record are freed once the oldest record
+ *      moves past them.
+ *      Nothing is moved while an RACP procedure is using queue indices.
+ *
+ *  RETURNS/MODIFIES
+ *      TRUE if a deleted measurement was removed.
+ *
+ *----------------------------------------------------------------------------*/
+static bool compactMeasQueueStep(void)
+{
+    uint16 num = g_glucose_data.gs_meas_queue.num;
+    uint16 first;
+    uint16 last;
+    uint16 pos;
+
+    if(g_glucose_data.gs_meas_queue.num_deleted == 0 ||
+       g_glucose_data.racp_procedure_in_progress ||
+       g_glucose_data.meas_pending.num)
+    {
+        return FALSE;
+    }
+
+    /* Deleted measurements are never at the ends of the queue, so these 
+     * searches stop before running out of the queue.
+     */
+    for(first = 1; !MEAS_IS_DELETED(MEAS_QUEUE_IDX(first)); first++)
+        ;
+    for(last = num - 2; !MEAS_IS_DELETED(MEAS_QUEUE_IDX(last)); last--)
+        ;
+
+    if(first <= num - 1 - last)
+    {
+        /* Move the older records up by one place */
+        for(pos = first; pos > 0; pos--)
+        {
+            g_glucose_data.gs_meas_queue.gs_records[MEAS_QUEUE_IDX(pos)] = 
+                g_glucose_data.gs_meas_queue.gs_records[MEAS_QUEUE_IDX(pos-1)];
+        }
+        MEAS_CLEAR_DELETED(MEAS_QUEUE_IDX(first));
+
+        g_glucose_data.gs_meas_queue.start_idx = MEAS_QUEUE_IDX(1);
+    }
+    else
+    {
+        /* Move the later records down by one place */
+        for(pos = last; pos < num - 1; pos++)
+        {
+            g_glucose_data.gs_meas_queue.gs_records[MEAS_QUEUE_IDX(pos)] = 
+                g_glucose_data.gs_meas_queue.gs_records[MEAS_QUEUE_IDX(pos+1)];
+        }
+        MEAS_CLEAR_DELETED(MEAS_QUEUE_IDX(last));
+    }
+
+    g_glucose_data.gs_meas_queue.num--;
+    g_glucose_data.gs_meas_queue.num_deleted--;
+
+    /* The records have moved in the queue */
+    g_glucose_data.query_result.valid = FALSE;
+
+    return TRUE;
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      allocRecord
+ *
+ *  DESCRIPTION
+ *      This function adds an index entry for a new record at the end of the 
+ *      circular queue and reserves room for it in the record arena. If max 
+ *      circular queue length has reached or the record arena has no room for 
+ *      the new record, the oldest measurements will get overwritten.
+ *
+ *  RETURNS/MODIFIES
+ *      Offset in the record arena at which the record is to be written.
+ *
+ *----------------------------------------------------------------------------*/
+static uint16 allocRecord(uint16 seq_num, uint32 user_time, uint16 meas_len, 
+                          uint16 context_len)
+{
+    GLUCOSE_RECORD_T *p_record;
+    uint16 add_idx;
+
+    /* The new record may match the last query, and overwriting the oldest 
+     * records moves the others in the queue
+     */
+    g_glucose_data.query_result.valid = FALSE;
+
+    /* If the queue is full, reclaim the place of a deleted measurement 
+     * before overwriting the oldest one.
+     */
+    if(g_glucose_data.gs_meas_queue.num == MAX_NUMBER_GLUCOSE_MEASUREMENTS)
+    {
+        compactMeasQueueStep();
+    }
+
+    while((g_glucose_data.gs_meas_queue.num == 
+                                        MAX_NUMBER_GLUCOSE_MEASUREMENTS) ||
+          (arenaFreeSpace() < meas_len + context_len))
+    {
+        dropOldestMeasRecord();
+
+        /* The new oldest measurement may be a deleted one */
+        trimMeasQueue();
+    }
+
+    /* Add new data to the end of circular queue */
+    add_idx = 
+        (g_glucose_data.gs_meas_queue.start_idx +
+            g_glucose_data.gs_meas_queue.num)% 
+                                    MAX_NUMBER_GLUCOSE_MEASUREMENTS;
+
+    if(g_glucose_data.gs_meas_queue.num == 0)
+    {
+        g_glucose_data.gs_meas_queue.time_sorted = TRUE;
+    }
+    else if(user_time < MEAS_QUEUE_TIME(g_glucose_data.gs_meas_queue.num - 1))
+    {
+        /* The user facing times can no longer be binary searched */
+        g_glucose_data.gs_meas_queue.time_sorted = FALSE;
+    }
+
+    p_record = &g_glucose_data.gs_meas_queue.gs_records[add_idx];
+    p_record->sequence_number = seq_num;
+    p_record->user_time = user_time;
+    p_record->offset = g_glucose_data.gs_meas_queue.arena_end;
+    p_record->meas_len = meas_len;
+    p_record->context_len = context_len;
+
+    g_glucose_data.gs_meas_queue.arena_end = 
+                            (p_record->offset + meas_len + context_len) % 
+                                                    GLUCOSE_RECORD_ARENA_SIZE;
+
+    g_glucose_data.gs_meas_queue.num++;
+
+    return p_record->offset;
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      timeOffsetToSeconds
+ *
+ *  DESCRIPTION
+ *      This function converts the time offset field of a measurement, a 
+ *      signed number of minutes, to seconds.
+ *
+ *  RETURNS/MODIFIES
+ *      Time offset in seconds, to be added to the base time modulo 2^32.
+ *
+ *----------------------------------------------------------------------------*/
+static uint32 timeOffsetToSeconds(const uint8 *p_offset)
+{
+    int16 minutes = (int16)(p_offset[0] | ((uint16)p_offset[1] << 8));
+
+    return (uint32)((int32)minutes * 60);
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      measUserFacingTime
+ *
+ *  DESCRIPTION
+ *      This function returns the user facing time of a measurement stored as
+ *      in the NVM record log, that is its base time plus its time offset if 
+ *      it has one.
+ *
+ *  RETURNS/MODIFIES
+ *      User facing time in seconds since 1970.
+ *
+ *----------------------------------------------------------------------------*/
+static uint32 measUserFacingTime(const uint8 *p_meas)
+{
+    uint32 user_time = (uint32)p_meas[1] | ((uint32)p_meas[2] << 8) |
+                       ((uint32)p_meas[3] << 16) | ((uint32)p_meas[4] << 24);
+
+    if(p_meas[0] & TIME_OFFSET_PRESENT)
+    {
+        /* The time offset is the first optional field */
+        user_time += timeOffsetToSeconds(
+                    &p_meas[MEAS_RECORD_HEADER_LEN + MEAS_LOG_TIME_LEN]);
+    }
+
+    return user_time;
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      storeRecord
+ *
+ *  DESCRIPTION
+ *      This function appends a record, in the form it has in the NVM record 
+ *      log, to the measurement queue. The base time of the measurement is 
+ *      kept in the index entry as part of the user facing time, so it is not
+ *      copied to the record arena.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+static void storeRecord(uint16 seq_num, const uint8 *p_data, 
+                        uint16 meas_len, uint16 context_len)
+{
+    uint16 offset;
+
+    meas_len -= MEAS_LOG_TIME_LEN;
+
+    offset = allocRecord(seq_num, measUserFacingTime(p_data), meas_len, 
+                         context_len);
+
+    /* The flags followed by the optional fields and the context */
+    arenaWrite(offset, p_data, MEAS_RECORD_HEADER_LEN);
+    arenaWrite((offset + MEAS_RECORD_HEADER_LEN) % GLUCOSE_RECORD_ARENA_SIZE,
+               p_data + MEAS_RECORD_HEADER_LEN + MEAS_LOG_TIME_LEN,
+               meas_len - MEAS_RECORD_HEADER_LEN + context_len);
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      writeRecordToLog
+ *
+ *  DESCRIPTION
+ *      This function writes a record to its entry of the NVM record log. The
+ *      entry of a record is chosen by its sequence number, so the entries 
+ *      are written in turn and wear evenly. The entry is marked empty before
+ *      the record data is written and its sequence number is written last, 
+ *      so an entry whose write was interrupted by a power loss is never 
+ *      taken as valid: neither the old record with new data nor the new 
+ *      record with old data.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+static void writeRecordToLog(uint16 seq_num, const uint8 *p_data, 
+                             uint16 meas_len, uint16 context_len)
+{
+    uint16 data[NVM_RECORD_LOG_DATA_WORDS];
+    uint16 entry = seq_num % NVM_RECORD_LOG_ENTRIES;
+    uint16 seq_num_offset = g_glucose_data.nvm_offset + 
+                            NVM_RECORD_LOG_SEQ_NUM_OFFSET + entry;
+    uint16 len = meas_len + context_len;
+    uint16 i;
+
+    /* The entry may hold an older record, which must not be restored with 
+     * the new data. The sequence number words and the data words are not 
+     * adjacent, so an NVM transaction does not merge these writes and they 
+     * reach the NVM in this order.
+     */
+    data[0] = 0;
+    Nvm_Write(data, 1, seq_num_offset);
+
+    /* Lengths word followed by the record packed two octets per word */
+    data[0] = meas_len | (context_len << 8);
+
+    for(i = 0; i < len; i += 2)
+    {
+        data[1 + (i >> 1)] = (p_data[i] & 0x00ff) |
+                    ((i + 1 < len) ? ((uint16)(p_data[i + 1]) << 8) : 0);
+    }
+
+    Nvm_Write(data, 1 + ((len + 1) >> 1), g_glucose_data.nvm_offset + 
+              NVM_RECORD_LOG_DATA_OFFSET + entry * NVM_RECORD_LOG_DATA_WORDS);
+
+    Nvm_Write(&seq_num, SIZEOF_WORDS(seq_num), seq_num_offset);
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      eraseRecordFromLog
+ *
+ *  DESCRIPTION
+ *      This function marks the NVM record log entry of a deleted record as 
+ *      empty, if the entry has not been reused by a later record yet.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+static void eraseRecordFromLog(uint16 seq_num)
+{
+    uint16 offset = g_glucose_data.nvm_offset + 
+                    NVM_RECORD_LOG_SEQ_NUM_OFFSET + 
+                    (seq_num % NVM_RECORD_LOG_ENTRIES);
+    uint16 entry_seq_num;
+
+    Nvm_Read(&entry_seq_num, SIZEOF_WORDS(entry_seq_num), offset);
+
+    if(entry_seq_num == seq_num)
+    {
+        entry_seq_num = 0;
+        Nvm_Write(&entry_seq_num, SIZEOF_WORDS(entry_seq_num), offset);
+    }
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      findLastSeqNumInLog
+ *
+ *  DESCRIPTION
+ *      This function finds the last record written to the NVM record log 
+ *      from the last block of reserved sequence numbers. The first number of
+ *      the block has been used, the numbers after the last record found have
+ *      not been used or their records have been deleted.
+ *
+ *  RETURNS/MODIFIES
+ *      Sequence number of the last record in the NVM record log.
+ *
+ *----------------------------------------------------------------------------*/
+static uint16 findLastSeqNumInLog(void)
+{
+    uint16 seq_nums[NVM_RECORD_LOG_READ_WORDS];
+    uint16 seq_num = g_glucose_data.seq_num_reserved - 
+                                            SEQ_NUM_RESERVE_BLOCK + 1;
+    uint16 last_seq_num = seq_num;
+    uint16 entry;
+    uint16 done;
+    uint16 num;
+    uint16 i;
+
+    for(done = 0; done < SEQ_NUM_RESERVE_BLOCK; done += num)
+    {
+        entry = seq_num % NVM_RECORD_LOG_ENTRIES;
+
+        num = NVM_RECORD_LOG_ENTRIES - entry;
+        if(num > NVM_RECORD_LOG_READ_WORDS)
+        {
+            num = NVM_RECORD_LOG_READ_WORDS;
+        }
+        if(num > SEQ_NUM_RESERVE_BLOCK - done)
+        {
+            num = SEQ_NUM_RESERVE_BLOCK - done;
+        }
+
+        Nvm_Read(seq_nums, num, g_glucose_data.nvm_offset + 
+                 NVM_RECORD_LOG_SEQ_NUM_OFFSET + entry);
+
+        for(i = 0; i < num; i++, seq_num++)
+        {
+            if(seq_num != 0 && seq_nums[i] == seq_num)
+            {
+                last_seq_num = seq_num;
+            }
+        }
+    }
+
+    return last_seq_num;
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      readRecordLog
+ *
+ *  DESCRIPTION
+ *      This function restores the records of the NVM record log to the 
+ *      measurement queue, oldest first. The entries are visited in order,
+ *      ending with the entry of 'last_seq_num'. An entry is restored only if
+ *      it holds one of the sequence numbers the log can hold, up to 
+ *      'last_seq_num', and the record has not been deleted.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+static void readRecordLog(uint16 last_seq_num)
+{
+    uint16 seq_nums[NVM_RECORD_LOG_READ_WORDS];
+    uint16 data[NVM_RECORD_LOG_DATA_WORDS];
+    uint8 record[MAX_LEN_STORED_RECORD];
+    uint16 deleted_seq_num;
+    uint16 entry = (last_seq_num + 1) % NVM_RECORD_LOG_ENTRIES;
+    uint16 span = NVM_RECORD_LOG_ENTRIES - 1;
+    uint16 seq_num;
+    uint16 meas_len;
+    uint16 context_len;
+    uint16 done;
+    uint16 num;
+    uint16 i;
+    uint16 j;
+
+    /* The sequence numbers skipped after 0xFFFF take no entry, so the log 
+     * reaches further back when it holds records either side of the wrap
+     */
+    if((uint16)(last_seq_num - SEQ_NUM_AFTER_WRAP) < span)
+    {
+        span += SEQ_NUM_AFTER_WRAP;
+    }
+
+    Nvm_Read(&deleted_seq_num, SIZEOF_WORDS(deleted_seq_num), 
+             g_glucose_data.nvm_offset + NVM_RECORD_LOG_DELETED_SEQ_NUM);
+
+    for(done = 0; done < NVM_RECORD_LOG_ENTRIES; done += num)
+    {
+        /* Read the sequence numbers of as many entries as possible before 
+         * the end of the log
+         */
+        num = NVM_RECORD_LOG_ENTRIES - entry;
+        if(num > NVM_RECORD_LOG_READ_WORDS)
+        {
+            num = NVM_RECORD_LOG_READ_WORDS;
+        }
+        if(num > NVM_RECORD_LOG_ENTRIES - done)
+        {
+            num = NVM_RECORD_LOG_ENTRIES - done;
+        }
+
+        Nvm_Read(seq_nums, num, g_glucose_data.nvm_offset + 
+                 NVM_RECORD_LOG_SEQ_NUM_OFFSET + entry);
+
+        for(i = 0; i < num; i++)
+        {
+            seq_num = seq_nums[i];
+
+            /* Sequence numbers wrap around, so an entry is deleted if it
+             * is no newer than the last deleted record, if any. Both are 
+             * compared by how far they are behind the last sequence number
+             * reserved, which no record is newer than.
+             */
+            if(seq_num == 0 || 
+               (uint16)(last_seq_num - seq_num) > span ||
+               (deleted_seq_num != 0 &&
+                (uint16)(g_glucose_data.seq_num_reserved - seq_num) >= 
+                    (uint16)(g_glucose_data.seq_num_reserved - 
+                                                        deleted_seq_num)))
+            {
+                /* Empty, stale or deleted entry */
+                continue;
+            }
+
+            Nvm_Read(data, NVM_RECORD_LOG_DATA_WORDS, 
+                     g_glucose_data.nvm_offset + NVM_RECORD_LOG_DATA_OFFSET + 
+                     (entry + i) * NVM_RECORD_LOG_DATA_WORDS);
+
+            meas_len = data[0] & 0x00ff;
+            context_len = data[0] >> 8;
+
+            if(meas_len < MEAS_RECORD_HEADER_LEN + MEAS_LOG_TIME_LEN || 
+               meas_len + context_len > MAX_LEN_STORED_RECORD)
+            {
+                /* Not a valid record */
+                continue;
+            }
+
+            for(j = 0; j < meas_len + context_len; j++)
+            {
+                record[j] = (j & 1) ? (data[1 + (j >> 1)] >> 8) :
+                                      (data[1 + (j >> 1)] & 0x00ff);
+            }
+
+            storeRecord(seq_num, record, meas_len, context_len);
+
+            g_glucose_data.data_pending = TRUE;
+        }
+
+        entry = (entry + num) % NVM_RECORD_LOG_ENTRIES;
+    }
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      sendFirstOrLastMeasRecord
+ *
+ *  DESCRIPTION
+ *      This function is used to report First (Oldest) or Last (Latest) 
+ *      measurement data to the collector.
+ *      
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+static void sendFirstOrLastMeasRecord(uint16 ucid, uint8 operator)
+{
+    uint16 index;
+
+    /* Initialise measurement pending tx data */
+    g_glucose_data.meas_pending.num = 0;
+    g_glucose_data.meas_pending.filter_time = FALSE;
+    notifyCursorReset();
+
+    /* Send data to collector */
+     if(operator == FIRST_RECORD) /* Oldest record */
+    {
+        index = g_glucose_data.gs_meas_queue.start_idx;
+    }
+    else /* LAST_RECORD or most Recent Record */
+    {
+        index = 
+              (g_glucose_data.gs_meas_queue.start_idx +
+              g_glucose_data.gs_meas_queue.num - 1) % 
+              MAX_NUMBER_GLUCOSE_MEASUREMENTS;
+    }
+
+    g_glucose_data.meas_pending.start_idx = index;
+
+    g_glucose_data.meas_pending.num = 1;
+
+}
+#ifdef ENABLE_PTS_WORKAROUNDS
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      ptsSendMeasNotifications
+ *
+ *  DESCRIPTION
+ *      This function will be used only for those PTS test cases which will be 
+ *      writing ABORT on RACP and will send glucose measurement notifications
+ *      upon expiry of a timer.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+static void ptsSendMeasNotifications(timer_id tid)
+{
+    /* Send glucose notification */
+    if(tid == g_glucose_data.pts_tid)
+    {
+        g_glucose_data.pts_tid = TIMER_INVALID;
+        sendMeasNotifications(GetAppConnectedUcid());
+    }
+    /* Else Ignore. This may be due to some race condition */
+}
+#endif /* ENABLE_PTS_WORKAROUNDS */
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      sendMeasContextOrMoveToNextRecord
+ *
+ *  DESCRIPTION
+ *      If a Glucose Context is present for the current Glucose Record, the 
+ *      application sends it otherwise it moves to the next record.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+static void sendMeasContextOrMoveToNextRecord(uint16 ucid)
+{
+#ifdef ENABLE_PTS_WORKAROUNDS
+    const GLUCOSE_NOTIFY_TUPLE_T *p_next;
+#endif /* ENABLE_PTS_WORKAROUNDS */
+
+    /* Check if collector has not aborted the ongoing procedure */
+    if(g_glucose_data.racp_procedure_in_progress)
+    {
+#ifdef ENABLE_PTS_WORKAROUNDS
+        p_next = notifyCursorPeek();
+
+        if(g_pts_abort_test && 
+           (p_next == NULL || 
+            p_next->handle == HANDLE_GLUCOSE_MEASUREMENT))
+        {
+            /* If PTS abort test case is running and project
+             * keyr file has been configured accordingly, 
+             * introduce one secong gap between glucose 
+             * records. Start a one second timer and when it
+             * expires, send the notification over the air.
+             */
+            TimerDelete(g_glucose_data.pts_tid);
+            g_glucose_data.pts_tid = TimerCreate(0.1*SECOND, 
+                                                 TRUE,
+                                                 ptsSendMeasNotifications);
+        }
+        else
+#endif /* ENABLE_PTS_WORKAROUNDS */
+        {
+            /* Send the context of the last record, or the next record */
+            sendMeasNotifications(ucid);
+        }
+    }
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      abortRACPProcedure
+ *
+ *  DESCRIPTION
+ *      This function aborts the RACP procedure in progress as soon as the 
+ *      collector writes ABORT on RACP, rather than on the next notification
+ *      confirmation or radio event. It stops deleting records, drops the 
+ *      measurements not notified yet and sends the response of the abort.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+static void abortRACPProcedure(uint16 ucid)
+{
+    deleteTaskStop();
+
+#ifdef ENABLE_PTS_WORKAROUNDS
+    if(g_pts_abort_test)
+    {
+        /* If PTS abort test case is running and project keyr 
+         * file has been configured accordingly, delete the one 
+         * second gap timer if it is running.
+         */
+        TimerDelete(g_glucose_data.pts_tid);
+        g_glucose_data.pts_tid = TIMER_INVALID;
+    }
+#endif /* ENABLE_PTS_WORKAROUNDS */
+
+    /* Re-initialise the measurement pending data  */
+    g_glucose_data.meas_pending.num = 0;
+
+    /* The response disables the radio events and the short connection 
+     * interval, and resets the notification cursor and the flow control
+     */
+    sendRACPResponseInd(ucid, ABORT_OPERATION, RESPONSE_CODE_SUCCESS);
+}
+
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      sendMeasNotifications
+ *
+ *  DESCRIPTION
+ *      This function sends glucose measurement notifications
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+static void sendMeasNotifications(uint16 ucid)
+{
+    /* One notification will be sent at a time. Then we will wait for the 
+     * radio event for tx data and then second notification and so on.
+     * If we don't have any more notification to be send after this, we will
+     * reset measurement pending data and send complete indication
+     */
+    const GLUCOSE_NOTIFY_TUPLE_T *p_next = notifyCursorPeek();
+    uint8 response_val = RESPONSE_CODE_SUCCESS;
+
+    /* If there is no pending Glucose Measurements to be trasmitted, Send the 
+     * RACP procedure complete indication.
+     */
+    if(p_next == NULL)
+    {
+        /* Reset Data. */
+        g_glucose_data.meas_pending.num = 0;
+        notifyCursorReset();
+#ifdef ENABLE_RACP_STATS
+        g_glucose_data.racp_stats.end_time = TimeGet32();
+#endif /* ENABLE_RACP_STATS */
+        /* Send RACP response indication */
+        sendRACPResponseInd(ucid, REPORT_STORED_RECORDS, response_val);
+    }
+    else if(p_next->handle == HANDLE_GLUCOSE_MEASUREMENT_CONTEXT ||
+            g_glucose_data.meas_client_config == 
+                                           gatt_client_config_notification)
+    {
+        /* If notifications are enabled, Send notification*/
+        notifyCursorSendNext(ucid);
+    }
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      queryResultHit
+ *
+ *  DESCRIPTION
+ *      This function checks if the result of the last report query is for 
+ *      the given operator, filter type and operands. If it is not, the 
+ *      query is stored as the new key and the caller computes its result.
+ *
+ *  RETURNS/MODIFIES
+ *      Boolean TRUE if the stored result can be used
+ *              FALSE if the caller has to compute the result
+ *
+ *----------------------------------------------------------------------------*/
+static bool queryResultHit(uint8 operator, uint8 filter_type, 
+                           uint32 min_value, uint32 max_value)
+{
+    GLUCOSE_QUERY_RESULT_T *p_result = &g_glucose_data.query_result;
+
+    if(p_result->valid &&
+       p_result->operator == operator &&
+       p_result->filter_type == filter_type &&
+       p_result->min_value == min_value &&
+       p_result->max_value == max_value)
+    {
+        return TRUE;
+    }
+
+    p_result->valid = TRUE;
+    p_result->operator = operator;
+    p_result->filter_type = filter_type;
+    p_result->min_value = min_value;
+    p_result->max_value = max_value;
+
+    return FALSE;
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      sendMeasBasedOnSeqNum
+ *
+ *  DESCRIPTION
+ *      This function sends measurements using operand sequence number.
+ *
+ *  RETURNS/MODIFIES
+ *      uint16 Number of records with matching criteria
+ *
+ *----------------------------------------------------------------------------*/
+static uint16 sendMeasBasedOnSeqNum(uint16 ucid, uint8 opcode, uint8 operator, 
+                                    uint16 min_seq_num, uint16 max_seq_num)
+{
+    GLUCOSE_QUERY_RESULT_T *p_result = &g_glucose_data.query_result;
+
+    /* Initialise measurement pending tx data */
+    g_glucose_data.meas_pending.num = 0;
+    g_glucose_data.meas_pending.filter_time = FALSE;
+    notifyCursorReset();
+
+    if(!queryResultHit(operator, SEQUENCE_NUMBER, min_seq_num, max_seq_num))
+    {
+        findMeasRangeBasedOnSeqNum(operator, min_seq_num, max_seq_num, 
+                                   &p_result->first, &p_result->end);
+        p_result->all_match = TRUE;
+
+        /* The matching span may contain deleted records which have not been
+         * compacted yet, they are not counted.
+         */
+        p_result->num_records = (p_result->end - p_result->first) - 
+                        countDeletedMeasRecords(p_result->first, p_result->end);
+    }
+
+    if(opcode == REPORT_STORED_RECORDS && p_result->num_records)
     {
-        /*Aborting the RACP procedure */
-        if(g_pts_abort_test)
-        {
-            /* If PTS abort test case is running and project keyr 
-             * file has been configured accordingly, delete the one 
-             * second gap timer if it is running.
-             */
-            TimerDelete(g_glucose_data.pts_tid);
-            g_glucose_data.pts_tid = TIMER_INVALID;
-        }
-        /* Re-initialise the measurement pending data  */
-        g_glucose_data.meas_pending.current = 0;
-        g_glucose_data.meas_pending.num = 0;
-        g_glucose_data.abort_racp_in_progress = FALSE;
-        g_glucose_data.racp_procedure_in_progress = FALSE;
-        sendRACPResponseInd(ucid, ABORT_OPERATION, RESPONSE_CODE_SUCCESS);
+        /* if reporting of records has been requested then store the matching
+         * span as the pending records to be transmitted. Deleted records are
+         * skipped while sending.
+         */
+        g_glucose_data.meas_pending.start_idx = MEAS_QUEUE_IDX(p_result->first);
+        g_glucose_data.meas_pending.num = p_result->end - p_result->first;
     }
-}
 
+    return p_result->num_records;
+
+}
 
 /*----------------------------------------------------------------------------*
  *  NAME
- *      sendMeasNotifications
+ *      measPendingInTimeRange
  *
  *  DESCRIPTION
- *      This function sends glucose measurement notifications
+ *      This function checks if the user facing time of the record at 
+ *      position 'pos' of the pending span lies in the time filter of the 
+ *      request.
  *
  *  RETURNS/MODIFIES
- *      Nothing.
+ *      TRUE if the record matches the filter.
  *
  *----------------------------------------------------------------------------*/
-static void sendMeasNotifications(uint16 ucid)
+static bool measPendingInTimeRange(uint16 pos)
 {
-    /* One notification will be sent at a time. Then we will wait for the 
-     * radio event for tx data and then second notification and so on.
-     * If we don't have any more notification to be send after this, we will
-     * reset measurement pending data and send complete indication
-     */
-    uint8 idx;
-    uint8 response_val = RESPONSE_CODE_SUCCESS;
-
-    /* If there is no pending Glucose Measurements to be trasmitted, Send the 
-     * RACP procedure complete indication.
-     */
-    if((g_glucose_data.meas_pending.num == 0) ||
-       (g_glucose_data.meas_pending.current >= g_glucose_data.meas_pending.num))
-    {
-        /* Reset Data. */
-        g_glucose_data.meas_pending.current = 0;
-        g_glucose_data.meas_pending.num = 0;
-        /* Send RACP response indication */
-        sendRACPResponseInd(ucid, REPORT_STORED_RECORDS, response_val);
-    }
-    else if(g_glucose_data.meas_pending.num)
-    {
-        if(g_glucose_data.meas_client_config == gatt_client_config_notification)
-        {
-            /* If notifications are enabled, Send notification*/
-            idx = g_glucose_data.meas_pending.cqueue_idx
-                        [g_glucose_data.meas_pending.current];
-
+    uint32 user_time = g_glucose_data.gs_meas_queue.
+                                gs_records[MEAS_PENDING_IDX(pos)].user_time;
 
-            GattCharValueNotification(ucid, HANDLE_GLUCOSE_MEASUREMENT, 
-                          g_glucose_data.gs_meas_queue.gs_meas[idx].meas_len,
-                          g_glucose_data.gs_meas_queue.gs_meas[idx].meas_data);
-
-            g_glucose_data.last_idx = g_glucose_data.meas_pending.current;
-            g_glucose_data.last_handle = HANDLE_GLUCOSE_MEASUREMENT;
-        }
-    }
+    return (user_time >= g_glucose_data.meas_pending.min_time &&
+            user_time <= g_glucose_data.meas_pending.max_time);
 }
 
-
 /*----------------------------------------------------------------------------*
  *  NAME
- *      sendMeasBasedOnSeqNum
+ *      sendMeasBasedOnTime
  *
  *  DESCRIPTION
- *      This function sends measurements using operand sequence number.
+ *      This function sends the measurements whose user facing time lies 
+ *      between 'min_time' and 'max_time'. If the span of matching records 
+ *      holds records which do not match, the time filter is kept with the 
+ *      pending span and those records are skipped while sending.
  *
  *  RETURNS/MODIFIES
  *      uint16 Number of records with matching criteria
  *
  *----------------------------------------------------------------------------*/
-static uint16 sendMeasBasedOnSeqNum(uint16 ucid, uint8 opcode, uint8 operator, 
-                                    uint16 min_seq_num, uint16 max_seq_num)
+static uint16 sendMeasBasedOnTime(uint16 ucid, uint8 opcode, uint8 operator,
+                                  uint32 min_time, uint32 max_time)
 {
-    uint8 idx = g_glucose_data.gs_meas_queue.start_idx;
-    uint8 num_elements = g_glucose_data.gs_meas_queue.num;
-    uint16 start_idx_seq_num;
-    uint16 num_of_records = 0;
+    GLUCOSE_QUERY_RESULT_T *p_result = &g_glucose_data.query_result;
+    uint16 pos;
 
     /* Initialise measurement pending tx data */
     g_glucose_data.meas_pending.num = 0;
-    g_glucose_data.meas_pending.current = 0;
+    g_glucose_data.meas_pending.min_time = min_time;
+    g_glucose_data.meas_pending.max_time = max_time;
+    notifyCursorReset();
 
-    /* check every stores glucose measurement against the criteria */
-    while(num_elements)
+    if(!queryResultHit(operator, USER_FACING_TIME, min_time, max_time))
     {
-        start_idx_seq_num = g_glucose_data.gs_meas_queue
-                            .gs_meas[idx].sequence_number;
+        p_result->all_match = findMeasRangeBasedOnTime(min_time, max_time, 
+                                                       &p_result->first, 
+                                                       &p_result->end);
 
-        /* Operator and operand validation */
-        if(((operator == ALL_RECORDS) ||
-            (operator == LESS_THAN_OR_EQUAL_TO && 
-             start_idx_seq_num <= min_seq_num) ||
-            (operator == GREATER_THAN_OR_EQUAL_TO && 
-             start_idx_seq_num >= min_seq_num) ||
-            (operator == WITHIN_RANGE_OF && 
-             start_idx_seq_num >= min_seq_num &&
-             start_idx_seq_num <= max_seq_num)) &&
-             (g_glucose_data.gs_meas_queue.gs_meas[(idx)].deleted == FALSE))
+        if(p_result->all_match)
         {
+            /* Deleted records which have not been compacted yet are not 
+             * counted
+             */
+            p_result->num_records = (p_result->end - p_result->first) - 
+                        countDeletedMeasRecords(p_result->first, p_result->end);
+        }
+        else
+        {
+            /* The records in the span are checked as pending records */
+            g_glucose_data.meas_pending.start_idx = 
+                                            MEAS_QUEUE_IDX(p_result->first);
+            p_result->num_records = 0;
 
-            /* Send data to collector */
-            if(opcode == REPORT_STORED_RECORDS)
+            for(pos = 0; pos < p_result->end - p_result->first; pos++)
             {
-                /* store the index in the pending measurement record */
-                g_glucose_data.meas_pending.cqueue_idx[num_of_records] = idx;
+                if(!MEAS_IS_DELETED(MEAS_PENDING_IDX(pos)) &&
+                   measPendingInTimeRange(pos))
+                {
+                    p_result->num_records++;
+                }
             }
-
-            num_of_records++;
-
         }
-
-        idx = (idx + 1) % MAX_NUMBER_GLUCOSE_MEASUREMENTS;
-
-        num_elements--;
     }
 
-    if(opcode == REPORT_STORED_RECORDS)
+    g_glucose_data.meas_pending.start_idx = MEAS_QUEUE_IDX(p_result->first);
+    g_glucose_data.meas_pending.filter_time = !p_result->all_match;
+
+    if(opcode == REPORT_STORED_RECORDS && p_result->num_records)
     {
-        /* if reporting of records has been requested then store the the 
-         * count in number of pending records to be transmitted 
-         */
-        g_glucose_data.meas_pending.num = num_of_records;
+        /* Store the span as the pending records to be transmitted */
+        g_glucose_data.meas_pending.num = p_result->end - p_result->first;
     }
 
-    return num_of_records;
-
+    return p_result->num_records;
 }
 
 /*----------------------------------------------------------------------------*
@@ -699,10 +2807,22 @@ static void sendRACPResponseInd(uint16 ucid, uint8 req_code, uint8 res_value)
      * Set RACP procedure in progress flag to FASLE 
      */
     g_glucose_data.racp_procedure_in_progress = FALSE;
-    g_glucose_data.last_idx = -1;
-    g_glucose_data.last_handle = INVALID_ATT_HANDLE;
+    notifyCursorReset();
     g_glucose_data.has_notification_failed_before = FALSE;
     g_glucose_data.send_the_last_notification_again = FALSE;
+    g_glucose_data.notification_in_flight = FALSE;
+
+    /* A sync is only acknowledged if all its records have been sent */
+    if(req_code != REPORT_STORED_RECORDS || 
+       res_value != RESPONSE_CODE_SUCCESS)
+    {
+        g_glucose_data.sync_in_progress = FALSE;
+    }
+
+    /* Go back to the low power connection parameters after a bulk 
+     * transfer
+     */
+    AppSetBulkTransfer(FALSE);
 
     /* Restart the idle timer. If collector does not execute any more RACP
      * procedure in next CONNECTED_IDLE_TIMEOUT_VALUE, we will disconnect
@@ -730,6 +2850,8 @@ static void handleDeleteStoredRecordsInfo(GATT_ACCESS_IND_T *p_ind)
     uint8 filter_type;
     uint16 min_seq_num = 0;
     uint16 max_seq_num = 0;
+    uint32 min_time;
+    uint32 max_time;
 
     if(g_glucose_data.meas_pending.num)
     {
@@ -750,6 +2872,16 @@ static void handleDeleteStoredRecordsInfo(GATT_ACCESS_IND_T *p_ind)
 
             g_glucose_data.gs_meas_queue.start_idx = 0;
             g_glucose_data.gs_meas_queue.num = 0;
+            g_glucose_data.gs_meas_queue.num_deleted = 0;
+            MemSet(g_glucose_data.gs_meas_queue.deleted_map, 0,
+                   SIZEOF_WORDS(g_glucose_data.gs_meas_queue.deleted_map));
+            g_glucose_data.query_result.valid = FALSE;
+
+            /* All the records in the NVM record log are deleted */
+            Nvm_Write(&g_glucose_data.seq_num, 
+                      SIZEOF_WORDS(g_glucose_data.seq_num),
+                      g_glucose_data.nvm_offset + 
+                      NVM_RECORD_LOG_DELETED_SEQ_NUM);
         }
         else if(operator == WITHIN_RANGE_OF)
         {
@@ -764,9 +2896,21 @@ static void handleDeleteStoredRecordsInfo(GATT_ACCESS_IND_T *p_ind)
 
                 deleteMeasRecordsBasedOnSeqNum(operator, min_seq_num, max_seq_num);
             }
+            else if(filter_type == USER_FACING_TIME)
+            {
+                response_val = readTimeOperands(operator, p_value, 
+                                                p_ind->size_value,
+                                                &min_time, &max_time);
+                if(response_val == RESPONSE_CODE_SUCCESS)
+                {
+                    deleteMeasRecordsBasedOnTime(min_time, max_time);
+                }
+            }
             else
             {
-                /* Only sequence number filtering is supported */
+                /* Only sequence number and user facing time filtering are 
+                 * supported
+                 */
                 response_val = FILTER_TYPE_NOT_SUPPORTED;
             }
         }
@@ -785,9 +2929,21 @@ static void handleDeleteStoredRecordsInfo(GATT_ACCESS_IND_T *p_ind)
                 deleteMeasRecordsBasedOnSeqNum(operator, min_seq_num, 
                                                max_seq_num);
             }
+            else if(filter_type == USER_FACING_TIME)
+            {
+                response_val = readTimeOperands(operator, p_value, 
+                                                p_ind->size_value,
+                                                &min_time, &max_time);
+                if(response_val == RESPONSE_CODE_SUCCESS)
+                {
+                    deleteMeasRecordsBasedOnTime(min_time, max_time);
+                }
+            }
             else
             {
-                /* Only sequence number filtering is supported */
+                /* Only sequence number and user facing time filtering are 
+                 * supported
+                 */
                 response_val = FILTER_TYPE_NOT_SUPPORTED;
             }
         }
@@ -806,55 +2962,38 @@ static void handleDeleteStoredRecordsInfo(GATT_ACCESS_IND_T *p_ind)
                 deleteMeasRecordsBasedOnSeqNum(operator, min_seq_num,
                                                max_seq_num);
             }
+            else if(filter_type == USER_FACING_TIME)
+            {
+                response_val = readTimeOperands(operator, p_value, 
+                                                p_ind->size_value,
+                                                &min_time, &max_time);
+                if(response_val == RESPONSE_CODE_SUCCESS)
+                {
+                    deleteMeasRecordsBasedOnTime(min_time, max_time);
+                }
+            }
             else
             {
-                /* Only sequence number filtering is supported */
+                /* Only sequence number and user facing time filtering are 
+                 * supported
+                 */
                 response_val = FILTER_TYPE_NOT_SUPPORTED;
             }
         }
         else if(operator == FIRST_RECORD )
         {
-            if(g_glucose_data.gs_meas_queue.num == 1)
-            {
-                /*all Records has been deleted */
-                g_glucose_data.data_pending = FALSE;
-
-                g_glucose_data.gs_meas_queue.start_idx = 0;
-                g_glucose_data.gs_meas_queue.num =0;
-            }
-            else if(g_glucose_data.gs_meas_queue.num != 0)
+            /* The oldest record is never a deleted one */
+            if(g_glucose_data.gs_meas_queue.num != 0)
             {
-                /* Set the deleted flag to TRUE and increment starting index
-                 *  by 1 and decrease the number of elements 
-                 */
-                g_glucose_data.gs_meas_queue.gs_meas
-                          [g_glucose_data.gs_meas_queue.start_idx].deleted 
-                                                                    = TRUE;
-
-
-                g_glucose_data.gs_meas_queue.start_idx = 
-                        (g_glucose_data.gs_meas_queue.start_idx + 1) % 
-                                            MAX_NUMBER_GLUCOSE_MEASUREMENTS;
-                g_glucose_data.gs_meas_queue.num--;
+                deleteMeasRecord(0);
             }
-
         }
         else if (operator == LAST_RECORD)
         {
-            if(g_glucose_data.gs_meas_queue.num == 1)
+            /* The latest record is never a deleted one */
+            if(g_glucose_data.gs_meas_queue.num != 0)
             {
-                /*all Records has been deleted */
-                g_glucose_data.data_pending = FALSE;
-
-                g_glucose_data.gs_meas_queue.start_idx = 0;
-                g_glucose_data.gs_meas_queue.num =0;
-            }
-            else if(g_glucose_data.gs_meas_queue.num != 0)
-            {
-                /* Set the deleted flag to TRUE and 
-                 * and decrease the number of elements 
-                 */
-                g_glucose_data.gs_meas_queue.num--;
+                deleteMeasRecord(g_glucose_data.gs_meas_queue.num - 1);
             }
         }
         else
@@ -865,10 +3004,19 @@ static void handleDeleteStoredRecordsInfo(GATT_ACCESS_IND_T *p_ind)
 
     }
 
-    removeHolesFromMeasurementQueue();
-    /* Send RACP response indication */
-    sendRACPResponseInd(p_ind->cid, opcode, response_val);
-
+    if(response_val == RESPONSE_CODE_SUCCESS)
+    {
+        /* Delete the selected records. The response is sent once they have
+         * all been deleted.
+         */
+        g_glucose_data.delete_task.ucid = p_ind->cid;
+        deleteTaskRun();
+    }
+    else
+    {
+        /* Send RACP response indication */
+        sendRACPResponseInd(p_ind->cid, opcode, response_val);
+    }
 }
 
 
@@ -895,6 +3043,8 @@ static void handleReportStoredRecordsInfo(GATT_ACCESS_IND_T *p_ind)
     uint8 filter_type;
     uint16 min_seq_num = 0;
     uint16 max_seq_num = 0;
+    uint32 min_time;
+    uint32 max_time;
     uint16 num_records = 0;
 
     switch(operator)
@@ -921,6 +3071,24 @@ static void handleReportStoredRecordsInfo(GATT_ACCESS_IND_T *p_ind)
         }
         break;
 
+        case OPERATOR_SINCE_LAST_SYNC:
+        {
+            if(size_param == 2)
+            {
+                /* Records newer than the last acknowledged one, none if 
+                 * the collector is up to date
+                 */
+                num_records = sendMeasBasedOnSeqNum(p_ind->cid, opcode, 
+                                        OPERATOR_SINCE_LAST_SYNC, 
+                                        AppGetSyncedSeqNum(), 0);
+            }
+            else
+            {
+                response_val = INVALID_OPERAND;
+            }
+        }
+        break;
+
         case LESS_THAN_OR_EQUAL_TO:
             /* FALLTHROUGH */
         case GREATER_THAN_OR_EQUAL_TO:
@@ -946,12 +3114,34 @@ static void handleReportStoredRecordsInfo(GATT_ACCESS_IND_T *p_ind)
                             break;
                         }
                     }
+                    else if(operator == LESS_THAN_OR_EQUAL_TO)
+                    {
+                        /* The only operand is the upper limit */
+                        max_seq_num = min_seq_num;
+                    }
                     /* send measurement records based on sequence number */
                     num_records = sendMeasBasedOnSeqNum(p_ind->cid, opcode, 
                                           operator, min_seq_num, max_seq_num);
                 }
                 break;
 
+                case USER_FACING_TIME:
+                {
+                    response_val = readTimeOperands(operator, p_value, 
+                                                    size_param, &min_time, 
+                                                    &max_time);
+                    if(response_val == RESPONSE_CODE_SUCCESS)
+                    {
+                        /* send measurement records based on user facing 
+                         * time
+                         */
+                        num_records = sendMeasBasedOnTime(p_ind->cid, opcode,
+                                                          operator, min_time, 
+                                                          max_time);
+                    }
+                }
+                break;
+
                 default:
                 {
                     /* Operand not supported */
@@ -1014,6 +3204,32 @@ static void handleReportStoredRecordsInfo(GATT_ACCESS_IND_T *p_ind)
              */
             g_glucose_data.has_notification_failed_before = FALSE;
             g_glucose_data.send_the_last_notification_again = FALSE;
+            g_glucose_data.notification_in_flight = FALSE;
+
+            if(operator == ALL_RECORDS || operator == OPERATOR_SINCE_LAST_SYNC)
+            {
+                /* The collector will be up to date with the latest record,
+                 * which is never a deleted one
+                 */
+                g_glucose_data.sync_in_progress = TRUE;
+                g_glucose_data.sync_seq_num = 
+                    MEAS_QUEUE_SEQ_NUM(g_glucose_data.gs_meas_queue.num - 1);
+            }
+
+            /* Ask for a short connection interval while many records are
+             * sent, until the RACP response indication
+             */
+            if(num_records >= BULK_TRANSFER_MIN_RECORDS)
+            {
+                AppSetBulkTransfer(TRUE);
+            }
+#ifdef ENABLE_RACP_STATS
+            /* Start collecting statistics for this transfer */
+            MemSet(&g_glucose_data.racp_stats, 0, 
+                   SIZEOF_WORDS(g_glucose_data.racp_stats));
+            g_glucose_data.racp_stats.num_records = num_records;
+            g_glucose_data.racp_stats.start_time = TimeGet32();
+#endif /* ENABLE_RACP_STATS */
             sendMeasNotifications(p_ind->cid);
         }
     }
@@ -1102,25 +3318,20 @@ static void handleRACP(GATT_ACCESS_IND_T *p_ind)
             }
             break;
 
-            case ABORT_OPERATION: /* Not supported */
+            case ABORT_OPERATION:
             {
                 if(operator != OPERATOR_NULL)
                 {
                     resp_value = INVALID_OPERATOR;
                 }
 
-                /* Set RACP procedure in progress flag as we don't want to
-                 * any other RACP procedure to run when ABORT operation
-                 * is going on.
-                 */
                 if(g_glucose_data.racp_procedure_in_progress && 
                     resp_value == RESPONSE_CODE_SUCCESS)
                 {
-                    g_glucose_data.abort_racp_in_progress = TRUE;
+                    abortRACPProcedure(p_ind->cid);
                 }
                 else
                 {
-                    g_glucose_data.abort_racp_in_progress = FALSE;
                     sendRACPResponseInd(p_ind->cid, opcode, resp_value);
                 }
             }
@@ -1167,12 +3378,11 @@ extern void GlucoseDataInit(void)
 
     /* Initialize measurement pending data */
     g_glucose_data.meas_pending.num = 0;
-    g_glucose_data.meas_pending.current = 0;
     g_glucose_data.racp_procedure_in_progress = FALSE;
-    g_glucose_data.abort_racp_in_progress = FALSE;
-    g_glucose_data.last_idx = -1;
-    g_glucose_data.last_handle = INVALID_ATT_HANDLE;
+    g_glucose_data.sync_in_progress = FALSE;
+    notifyCursorReset();
 
+#ifdef ENABLE_PTS_WORKAROUNDS
     if(g_pts_abort_test)
     {
         /* If PTS abort test case is running and keyr file has been configured
@@ -1181,8 +3391,24 @@ extern void GlucoseDataInit(void)
         TimerDelete(g_glucose_data.pts_tid);
         g_glucose_data.pts_tid = TIMER_INVALID;
     }
+#endif /* ENABLE_PTS_WORKAROUNDS */
 
+    if(g_glucose_data.delete_task.pending)
+    {
+        /* There is no link, finish deleting the records selected by the 
+         * interrupted Delete Stored Records procedure
+         */
+        TimerDelete(g_glucose_data.delete_task.tid);
+        g_glucose_data.delete_task.tid = TIMER_INVALID;
+
+        while(deleteTaskStep())
+            ;
+        trimMeasQueue();
+    }
 
+    /* There is no link, finish compacting the measurement queue */
+    while(compactMeasQueueStep())
+        ;
 }
 
 /*----------------------------------------------------------------------------*
@@ -1192,7 +3418,7 @@ extern void GlucoseDataInit(void)
  *  DESCRIPTION
  *      This function is used to initialise Glucose service sequence number 
  *      This function will only be called when NVM will be initialized at the
- *      time of first device bring up.
+ *      time of first device bring up. The NVM record log is emptied as well.
  *
  *  RETURNS/MODIFIES
  *      Nothing.
@@ -1200,10 +3426,38 @@ extern void GlucoseDataInit(void)
  *----------------------------------------------------------------------------*/
 extern void GlucoseSeqNumInit(uint16 offset)
 {
+    uint16 empty[NVM_RECORD_LOG_READ_WORDS];
+    uint16 entry;
+    uint16 num;
+
     g_glucose_data.seq_num = 0;
+    g_glucose_data.seq_num_reserved = 0;
+
+    Nvm_BeginTransaction();
+
     /* Write glucose service sequence number to NVM */
-    Nvm_Write(&g_glucose_data.seq_num, sizeof(g_glucose_data.seq_num),
+    Nvm_Write(&g_glucose_data.seq_num, SIZEOF_WORDS(g_glucose_data.seq_num),
                offset);
+
+    /* No record has been deleted */
+    Nvm_Write(&g_glucose_data.seq_num, SIZEOF_WORDS(g_glucose_data.seq_num),
+               offset + NVM_RECORD_LOG_DELETED_SEQ_NUM);
+
+    /* Mark all the entries of the NVM record log as empty */
+    MemSet(empty, 0, SIZEOF_WORDS(empty));
+
+    for(entry = 0; entry < NVM_RECORD_LOG_ENTRIES; entry += num)
+    {
+        num = NVM_RECORD_LOG_ENTRIES - entry;
+        if(num > NVM_RECORD_LOG_READ_WORDS)
+        {
+            num = NVM_RECORD_LOG_READ_WORDS;
+        }
+
+        Nvm_Write(empty, num, offset + NVM_RECORD_LOG_SEQ_NUM_OFFSET + entry);
+    }
+
+    Nvm_CommitTransaction();
 }
 
 /*----------------------------------------------------------------------------*
@@ -1225,12 +3479,21 @@ extern void GlucoseInitChipReset(void)
     /* Initialise circular queue buffer */
     g_glucose_data.gs_meas_queue.start_idx = 0;
     g_glucose_data.gs_meas_queue.num =0;
+    g_glucose_data.gs_meas_queue.arena_end = 0;
     g_glucose_data.data_pending = FALSE;
 
-    for(i=0; i<MAX_NUMBER_GLUCOSE_MEASUREMENTS; i++)
+    /* No measurement has been deleted */
+    g_glucose_data.gs_meas_queue.num_deleted = 0;
+
+    /* An empty queue is sorted by user facing time */
+    g_glucose_data.gs_meas_queue.time_sorted = TRUE;
+
+    /* No report query has been made */
+    g_glucose_data.query_result.valid = FALSE;
+
+    for(i=0; i<MEAS_DELETED_MAP_WORDS; i++)
     {
-        /* Set the deleted flag in measurement data */
-        g_glucose_data.gs_meas_queue.gs_meas[i].deleted= TRUE;
+        g_glucose_data.gs_meas_queue.deleted_map[i] = 0;
     }
 }
 
@@ -1286,6 +3549,9 @@ extern bool IsGlucoseDataPending(void)
  *  The different values for these fields are made available 
  *  to the application from glucose_service.h.
  *
+ *  epoch: base time of the measurement in seconds since 1970. It is 
+ *  converted to the date and time fields when the measurement is notified.
+ *
  *
  *  RETURNS/MODIFIES
  *      Nothing.
@@ -1294,86 +3560,81 @@ extern bool IsGlucoseDataPending(void)
 
 extern void AddGlucoseMeasurementToQueue(
                 uint8 meas_flag,uint8 *meas_data,uint16 meas_len,
-                uint8 context_flag, uint8 *context_data, uint16 context_len, TIME_UNIX_CONV *tm)
+                uint8 context_flag, uint8 *context_data, uint16 context_len,
+                uint32 epoch)
 {
-    uint8 *temp_measurement_data = NULL;
-    uint8 *temp_context_data = NULL;
-    uint16 add_idx, data_len = 0;
+    /* The stored measurement is followed by the stored context */
+    uint8 temp_record_data[MAX_LEN_STORED_RECORD];
+    uint8 *temp_context_data;
+    uint16 data_len = 0;
     uint16 offset = g_glucose_data.nvm_offset + 
                                   NVM_GLUCOSE_SEQ_NUM;
 
-    /* Increment sequence number */
+    /* Increment sequence number, skipping the numbers after 0xFFFF which 
+     * the NVM record log cannot tell apart from those before it
+     */
     g_glucose_data.seq_num++;
+    if(g_glucose_data.seq_num == 0)
+    {
+        g_glucose_data.seq_num = SEQ_NUM_AFTER_WRAP;
+    }
 
-    /* Write glucose service sequence number to NVM */
-    Nvm_Write(&g_glucose_data.seq_num, sizeof(g_glucose_data.seq_num),
-                                                                offset);
+    /* Keep the NVM enabled for the sequence number and the record log */
+    Nvm_BeginTransaction();
 
-    /* Add new data to the end of circular queue. If max circular queue 
-     * length has reached the oldest measurement will get overwritten 
-     */
-    add_idx = 
-        (g_glucose_data.gs_meas_queue.start_idx +
-            g_glucose_data.gs_meas_queue.num)% 
-                                    MAX_NUMBER_GLUCOSE_MEASUREMENTS;
+    if((uint16)(g_glucose_data.seq_num_reserved - g_glucose_data.seq_num) >=
+                                                    SEQ_NUM_RESERVE_BLOCK)
+    {
+        /* The sequence number is past the last one reserved, reserve the
+         * next block of sequence numbers in NVM
+         */
+        g_glucose_data.seq_num_reserved = 
+                        g_glucose_data.seq_num + SEQ_NUM_RESERVE_BLOCK - 1;
 
-    /* ******* Fill glucose measurement data ******* */
-    temp_measurement_data = g_glucose_data.gs_meas_queue
-                                              .gs_meas[add_idx].meas_data;
+        /* A block ends at 0xFFFF, so that the numbers used after a reset
+         * carry on past the wrap as they do without one
+         */
+        if(g_glucose_data.seq_num_reserved < g_glucose_data.seq_num)
+        {
+            g_glucose_data.seq_num_reserved = 0xFFFF;
+        }
+
+        Nvm_Write(&g_glucose_data.seq_num_reserved, 
+                  SIZEOF_WORDS(g_glucose_data.seq_num_reserved), offset);
+    }
 
+    /* ******* Fill glucose measurement data ******* */
     /* Add measurement flag */
-    temp_measurement_data[data_len ++] = meas_flag;
-
-    /* Add sequence number */
-    g_glucose_data.gs_meas_queue
-            .gs_meas[add_idx].sequence_number = g_glucose_data.seq_num;
-
-    temp_measurement_data[data_len ++] = LE8_L(g_glucose_data.seq_num);
-    temp_measurement_data[data_len ++] = LE8_H(g_glucose_data.seq_num);
-
-    /* Add base time to glucose measurement data */
-    temp_measurement_data[data_len ++] = LE8_L(tm->tm_year); /* Year */
-    temp_measurement_data[data_len ++] = LE8_H(tm->tm_year);
-    temp_measurement_data[data_len ++] = tm->tm_mon; /* Month 0 to 12 */
-    temp_measurement_data[data_len ++] = tm->tm_mday; /* Day   1 to 31 */
-    temp_measurement_data[data_len ++] = 
-                tm->tm_hour; /* Hour  0 to 23 */
-    temp_measurement_data[data_len ++] = 
-                tm->tm_min; /* Min   0 to 59 */
-    temp_measurement_data[data_len ++] = 
-                tm->tm_sec; /* Secs  0 to 59 */
+    temp_record_data[data_len ++] = meas_flag;
+
+    /* Add base time in seconds since 1970. The sequence number and the 
+     * date and time fields are added when the measurement is notified.
+     */
+    temp_record_data[data_len ++] = LE8_L(epoch);
+    temp_record_data[data_len ++] = LE8_H(epoch);
+    temp_record_data[data_len ++] = LE8_L(epoch >> 16);
+    temp_record_data[data_len ++] = LE8_H(epoch >> 16);
 
     /* Add optional data based upon the flag set */
     if(meas_len)
-        MemCopy((uint8*)(temp_measurement_data + data_len), meas_data,
+        MemCopy((uint8*)(temp_record_data + data_len), meas_data,
                     meas_len);
 
-    g_glucose_data.gs_meas_queue.gs_meas[add_idx].meas_len = 
-                                                    meas_len + data_len;
-
-    /* Set the deleted flag in measurement data */
-    g_glucose_data.gs_meas_queue.gs_meas[add_idx].deleted= FALSE;
+    meas_len += data_len;
 
     /* ******* Fill glucose context information data ******* */
+    temp_context_data = temp_record_data + meas_len;
 
     /* Reset 'dataLen' variable */
     data_len = 0;
 
     if(context_len)
     {
-        temp_context_data = 
-            g_glucose_data.gs_meas_queue.gs_contexts[add_idx].context_data;
-
-        /* Add context information flag */
+        /* Add context information flag. The sequence number is added when 
+         * the context is notified.
+         */
         temp_context_data[data_len ++] = context_flag;
 
-        /* Add sequence number */
-        g_glucose_data.gs_meas_queue.gs_contexts[add_idx].sequence_number = 
-                                                g_glucose_data.seq_num;
- 
-        temp_context_data[data_len ++] = LE8_L(g_glucose_data.seq_num);
-        temp_context_data[data_len ++] = LE8_H(g_glucose_data.seq_num);
-
         /* Add optional data based upon the flag set */
         if(context_len)
             MemCopy((uint8*)(temp_context_data + data_len), context_data,
@@ -1381,19 +3642,17 @@ extern void AddGlucoseMeasurementToQueue(
 
     }
 
-    g_glucose_data.gs_meas_queue.gs_contexts[add_idx].context_len = 
-                                                        context_len + data_len;
+    context_len += data_len;
 
-    if(g_glucose_data.gs_meas_queue.num
-                                    < MAX_NUMBER_GLUCOSE_MEASUREMENTS)
-    {
-        g_glucose_data.gs_meas_queue.num++;
-    }
-    else /* Oldest glucose measurement overwritten, move the index */
-    {
-        g_glucose_data.gs_meas_queue.start_idx =
-            (add_idx + 1) % MAX_NUMBER_GLUCOSE_MEASUREMENTS;
-    }
+    /* Append the record to the record arena */
+    storeRecord(g_glucose_data.seq_num, temp_record_data, meas_len, 
+                context_len);
+
+    /* Append the record to the NVM record log */
+    writeRecordToLog(g_glucose_data.seq_num, temp_record_data, meas_len, 
+                     context_len);
+
+    Nvm_CommitTransaction();
 
     g_glucose_data.data_pending = TRUE;
 }
@@ -1507,7 +3766,7 @@ extern void GlucoseHandleAccessWrite(GATT_ACCESS_IND_T *p_ind)
                  if(AppIsDeviceBonded())
                  {
                      Nvm_Write((uint16 *)&client_config,
-                              sizeof(client_config),
+                              SIZEOF_WORDS(client_config),
                               offset);
                  }
             }
@@ -1543,7 +3802,7 @@ extern void GlucoseHandleAccessWrite(GATT_ACCESS_IND_T *p_ind)
                  if(AppIsDeviceBonded())
                  {
                      Nvm_Write((uint16 *)&client_config,
-                              sizeof(client_config),
+                              SIZEOF_WORDS(client_config),
                               offset);
                  }
             }
@@ -1579,7 +3838,7 @@ extern void GlucoseHandleAccessWrite(GATT_ACCESS_IND_T *p_ind)
                  if(AppIsDeviceBonded())
                  {
                      Nvm_Write((uint16 *)&client_config,
-                              sizeof(client_config),
+                              SIZEOF_WORDS(client_config),
                               offset);
                  }
             }
@@ -1631,7 +3890,7 @@ extern void GlucoseHandleAccessWrite(GATT_ACCESS_IND_T *p_ind)
  *
  *  DESCRIPTION
  *      This function is used to read Glucose service specific data stored in 
- *      NVM
+ *      NVM and to restore the glucose records from the NVM record log
  *
  *  RETURNS/MODIFIES
  *      Nothing.
@@ -1641,33 +3900,40 @@ extern void GlucoseReadDataFromNVM(bool bonded, uint16 *p_offset)
 {
     g_glucose_data.nvm_offset = *p_offset;
 
-    /* Read sequence number */
-    Nvm_Read(&g_glucose_data.seq_num,
-                   sizeof(g_glucose_data.seq_num),
+    /* Read the last reserved sequence number. The numbers reserved but not 
+     * used before the reset are skipped.
+     */
+    Nvm_Read(&g_glucose_data.seq_num_reserved,
+                   SIZEOF_WORDS(g_glucose_data.seq_num_reserved),
                    g_glucose_data.nvm_offset + NVM_GLUCOSE_SEQ_NUM);
+
+    g_glucose_data.seq_num = g_glucose_data.seq_num_reserved;
         
     /* Read NVM only if devices are bonded */
     if(bonded)
     {
         /* Read glucose measurement client configuration */
         Nvm_Read((uint16 *)&g_glucose_data.meas_client_config,
-                   sizeof(g_glucose_data.meas_client_config),
+                   SIZEOF_WORDS(g_glucose_data.meas_client_config),
                    g_glucose_data.nvm_offset + 
                    NVM_MEASUREMENT_CLIENT_CONFIG_OFFSET);
 
         /* Read glucose context information client configuration */
         Nvm_Read((uint16 *)&g_glucose_data.context_client_config,
-                   sizeof(g_glucose_data.context_client_config),
+                   SIZEOF_WORDS(g_glucose_data.context_client_config),
                    g_glucose_data.nvm_offset + 
                    NVM_CONTEXT_CLIENT_CONFIG_OFFSET);
 
         /* Read glucose RACP client configuration */
         Nvm_Read((uint16 *)&g_glucose_data.racp_client_config,
-                   sizeof(g_glucose_data.racp_client_config),
+                   SIZEOF_WORDS(g_glucose_data.racp_client_config),
                    g_glucose_data.nvm_offset + 
                    NVM_RACP_CLIENT_CONFIG_OFFSET);
     }
 
+    /* Restore the glucose records which were stored before the power loss */
+    readRecordLog(findLastSeqNumInLog());
+
     /* Increment the offset by the number of words of NVM memory required 
      * by service.
      */
@@ -1688,35 +3954,43 @@ extern void GlucoseReadDataFromNVM(bool bonded, uint16 *p_offset)
  *----------------------------------------------------------------------------*/
 extern void GlucoseHandleSignalLsRadioEventInd(uint16 ucid)
 {
-    uint8 idx;
+    const GLUCOSE_NOTIFY_TUPLE_T *p_last;
+
+#ifdef ENABLE_RACP_STATS
+    if(g_glucose_data.racp_procedure_in_progress)
+    {
+        g_glucose_data.racp_stats.radio_events++;
+    }
+#endif /* ENABLE_RACP_STATS */
     
     if(g_glucose_data.has_notification_failed_before)
     {
-        if(!g_glucose_data.abort_racp_in_progress &&
-            g_glucose_data.racp_procedure_in_progress &&
+        /* A connection event has freed firmware buffers, grant a window of
+         * notifications. If one is still waiting for its confirmation, the
+         * confirmation carries on with the window.
+         */
+        g_glucose_data.notify_credits = g_glucose_data.notify_window;
+
+        if(g_glucose_data.notification_in_flight)
+        {
+            return;
+        }
+
+        g_glucose_data.notify_credits--;
+
+        if(g_glucose_data.racp_procedure_in_progress &&
             g_glucose_data.send_the_last_notification_again)
         {
             /* The last notification sending had failed, send it again. */
             g_glucose_data.send_the_last_notification_again = FALSE;
 
-            idx = g_glucose_data.meas_pending.cqueue_idx
-                                                    [g_glucose_data.last_idx];
-            if(g_glucose_data.last_handle == HANDLE_GLUCOSE_MEASUREMENT)
-            {
-                GattCharValueNotification(ucid, 
-                            HANDLE_GLUCOSE_MEASUREMENT,
-                            g_glucose_data.gs_meas_queue.gs_meas[idx].meas_len, 
-                            g_glucose_data.gs_meas_queue.gs_meas[idx].meas_data);
-            }
-            else if(g_glucose_data.last_handle == 
-                                            HANDLE_GLUCOSE_MEASUREMENT_CONTEXT)
+            p_last = &g_glucose_data.notify_cursor.tuple[
+                                        g_glucose_data.notify_cursor.last];
+            if(p_last->handle != INVALID_ATT_HANDLE)
             {
-                GattCharValueNotification(ucid, 
-                            HANDLE_GLUCOSE_MEASUREMENT_CONTEXT,
-                            g_glucose_data.gs_meas_queue.
-                                                  gs_contexts[idx].context_len, 
-                            g_glucose_data.gs_meas_queue.
-                                                 gs_contexts[idx].context_data);
+                GattCharValueNotification(ucid, p_last->handle, 
+                                          p_last->len, p_last->data);
+                g_glucose_data.notification_in_flight = TRUE;
             }
         }
         else
@@ -1755,37 +4029,122 @@ extern void GlucoseHandleSignalGattCharValNotCfm(GATT_CHAR_VAL_IND_CFM_T
      * disable the radio tx events and resume normal functioning.
      */
 
-    if(!g_glucose_data.has_notification_failed_before)
+#ifdef ENABLE_RACP_STATS
+    if(p_event_data->handle == HANDLE_GLUCOSE_MEASUREMENT ||
+       p_event_data->handle == HANDLE_GLUCOSE_MEASUREMENT_CONTEXT)
+    {
+        if(p_event_data->result == sys_status_success)
+        {
+            g_glucose_data.racp_stats.notifications++;
+        }
+        else
+        {
+            g_glucose_data.racp_stats.notification_failures++;
+        }
+    }
+#endif /* ENABLE_RACP_STATS */
+
+    if(p_event_data->handle != HANDLE_GLUCOSE_MEASUREMENT &&
+       p_event_data->handle != HANDLE_GLUCOSE_MEASUREMENT_CONTEXT)
+    {
+        return;
+    }
+
+    g_glucose_data.notification_in_flight = FALSE;
+
+    if(!g_glucose_data.racp_procedure_in_progress)
+    {
+        /* A notification sent before the procedure was aborted */
+        return;
+    }
+
+    if(p_event_data->result != sys_status_success)
+    {
+        /* The firmware is out of buffers. Resend the notification on the 
+         * next Radio Tx event with half the window.
+         */
+        if(!g_glucose_data.has_notification_failed_before)
+        {
+            /* Enable radio events on Tx data. */
+            LsRadioEventNotification(p_event_data->cid, 
+                                     radio_event_tx_data);
+            g_glucose_data.has_notification_failed_before = TRUE;
+            g_glucose_data.notify_window = NOTIFY_WINDOW_MAX;
+#ifdef ENABLE_RACP_STATS
+            g_glucose_data.racp_stats.radio_event_driven = TRUE;
+#endif /* ENABLE_RACP_STATS */
+        }
+
+        g_glucose_data.send_the_last_notification_again = TRUE;
+        g_glucose_data.notify_window >>= 1;
+        if(g_glucose_data.notify_window == 0)
+        {
+            g_glucose_data.notify_window = 1;
+        }
+        g_glucose_data.notify_credits = 0;
+    }
+    else if(!g_glucose_data.has_notification_failed_before)
     {
         /* No notification sending has failed so far, the application shall 
          * continue sending notification to ensure good throughput.
          */
+        sendMeasContextOrMoveToNextRecord(ucid);
+    }
+    else if(g_glucose_data.notify_credits)
+    {
+        /* Carry on with the window of this connection event */
+        g_glucose_data.notify_credits--;
+        sendMeasContextOrMoveToNextRecord(ucid);
+    }
+    else if(g_glucose_data.notify_window < NOTIFY_WINDOW_MAX)
+    {
+        /* The whole window was accepted, try a larger one on the next
+         * Radio Tx event
+         */
+        g_glucose_data.notify_window++;
+    }
+    else
+    {
+        /* The firmware has buffers free again, go back to pumping 
+         * notifications on confirmations
+         */
+        g_glucose_data.has_notification_failed_before = FALSE;
+        LsRadioEventNotification(ucid, radio_event_none);
+        sendMeasContextOrMoveToNextRecord(ucid);
+    }
+}
 
-        if(p_event_data->handle == HANDLE_GLUCOSE_MEASUREMENT ||
-           p_event_data->handle == HANDLE_GLUCOSE_MEASUREMENT_CONTEXT)
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      GlucoseHandleSignalGattCharValIndCfm
+ *
+ *  DESCRIPTION
+ *      This function handles the confirmation of an indication sent. Once the
+ *      collector has confirmed an RACP indication the link is idle, so the 
+ *      application uses it to compact one deleted measurement. Confirming the
+ *      response of a sync acknowledges the records it reported.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+extern void GlucoseHandleSignalGattCharValIndCfm(GATT_CHAR_VAL_IND_CFM_T 
+                                                                *p_event_data)
+{
+    if(p_event_data->handle == HANDLE_RECORD_ACCESS_CONTROL_POINT)
+    {
+        if(g_glucose_data.sync_in_progress && 
+           p_event_data->result == sys_status_success)
         {
-            /* If the firmware has returned a success in the notification 
-             * confirmation, the application shall send the next notification.
+            /* The collector has received the response of the report, and 
+             * so all the records before it
              */
-            if(p_event_data->result == sys_status_success)
-            {
-                sendMeasContextOrMoveToNextRecord(ucid);
-            }
-            else
-            {
-                /* Enable radio events on Tx data. */
-                LsRadioEventNotification(p_event_data->cid, 
-                                         radio_event_tx_data);
-                g_glucose_data.has_notification_failed_before = TRUE;
-                g_glucose_data.send_the_last_notification_again = TRUE;
-            }
-
+            AppSetSyncedSeqNum(g_glucose_data.sync_seq_num);
         }
-    }
-    /* The application need not do anything in the else part. It will keep 
-     * sending notifcations based on Radio Tx events.
-     */
+        g_glucose_data.sync_in_progress = FALSE;
 
+        compactMeasQueueStep();
+    }
 }
 
 /*----------------------------------------------------------------------------*
@@ -1831,19 +4190,48 @@ extern void GlucoseBondingNotify(bool bond_status)
         uint16 offset = g_glucose_data.nvm_offset + 
                                   NVM_MEASUREMENT_CLIENT_CONFIG_OFFSET;
 
-        Nvm_Write((uint16 *)&client_config, sizeof(client_config), offset);
+        /* The client configurations are adjacent in NVM, they are written 
+         * with a single NVM write.
+         */
+        Nvm_BeginTransaction();
+
+        Nvm_Write((uint16 *)&client_config, SIZEOF_WORDS(client_config), 
+                  offset);
 
         client_config = g_glucose_data.context_client_config;
         offset = g_glucose_data.nvm_offset + 
                                  NVM_CONTEXT_CLIENT_CONFIG_OFFSET;
 
-        Nvm_Write((uint16 *)&client_config, sizeof(client_config), offset);
+        Nvm_Write((uint16 *)&client_config, SIZEOF_WORDS(client_config), 
+                  offset);
 
         client_config = g_glucose_data.racp_client_config;
         offset = g_glucose_data.nvm_offset + 
                                  NVM_RACP_CLIENT_CONFIG_OFFSET;
 
-        Nvm_Write((uint16 *)&client_config, sizeof(client_config), offset);
+        Nvm_Write((uint16 *)&client_config, SIZEOF_WORDS(client_config), 
+                  offset);
+
+        Nvm_CommitTransaction();
     }
 }
 
+#ifdef ENABLE_RACP_STATS
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      GlucoseGetRACPStats
+ *
+ *  DESCRIPTION
+ *      This function returns the throughput statistics of the last RACP
+ *      Report Stored Records procedure. They are complete once the final
+ *      RESPONSE_CODE indication has been sent.
+ *
+ *  RETURNS/MODIFIES
+ *      Pointer to the statistics.
+ *
+ *----------------------------------------------------------------------------*/
+extern const GLUCOSE_RACP_STATS_T *GlucoseGetRACPStats(void)
+{
+    return &g_glucose_data.racp_stats;
+}
+#endif /* ENABLE_RACP_STATS */
@@ -29,14 +29,27 @@
  *  Public Definitions
  *============================================================================*/
 
+/* Enable this flag to collect throughput statistics for every RACP Report
+ * Stored Records procedure. The figures are kept in g_glucose_data.racp_stats
+ * and can be inspected with the debugger, or read with GlucoseGetRACPStats,
+ * after the final RACP indication. The host benchmark (host/bench_racp.c)
+ * is built with it. Collecting them does not change how the notifications
+ * are sent.
+ */
+/*#define ENABLE_RACP_STATS*/
+
 #define MAX_LEN_MEAS_FIELDS                         (17)
 #define MAX_LEN_MEAS_OPTIONAL_FIELDS                (7)
 
 #define MAX_LEN_CONTEXT_FIELDS                      (17)
 #define MAX_LEN_CONTEXT_OPTIONAL_FIELDS             (14)
 
-#define MAX_NUMBER_GLUCOSE_MEASUREMENTS             (0x64)
-#define MAX_NUMBER_GLUCOSE_CONTEXT                  (0x64)
+#define MAX_NUMBER_GLUCOSE_MEASUREMENTS             (0xD4)
+
+/* Size (in octets) of the arena in which the glucose measurements and 
+ * contexts are stored with their actual lengths. It must be even.
+ */
+#define GLUCOSE_RECORD_ARENA_SIZE                   (0x130C)
 
 /* Bit masks for glucose measurement flag byte */
 #define TIME_OFFSET_PRESENT                         (0x01)
@@ -163,6 +176,11 @@
 #define OPERATOR_RFU_START                          (0x07)
 #define OPERATOR_RFU_END                            (0xFF)
 
+/* Vendor specific operator, taken from the RFU range, for the records newer 
+ * than the last one the collector has acknowledged. It has no operand.
+ */
+#define OPERATOR_SINCE_LAST_SYNC                    (0xF0)
+
 /* Operand filter type value */
 #define SEQUENCE_NUMBER                             (0x01)
 #define USER_FACING_TIME                            (0x02)
@@ -188,7 +206,66 @@
 #define NVM_CONTEXT_CLIENT_CONFIG_OFFSET            (2)
 #define NVM_RACP_CLIENT_CONFIG_OFFSET               (3)
 
-#define GLUCOSE_SERVICE_NVM_MEMORY_WORDS            (4)
+/* The glucose records are also kept in a record log in NVM so that they
+ * survive a power loss. The log holds the most recent NVM_RECORD_LOG_ENTRIES
+ * records, the entry of a record being its sequence number modulo the number
+ * of entries. Each entry has a sequence number word (0 when empty) and
+ * NVM_RECORD_LOG_DATA_WORDS data words: the measurement and context lengths
+ * followed by the stored record packed two octets per word. Records with a
+ * sequence number up to the one at NVM_RECORD_LOG_DELETED_SEQ_NUM have been
+ * deleted.
+ */
+#define NVM_RECORD_LOG_DELETED_SEQ_NUM              (4)
+#define NVM_RECORD_LOG_SEQ_NUM_OFFSET               (5)
+
+#define NVM_RECORD_LOG_ENTRIES                      (0x78)
+#define NVM_RECORD_LOG_DATA_WORDS                   (15)
+
+#define NVM_RECORD_LOG_DATA_OFFSET                  \
+                (NVM_RECORD_LOG_SEQ_NUM_OFFSET + NVM_RECORD_LOG_ENTRIES)
+
+#define GLUCOSE_SERVICE_NVM_MEMORY_WORDS            \
+                (NVM_RECORD_LOG_DATA_OFFSET +                               \
+                 NVM_RECORD_LOG_ENTRIES * NVM_RECORD_LOG_DATA_WORDS)
+
+/*============================================================================*
+ *  Public Data Types
+ *============================================================================*/
+
+#ifdef ENABLE_RACP_STATS
+/* Throughput statistics of the last RACP Report Stored Records procedure.
+ *
+ * Records per second   = num_records * SECOND / (end_time - start_time)
+ */
+typedef struct _glucose_racp_stats
+{
+    /* Number of records selected for transmission */
+    uint16              num_records;
+
+    /* Notifications accepted by the firmware */
+    uint16              notifications;
+
+    /* Notifications rejected by the firmware because it was out of buffers */
+    uint16              notification_failures;
+
+    /* Radio Tx events received during the procedure. They are only enabled
+     * while the notifications are pumped on them.
+     */
+    uint16              radio_events;
+
+    /* TRUE if the transfer had to fall back to pumping notifications on
+     * radio Tx events instead of on notification confirmations
+     */
+    bool                radio_event_driven;
+
+    /* Time (in microseconds) at which the procedure was started and at which
+     * the final RESPONSE_CODE indication was sent.
+     */
+    uint32              start_time;
+    uint32              end_time;
+
+} GLUCOSE_RACP_STATS_T;
+#endif /* ENABLE_RACP_STATS */
 
 /*============================================================================*
  *  Public Function Prototypes
@@ -205,7 +282,8 @@ extern bool IsGlucoseDataPending(void);
 /* This function adds Glucose measurement data to the measurement queue. */
 extern void AddGlucoseMeasurementToQueue(
                 uint8 meas_flag,uint8 *meas_data,uint16 meas_len,
-                uint8 context_flag, uint8 *context_data, uint16 context_len,TIME_UNIX_CONV *tm);
+                uint8 context_flag, uint8 *context_data, uint16 context_len,
+                uint32 epoch);
 
 /* This function handles the read access requests on Glucose Service 
  * characteristics.
@@ -229,6 +307,11 @@ extern void GlucoseHandleSignalLsRadioEventInd(uint16 ucid);
 extern void GlucoseHandleSignalGattCharValNotCfm(GATT_CHAR_VAL_IND_CFM_T 
                                                                 *p_event_data);
 
+/* This function handles the confirmation signal for the indication sent.
+ */
+extern void GlucoseHandleSignalGattCharValIndCfm(GATT_CHAR_VAL_IND_CFM_T 
+                                                                *p_event_data);
+
 /* This function checks if the parameter received falls under the Glucose 
  * Service handle range or not.
  */
@@ -244,4 +327,11 @@ extern void GlucoseSeqNumInit(uint16 offset);
  */
 extern void GlucoseBondingNotify(bool bond_Status);
 
+#ifdef ENABLE_RACP_STATS
+/* This function returns the throughput statistics of the last RACP Report
+ * Stored Records procedure.
+ */
+extern const GLUCOSE_RACP_STATS_T *GlucoseGetRACPStats(void);
+#endif /* ENABLE_RACP_STATS */
+
 #endif /* __GLUCOSE_SERVICE_H__ */
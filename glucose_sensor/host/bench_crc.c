@@ -0,0 +1,129 @@
+/******************************************************************************
+ *  FILE
+ *      bench_crc.c
+ *
+ *  DESCRIPTION
+ *      Host benchmark of the CRC-CCITT of Calc_CRC.c with the 256 and the 16
+ *      entry tables, and of the bitwise calculation it replaced, over whole
+ *      buffers and a byte at a time as uartio.c feeds the frame bytes. The
+ *      times are of the host processor, so only the ratios between the
+ *      variants carry over to the XAP. It is built with "make bench".
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <time.h>
+
+#include "crc_ref.h"
+#include "host_test.h"
+
+/*============================================================================*
+ *  Private Definitions
+ *============================================================================*/
+
+/* Length of the buffer, that of a long meter frame, and the number of times
+ * it is run through each variant
+ */
+#define BENCH_LEN                       (256)
+#define BENCH_ROUNDS                    (40000UL)
+
+/*============================================================================*
+ *  Private Data
+ *============================================================================*/
+
+static uint8 g_buf[BENCH_LEN];
+
+/* Results of the runs, kept so that they are not optimised away */
+static volatile uint16 g_crc;
+
+/*============================================================================*
+ *  Private Function Implementations
+ *============================================================================*/
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Time a variant over whole buffers, print it and return its CRC */
+static uint16 benchBuffer(const char *p_name,
+                          unsigned short (*p_calculate)(unsigned short,
+                                                        const unsigned char *,
+                                                        unsigned short))
+{
+    uint16 crc = CRC_CCITT_SEED;
+    uint32 round;
+    double start = now();
+    double elapsed;
+
+    for(round = 0; round < BENCH_ROUNDS; round++)
+    {
+        crc = p_calculate(crc, g_buf, BENCH_LEN);
+    }
+
+    elapsed = now() - start;
+    g_crc = crc;
+
+    printf("%-24s %8.2f ns/byte %8.1f MB/s\n", p_name,
+           elapsed * 1e9 / (BENCH_ROUNDS * BENCH_LEN),
+           BENCH_ROUNDS * BENCH_LEN / elapsed / 1e6);
+
+    return crc;
+}
+
+/* Time a variant a byte at a time, print it and return its CRC */
+static uint16 benchUpdate(const char *p_name,
+                          uint16 (*p_update)(uint16, uint8))
+{
+    uint16 crc = CRC_CCITT_SEED;
+    uint32 round;
+    uint16 i;
+    double start = now();
+    double elapsed;
+
+    for(round = 0; round < BENCH_ROUNDS; round++)
+    {
+        for(i = 0; i < BENCH_LEN; i++)
+        {
+            crc = p_update(crc, g_buf[i]);
+        }
+    }
+
+    elapsed = now() - start;
+    g_crc = crc;
+
+    printf("%-24s %8.2f ns/byte %8.1f MB/s\n", p_name,
+           elapsed * 1e9 / (BENCH_ROUNDS * BENCH_LEN),
+           BENCH_ROUNDS * BENCH_LEN / elapsed / 1e6);
+
+    return crc;
+}
+
+/*============================================================================*
+ *  Public Function Implementations
+ *============================================================================*/
+
+int main(void)
+{
+    uint16 ref;
+    uint16 i;
+
+    for(i = 0; i < BENCH_LEN; i++)
+    {
+        g_buf[i] = (uint8)(i * 7 + 3);
+    }
+
+    printf("CRC-CCITT of %u bytes, %lu times\n\n", BENCH_LEN, BENCH_ROUNDS);
+
+    ref = benchBuffer("bitwise (original)", crcRefCalculate);
+    CHECK(benchBuffer("256 entry table", crc_calculate_crc) == ref);
+    CHECK(benchBuffer("16 entry table", crc_calculate_crc_nibble) == ref);
+    CHECK(benchUpdate("256 entry table, bytes", crc_update_crc) == ref);
+    CHECK(benchUpdate("16 entry table, bytes", crc_update_crc_nibble) == ref);
+
+    printf("\n");
+    return HOST_TEST_RESULT("bench_crc");
+}
@@ -0,0 +1,158 @@
+/******************************************************************************
+ *  FILE
+ *      bench_racp.c
+ *
+ *  DESCRIPTION
+ *      Host benchmark of the RACP Report Stored Records procedure. It reports
+ *      all of 1, 10, 100 and MAX_NUMBER_GLUCOSE_MEASUREMENTS records, with
+ *      and without contexts, over the emulated link of host_link.c:
+ *
+ *      - with enough firmware buffers for every notification, so that they
+ *        are pumped on their confirmations, and
+ *      - with few firmware buffers, so that the notifications fail and are
+ *        pumped on radio Tx events.
+ *
+ *      For each transfer it prints the records per second and the time to
+ *      the final RESPONSE_CODE indication on the virtual clock, the
+ *      notifications, failures and radio Tx events counted by the service
+ *      with ENABLE_RACP_STATS, and the packets per connection event of the
+ *      link. It is built with "make bench".
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+
+#include "app_gatt_db.h"
+#include "glucose_service.h"
+#include "host_link.h"
+#include "host_test.h"
+
+#ifndef ENABLE_RACP_STATS
+#error "The benchmark needs ENABLE_RACP_STATS, build it with make bench"
+#endif /* ENABLE_RACP_STATS */
+
+/*============================================================================*
+ *  Private Definitions
+ *============================================================================*/
+
+/* Link of the benchmark: packets sent per connection event and connection
+ * interval in microseconds, the short interval asked for bulk transfers
+ */
+#define BENCH_PER_EVENT                 (4)
+#define BENCH_INTERVAL                  (7500)
+
+/* Firmware buffers of the radio event driven transfers */
+#define BENCH_FEW_BUFFERS               (4)
+
+/*============================================================================*
+ *  Private Data
+ *============================================================================*/
+
+static const uint16 g_num_records[] =
+{
+    1, 10, 100, MAX_NUMBER_GLUCOSE_MEASUREMENTS
+};
+
+/*============================================================================*
+ *  Private Function Implementations
+ *============================================================================*/
+
+/* Add 'num' records with or without contexts to an empty store */
+static void fillStore(uint16 num, bool contexts)
+{
+    uint8 meas[] = {0x00, 0x00, 0x46, 0xb0, 0x11, 0x00, 0x00};
+    uint8 context[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13};
+    uint32 epoch = 1431702245UL;
+
+    HostLinkPowerOn(TRUE);
+
+    while(num--)
+    {
+        if(contexts)
+        {
+            AddGlucoseMeasurementToQueue(0x1f, meas, sizeof(meas),
+                                         0xff, context, sizeof(context),
+                                         epoch);
+        }
+        else
+        {
+            AddGlucoseMeasurementToQueue(0x0f, meas, sizeof(meas),
+                                         0, NULL, 0, epoch);
+        }
+
+        epoch += 60;
+    }
+}
+
+/* Report all the records and print the figures of the transfer */
+static void benchTransfer(uint16 num, bool contexts, bool few_buffers)
+{
+    uint8 report_all[] = {REPORT_STORED_RECORDS, ALL_RECORDS};
+    const GLUCOSE_RACP_STATS_T *p_stats = GlucoseGetRACPStats();
+    uint32 start;
+    uint32 elapsed;
+
+    HostLinkInit(few_buffers ? BENCH_FEW_BUFFERS : HOST_LINK_DEFAULT_BUFFERS,
+                 BENCH_PER_EVENT, BENCH_INTERVAL);
+    fillStore(num, contexts);
+    HostLinkSubscribe();
+
+    start = g_host_sdk.now;
+    HostLinkRequest(report_all, sizeof(report_all));
+    elapsed = g_host_link.response_time - start;
+
+    /* The transfer and the statistics of the service agree */
+    CHECK(HostLinkResponseValue() == RESPONSE_CODE_SUCCESS);
+    CHECK(g_host_link.num_meas == num);
+    CHECK(g_host_link.num_contexts == (contexts ? num : 0));
+    CHECK(p_stats->num_records == num);
+    CHECK(p_stats->notifications ==
+                        g_host_link.num_meas + g_host_link.num_contexts);
+    CHECK(p_stats->notification_failures == g_host_link.failures);
+    CHECK(p_stats->radio_event_driven == (g_host_link.failures != 0));
+    CHECK(few_buffers || !p_stats->radio_event_driven);
+
+    printf("%7u  %-8s %-6s %6u %6u %8u %8u %9.2f %9.1f %9.0f\n",
+           (unsigned int)num,
+           contexts ? "yes" : "no",
+           p_stats->radio_event_driven ? "radio" : "cfm",
+           (unsigned int)p_stats->notifications,
+           (unsigned int)p_stats->notification_failures,
+           (unsigned int)p_stats->radio_events,
+           (unsigned int)g_host_link.events,
+           (double)g_host_link.packets / g_host_link.events,
+           elapsed / 1000.0,
+           elapsed ? num * 1000000.0 / elapsed : 0.0);
+}
+
+/*============================================================================*
+ *  Public Function Implementations
+ *============================================================================*/
+
+int main(void)
+{
+    uint16 few_buffers;
+    uint16 contexts;
+    uint16 i;
+
+    printf("Link: %u packets per connection event every %.1f ms, "
+           "%u firmware buffers in the radio event driven transfers\n\n",
+           BENCH_PER_EVENT, BENCH_INTERVAL / 1000.0, BENCH_FEW_BUFFERS);
+    printf("records  contexts pump    notif   fail  tx evts  "
+           "conn ev  pkts/ev   time ms records/s\n");
+
+    for(few_buffers = 0; few_buffers < 2; few_buffers++)
+    {
+        for(contexts = 0; contexts < 2; contexts++)
+        {
+            for(i = 0; i < sizeof(g_num_records) / sizeof(g_num_records[0]);
+                i++)
+            {
+                benchTransfer(g_num_records[i], contexts, few_buffers);
+            }
+        }
+    }
+
+    printf("\n");
+    return HOST_TEST_RESULT("bench_racp");
+}
@@ -0,0 +1,62 @@
+/******************************************************************************
+ *  FILE
+ *      crc_ref.h
+ *
+ *  DESCRIPTION
+ *      Reference CRC-CCITT of the host CRC test and benchmark: the bitwise
+ *      calculation which Calc_CRC.c had before it became table driven, and
+ *      the 16 entry table variant of Calc_CRC.c, built here under other
+ *      names so that both variants can be run by one program.
+ *
+ ******************************************************************************/
+
+#ifndef __CRC_REF_H__
+#define __CRC_REF_H__
+
+#include "Calc_CRC.h"
+
+/* Bitwise calculation of the original Calc_CRC.c */
+static unsigned short crcRefCalculate(unsigned short initial_crc,
+                                      const unsigned char *buffer,
+                                      unsigned short length)
+{
+    unsigned short index = 0;
+    unsigned short crc = initial_crc;
+
+    if(buffer != NULL)
+    {
+        for(index = 0; index < length; index++)
+        {
+            crc = (unsigned short)((unsigned char)(crc >> 8) |
+                                   (unsigned short)(crc << 8));
+            crc ^= buffer[index];
+            crc ^= (unsigned char)(crc & 0xff) >> 4;
+            crc ^= (unsigned short)((unsigned short)(crc << 8) << 4);
+            crc ^= (unsigned short)((unsigned short)((crc & 0xff) << 4) << 1);
+        }
+    }
+
+    return crc;
+}
+
+/* The nibble table variant, as crc_update_crc_nibble and
+ * crc_calculate_crc_nibble
+ */
+#define CRC_NIBBLE_TABLE
+#define crc_table                       crc_table_nibble
+#define crc_update_crc                  crc_update_crc_nibble
+#define crc_calculate_crc               crc_calculate_crc_nibble
+
+extern uint16 crc_update_crc(uint16 crc, uint8 byte);
+extern unsigned short crc_calculate_crc(unsigned short initial_crc,
+                                        const unsigned char *buffer,
+                                        unsigned short length);
+
+#include "Calc_CRC.c"
+
+#undef crc_calculate_crc
+#undef crc_update_crc
+#undef crc_table
+#undef CRC_NIBBLE_TABLE
+
+#endif /* __CRC_REF_H__ */
@@ -0,0 +1,722 @@
+/******************************************************************************
+ *  FILE
+ *      host_link.c
+ *
+ *  DESCRIPTION
+ *      Host emulation of the radio link between the glucose sensor
+ *      application and a collector.
+ *
+ *      The application is brought up and connected by the firmware events
+ *      it gets on a device: the database is added, a short button press
+ *      starts advertising and the collector connects, pairs when the
+ *      application is not bonded and encrypts the link. Events are handed
+ *      to AppProcessLmEvent as the firmware does, those which follow a
+ *      call of the application once it has returned.
+ *
+ *      A notification takes one of the firmware buffers, or is refused with
+ *      a failed confirmation when they are all taken. An RACP indication is
+ *      queued behind the notifications. Connection events send up to
+ *      'per_event' packets every 'interval' and raise a radio Tx event when
+ *      they are enabled. Timers of the application fire on the virtual
+ *      clock between connection events.
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "app_gatt_db.h"
+#include "host_link.h"
+
+/*============================================================================*
+ *  Private Definitions
+ *============================================================================*/
+
+/* Steps after which a run of the link is taken to be stuck */
+#define HOST_LINK_MAX_STEPS             (1000000UL)
+
+/* Connection interval, latency and supervision timeout are in units of
+ * 1.25 ms and 10 ms
+ */
+#define HOST_LINK_INTERVAL_UNIT         (1250)
+#define HOST_LINK_SUPERVISION_TIMEOUT   (0x03e8)
+
+/* Encryption change status when the key of the collector is refused */
+#define HOST_LINK_KEY_MISSING           (0x06)
+
+/*============================================================================*
+ *  Public Data
+ *============================================================================*/
+
+HOST_LINK_T g_host_link;
+
+/*============================================================================*
+ *  Private Data
+ *============================================================================*/
+
+/* Public address of the collector */
+static const TYPED_BD_ADDR_T g_collector_addr =
+{
+    L2CA_PUBLIC_ADDR_TYPE, {0x123456, 0x78, 0x9abc}
+};
+
+/*============================================================================*
+ *  Private Function Implementations
+ *============================================================================*/
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      queueEvent
+ *
+ *  DESCRIPTION
+ *      This function queues a firmware event, to be delivered once the
+ *      application has returned.
+ *
+ *  RETURNS/MODIFIES
+ *      The event, for its data to be filled in.
+ *
+ *----------------------------------------------------------------------------*/
+static HOST_LINK_EVENT_T *queueEvent(lm_event_code code)
+{
+    HOST_LINK_EVENT_T *p_event;
+
+    if(g_host_link.num_pending == HOST_LINK_MAX_EVENTS)
+    {
+        fprintf(stderr, "Too many firmware events waiting\n");
+        exit(2);
+    }
+
+    p_event = &g_host_link.pending[g_host_link.num_pending++];
+    memset(p_event, 0, sizeof(*p_event));
+    p_event->code = code;
+
+    return p_event;
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      deliverEvent
+ *
+ *  DESCRIPTION
+ *      This function hands a firmware event to the application.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+static void deliverEvent(HOST_LINK_EVENT_T *p_event)
+{
+    AppProcessLmEvent(p_event->code, (LM_EVENT_T *)&p_event->data);
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      deliverPendingEvents
+ *
+ *  DESCRIPTION
+ *      This function delivers the queued firmware events in order, along
+ *      with those queued while they are handled.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+static void deliverPendingEvents(void)
+{
+    HOST_LINK_EVENT_T event;
+
+    while(g_host_link.num_pending)
+    {
+        event = g_host_link.pending[0];
+        g_host_link.num_pending--;
+        memmove(&g_host_link.pending[0], &g_host_link.pending[1],
+                g_host_link.num_pending * sizeof(event));
+
+        deliverEvent(&event);
+    }
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      queueEncryptionChange
+ *
+ *  DESCRIPTION
+ *      This function queues the end of the encryption of the link.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+static void queueEncryptionChange(uint16 status)
+{
+    HOST_LINK_EVENT_T *p_event = queueEvent(LM_EV_ENCRYPTION_CHANGE);
+
+    p_event->data.lm.enc_change.data.status = status;
+    p_event->data.lm.enc_change.data.enc_enable = (status == HCI_SUCCESS);
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      setConnectionData
+ *
+ *  DESCRIPTION
+ *      This function fills in the parameters of the connection.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+static void setConnectionData(HCI_EV_DATA_ULP_CONNECTION_T *p_data)
+{
+    p_data->status = HCI_SUCCESS;
+    p_data->conn_interval = (uint16)(g_host_link.interval /
+                                     HOST_LINK_INTERVAL_UNIT);
+    p_data->conn_latency = 0;
+    p_data->supervision_timeout = HOST_LINK_SUPERVISION_TIMEOUT;
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      pair
+ *
+ *  DESCRIPTION
+ *      This function queues the events of the collector pairing with the
+ *      application and encrypting the link, and bonds the collector.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+static void pair(void)
+{
+    static SM_KEYSET_T keys;
+    HOST_LINK_EVENT_T *p_event;
+
+    memset(&keys, 0, sizeof(keys));
+    keys.div = HOST_LINK_PAIRING_DIV;
+
+    p_event = queueEvent(SM_KEYS_IND);
+    p_event->data.keys_ind.cid = HOST_LINK_UCID;
+    p_event->data.keys_ind.keys = &keys;
+
+    p_event = queueEvent(SM_SIMPLE_PAIRING_COMPLETE_IND);
+    p_event->data.pairing_complete_ind.bd_addr = g_collector_addr;
+    p_event->data.pairing_complete_ind.status = sys_status_success;
+
+    queueEncryptionChange(HCI_SUCCESS);
+
+    g_host_link.bonded = TRUE;
+    g_host_link.div = HOST_LINK_PAIRING_DIV;
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      runConnectionEvent
+ *
+ *  DESCRIPTION
+ *      This function advances the clock to the next connection event, sends
+ *      the packets waiting in the firmware buffers and raises the radio Tx
+ *      event.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+static void runConnectionEvent(void)
+{
+    HOST_LINK_EVENT_T event;
+    uint16 sent = g_host_link.queued;
+
+    g_host_sdk.now = g_host_link.next_event;
+    g_host_link.next_event += g_host_link.interval;
+
+    if(sent > g_host_link.per_event)
+    {
+        sent = g_host_link.per_event;
+    }
+
+    g_host_link.queued -= sent;
+    g_host_link.packets += sent;
+    g_host_link.events++;
+
+    if(g_host_link.response_pos)
+    {
+        if(g_host_link.response_pos <= sent)
+        {
+            g_host_link.response_pos = 0;
+            g_host_link.response_time = g_host_sdk.now;
+        }
+        else
+        {
+            g_host_link.response_pos -= sent;
+        }
+    }
+
+    if(g_host_link.radio_events)
+    {
+        memset(&event, 0, sizeof(event));
+        event.code = LS_RADIO_EVENT_IND;
+        deliverEvent(&event);
+    }
+
+    if(g_host_link.p_event_hook)
+    {
+        g_host_link.p_event_hook();
+    }
+}
+
+/*============================================================================*
+ *  Public Function Implementations
+ *============================================================================*/
+
+/* GATT functions of the SDK */
+
+extern void GattInit(void)
+{
+}
+
+extern void GattInstallServerWrite(void)
+{
+}
+
+extern void GattAddDatabaseReq(uint16 length, uint16 *p_database)
+{
+    HOST_LINK_EVENT_T *p_event = queueEvent(GATT_ADD_DB_CFM);
+
+    (void)length;
+
+    p_event->data.add_db_cfm.result = p_database ? sys_status_success :
+                                                   sys_status_failed;
+}
+
+extern void GattConnectReq(TYPED_BD_ADDR_T *p_addr, uint16 flags)
+{
+    (void)p_addr;
+    (void)flags;
+}
+
+extern void GattCancelConnectReq(void)
+{
+    queueEvent(GATT_CANCEL_CONNECT_CFM);
+}
+
+extern void GattDisconnectReq(uint16 ucid)
+{
+    HOST_LINK_EVENT_T *p_event;
+
+    (void)ucid;
+
+    g_host_link.connected = FALSE;
+    g_host_link.queued = 0;
+    g_host_link.radio_events = FALSE;
+
+    p_event = queueEvent(LM_EV_DISCONNECT_COMPLETE);
+    p_event->data.lm.disconnect_complete.data.status = HCI_SUCCESS;
+    p_event->data.lm.disconnect_complete.data.reason =
+                                            HCI_ERROR_CONN_TERM_LOCAL_HOST;
+}
+
+extern void GattCharValueNotification(uint16 ucid, uint16 handle,
+                                      uint16 size, const uint8 *value)
+{
+    HOST_LINK_EVENT_T *p_event = queueEvent(GATT_CHAR_VAL_NOT_CFM);
+
+    p_event->data.val_cfm.cid = ucid;
+    p_event->data.val_cfm.handle = handle;
+
+    if(g_host_link.queued >= g_host_link.buffers)
+    {
+        g_host_link.failures++;
+        p_event->data.val_cfm.result = sys_status_failed;
+        return;
+    }
+
+    g_host_link.queued++;
+    p_event->data.val_cfm.result = sys_status_success;
+
+    if(handle == HANDLE_GLUCOSE_MEASUREMENT)
+    {
+        if(g_host_link.num_meas < HOST_LINK_MAX_RECORDS)
+        {
+            g_host_link.seq_nums[g_host_link.num_meas] =
+                                        (uint16)(value[1] | (value[2] << 8));
+        }
+        g_host_link.num_meas++;
+        memcpy(g_host_link.meas, value, size);
+        g_host_link.meas_len = size;
+    }
+    else if(handle == HANDLE_GLUCOSE_MEASUREMENT_CONTEXT)
+    {
+        g_host_link.num_contexts++;
+        memcpy(g_host_link.context, value, size);
+        g_host_link.context_len = size;
+    }
+}
+
+extern void GattCharValueIndication(uint16 ucid, uint16 handle,
+                                    uint16 size, const uint8 *value)
+{
+    (void)ucid;
+
+    if(handle == HANDLE_RECORD_ACCESS_CONTROL_POINT)
+    {
+        memcpy(g_host_link.response, value, size);
+        g_host_link.response_len = size;
+        g_host_link.indications++;
+
+        /* The indication is sent after the notifications queued before it */
+        g_host_link.queued++;
+        g_host_link.response_pos = g_host_link.queued;
+    }
+}
+
+extern void GattAccessRsp(uint16 ucid, uint16 handle, uint16 result,
+                          uint16 size, const uint8 *value)
+{
+    (void)ucid; (void)handle; (void)size; (void)value;
+
+    g_host_link.access_result = result;
+}
+
+/* Link supervisor functions of the SDK */
+
+extern void LsRadioEventNotification(uint16 ucid, radio_event event)
+{
+    (void)ucid;
+
+    g_host_link.radio_events = (event == radio_event_tx_data);
+}
+
+extern ls_err LsConnectionParamUpdateReq(TYPED_BD_ADDR_T *p_addr,
+                                         ble_con_params *p_params)
+{
+    HOST_LINK_EVENT_T *p_event;
+
+    (void)p_addr;
+
+    g_host_link.param_update_reqs++;
+    g_host_link.params = *p_params;
+
+    p_event = queueEvent(LS_CONNECTION_PARAM_UPDATE_CFM);
+
+    if(g_host_link.reject_param_updates)
+    {
+        p_event->data.param_update_cfm.status = ls_err_failed;
+        return ls_err_none;
+    }
+
+    p_event->data.param_update_cfm.status = ls_err_none;
+
+    /* The collector updates the connection to the interval it has */
+    p_event = queueEvent(LM_EV_CONNECTION_UPDATE);
+    setConnectionData(&p_event->data.lm.connection_update.data);
+
+    p_event = queueEvent(LS_CONNECTION_PARAM_UPDATE_IND);
+    p_event->data.param_update_ind.status = ls_err_none;
+
+    return ls_err_none;
+}
+
+extern ls_err LsStoreAdvScanData(uint16 len, uint8 *p_data, ad_src src)
+{
+    (void)len; (void)p_data; (void)src;
+    return ls_err_none;
+}
+
+extern ls_err LsReadTransmitPowerLevel(int8 *p_level)
+{
+    *p_level = 0;
+    return ls_err_none;
+}
+
+extern void LsResetWhiteList(void)
+{
+}
+
+extern ls_err LsAddWhiteListDevice(TYPED_BD_ADDR_T *p_addr)
+{
+    (void)p_addr;
+    return ls_err_none;
+}
+
+/* GAP functions of the SDK */
+
+extern ls_err GapSetMode(gap_role role, gap_mode_discover discover,
+                         gap_mode_connect connect, gap_mode_bond bond,
+                         gap_mode_security security)
+{
+    (void)role; (void)discover; (void)connect; (void)bond; (void)security;
+    return ls_err_none;
+}
+
+extern ls_err GapSetAdvInterval(uint32 interval_min, uint32 interval_max)
+{
+    (void)interval_min;
+    (void)interval_max;
+    return ls_err_none;
+}
+
+/* Security manager functions of the SDK. The collector pairs when it has
+ * no bond with the application, otherwise it encrypts the link with the
+ * key of its bond.
+ */
+
+extern void SMInit(uint16 diversifier)
+{
+    (void)diversifier;
+}
+
+extern void SMRequestSecurityLevel(TYPED_BD_ADDR_T *p_addr)
+{
+    HOST_LINK_EVENT_T *p_event;
+
+    (void)p_addr;
+
+    if(!g_host_link.bonded)
+    {
+        pair();
+        return;
+    }
+
+    p_event = queueEvent(SM_DIV_APPROVE_IND);
+    p_event->data.div_approve_ind.cid = HOST_LINK_UCID;
+    p_event->data.div_approve_ind.div = g_host_link.div;
+}
+
+extern void SMDivApproval(uint16 cid, sm_div_verdict verdict)
+{
+    (void)cid;
+
+    if(verdict == SM_DIV_APPROVED)
+    {
+        queueEncryptionChange(HCI_SUCCESS);
+    }
+    else
+    {
+        /* The key of the collector is refused, it pairs again */
+        queueEncryptionChange(HOST_LINK_KEY_MISSING);
+        pair();
+    }
+}
+
+extern void SMPairingAuthRsp(void *data, bool accept)
+{
+    (void)data;
+    (void)accept;
+}
+
+extern int16 SMPrivacyMatchAddress(TYPED_BD_ADDR_T *p_addr, uint16 *p_irks,
+                                   uint16 num_irks, uint16 irk_size)
+{
+    (void)p_addr; (void)p_irks; (void)num_irks; (void)irk_size;
+    return -1;
+}
+
+/* Control of the link */
+
+extern void HostLinkInit(uint16 buffers, uint16 per_event, uint32 interval)
+{
+    bool connected = g_host_link.connected;
+    bool bonded = g_host_link.bonded;
+    uint16 div = g_host_link.div;
+
+    memset(&g_host_link, 0, sizeof(g_host_link));
+
+    g_host_link.buffers = buffers;
+    g_host_link.per_event = per_event;
+    g_host_link.interval = interval;
+    g_host_link.next_event = g_host_sdk.now + interval;
+
+    g_host_link.connected = connected;
+    g_host_link.bonded = bonded;
+    g_host_link.div = div;
+}
+
+extern void HostLinkPowerOn(bool erase)
+{
+    HOST_LINK_EVENT_T *p_event;
+
+    if(g_host_link.interval == 0)
+    {
+        HostLinkInit(HOST_LINK_DEFAULT_BUFFERS, HOST_LINK_DEFAULT_PER_EVENT,
+                     HOST_LINK_DEFAULT_INTERVAL);
+    }
+
+    if(erase)
+    {
+        memset(g_host_sdk.nvm, 0, sizeof(g_host_sdk.nvm));
+    }
+
+    /* The connection is lost with the power */
+    g_host_link.connected = FALSE;
+    g_host_link.queued = 0;
+    g_host_link.num_pending = 0;
+    g_host_link.radio_events = FALSE;
+    g_host_link.response_pos = 0;
+
+    AppPowerOnReset();
+    AppInit(0);
+    deliverPendingEvents();
+
+    /* A short button press starts advertising */
+    HandleShortButtonPress();
+
+    if(g_gs_data.state != app_fast_advertising)
+    {
+        fprintf(stderr, "The application does not advertise\n");
+        exit(2);
+    }
+
+    /* The collector connects and secures the link */
+    g_host_link.connected = TRUE;
+    g_host_link.next_event = g_host_sdk.now + g_host_link.interval;
+
+    p_event = queueEvent(LM_EV_CONNECTION_COMPLETE);
+    setConnectionData(&p_event->data.lm.connection_complete.data);
+
+    p_event = queueEvent(GATT_CONNECT_CFM);
+    p_event->data.connect_cfm.bd_addr = g_collector_addr;
+    p_event->data.connect_cfm.cid = HOST_LINK_UCID;
+    p_event->data.connect_cfm.result = sys_status_success;
+
+    deliverPendingEvents();
+
+    if(!AppIsLinkEncrypted())
+    {
+        fprintf(stderr, "The link is not encrypted\n");
+        exit(2);
+    }
+
+    /* Let the application settle */
+    HostLinkRun();
+}
+
+extern void HostLinkSubscribe(void)
+{
+    uint8 notify[2] = {gatt_client_config_notification, 0};
+    uint8 indicate[2] = {gatt_client_config_indication, 0};
+
+    HostLinkWrite(HANDLE_GLUCOSE_MEASUREMENT_CLIENT_CONFIG, notify, 2);
+    HostLinkWrite(HANDLE_GLUCOSE_MEASUREMENT_CONTEXT_CLIENT_CONFIG, notify, 2);
+    HostLinkWrite(HANDLE_RACP_CLIENT_CONFIG, indicate, 2);
+}
+
+extern void HostLinkWrite(uint16 handle, const uint8 *p_value, uint16 len)
+{
+    uint8 value[MAX_LEN_MEAS_FIELDS + 3];
+    GATT_ACCESS_IND_T ind;
+
+    memcpy(value, p_value, len);
+
+    ind.cid = HOST_LINK_UCID;
+    ind.handle = handle;
+    ind.flags = ATT_ACCESS_WRITE | ATT_ACCESS_PERMISSION |
+                ATT_ACCESS_WRITE_COMPLETE;
+    ind.offset = 0;
+    ind.size_value = len;
+    ind.value = value;
+
+    AppProcessLmEvent(GATT_ACCESS_IND, (LM_EVENT_T *)&ind);
+}
+
+extern void HostLinkRun(void)
+{
+    uint32 steps = 0;
+    uint32 expiry = 0;
+    bool timer;
+
+    for(;;)
+    {
+        if(++steps > HOST_LINK_MAX_STEPS)
+        {
+            fprintf(stderr, "The link does not become idle\n");
+            exit(2);
+        }
+
+        /* Connection events which have passed have sent nothing */
+        while((int32)(g_host_link.next_event - g_host_sdk.now) < 0)
+        {
+            g_host_link.next_event += g_host_link.interval;
+        }
+
+        if(g_host_link.num_pending)
+        {
+            deliverPendingEvents();
+            continue;
+        }
+
+        timer = HostNextTimerExpiry(&expiry);
+
+        if(g_host_link.queued && g_host_link.connected &&
+           (!timer || (int32)(g_host_link.next_event - expiry) <= 0))
+        {
+            runConnectionEvent();
+        }
+        else if(timer &&
+                (int32)(expiry - g_host_sdk.now) <= (int32)HOST_LINK_IDLE_TIME)
+        {
+            HostRunNextTimer();
+        }
+        else
+        {
+            break;
+        }
+    }
+}
+
+extern void HostLinkConfirmIndication(void)
+{
+    HOST_LINK_EVENT_T event;
+
+    memset(&event, 0, sizeof(event));
+    event.code = GATT_CHAR_VAL_IND_CFM;
+    event.data.val_cfm.cid = HOST_LINK_UCID;
+    event.data.val_cfm.handle = HANDLE_RECORD_ACCESS_CONTROL_POINT;
+    event.data.val_cfm.result = sys_status_success;
+
+    deliverEvent(&event);
+}
+
+extern void HostLinkClearReceived(void)
+{
+    g_host_link.num_meas = 0;
+    g_host_link.num_contexts = 0;
+    g_host_link.meas_len = 0;
+    g_host_link.context_len = 0;
+    g_host_link.response_len = 0;
+}
+
+extern void HostLinkRequest(const uint8 *p_request, uint16 len)
+{
+    HostLinkClearReceived();
+    HostLinkWrite(HANDLE_RECORD_ACCESS_CONTROL_POINT, p_request, len);
+    HostLinkRun();
+
+    if(g_host_link.response_len)
+    {
+        HostLinkConfirmIndication();
+    }
+}
+
+extern uint16 HostLinkNumOfRecords(void)
+{
+    if(g_host_link.response_len < 4 ||
+       g_host_link.response[0] != NUMBER_OF_STORED_RECORDS_RESPONSE)
+    {
+        return 0xFFFF;
+    }
+
+    return (uint16)(g_host_link.response[2] | (g_host_link.response[3] << 8));
+}
+
+extern uint8 HostLinkResponseValue(void)
+{
+    if(g_host_link.response_len < 4 ||
+       g_host_link.response[0] != RESPONSE_CODE)
+    {
+        return 0;
+    }
+
+    return g_host_link.response[3];
+}
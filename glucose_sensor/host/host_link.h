@@ -0,0 +1,208 @@
+/******************************************************************************
+ *  FILE
+ *      host_link.h
+ *
+ *  DESCRIPTION
+ *      Host emulation of the radio link between the glucose sensor
+ *      application and a collector: the firmware events which bring the
+ *      application up and connect it, the firmware buffers for
+ *      notifications, the connection events which empty them and the
+ *      collector receiving the values.
+ *
+ ******************************************************************************/
+
+#ifndef __HOST_LINK_H__
+#define __HOST_LINK_H__
+
+#include <types.h>
+
+#include "glucose_service.h"
+#include "glucose_sensor.h"
+
+/*============================================================================*
+ *  Public Definitions
+ *============================================================================*/
+
+/* Connection identifier of the emulated link */
+#define HOST_LINK_UCID                  (0x0040)
+
+/* Number of measurements the collector keeps the sequence number of */
+#define HOST_LINK_MAX_RECORDS           (0x200)
+
+/* Number of firmware events waiting to be delivered */
+#define HOST_LINK_MAX_EVENTS            (8)
+
+/* Diversifier the collector is given when it pairs */
+#define HOST_LINK_PAIRING_DIV           (0x1234)
+
+/* Time after which a timer is not run by HostLinkRun, once the link is idle.
+ * It is longer than the reply timer of the meter and its retries, and
+ * shorter than Tgap(conn_param_timeout) and the idle timeout.
+ */
+#define HOST_LINK_IDLE_TIME             (5 * SECOND)
+
+/* Default link: enough buffers never to fail a notification, four packets
+ * per connection event of 7.5 ms
+ */
+#define HOST_LINK_DEFAULT_BUFFERS       (0xFFFF)
+#define HOST_LINK_DEFAULT_PER_EVENT     (4)
+#define HOST_LINK_DEFAULT_INTERVAL      (7500)
+
+/*============================================================================*
+ *  Public Data Types
+ *============================================================================*/
+
+/* Firmware event delivered to AppProcessLmEvent */
+typedef struct
+{
+    lm_event_code                       code;
+
+    union
+    {
+        LM_EVENT_T                          lm;
+        GATT_ADD_DB_CFM_T                   add_db_cfm;
+        GATT_CONNECT_CFM_T                  connect_cfm;
+        GATT_ACCESS_IND_T                   access_ind;
+        GATT_CHAR_VAL_IND_CFM_T             val_cfm;
+        SM_DIV_APPROVE_IND_T                div_approve_ind;
+        SM_KEYS_IND_T                       keys_ind;
+        SM_SIMPLE_PAIRING_COMPLETE_IND_T    pairing_complete_ind;
+        LS_CONNECTION_PARAM_UPDATE_CFM_T    param_update_cfm;
+        LS_CONNECTION_PARAM_UPDATE_IND_T    param_update_ind;
+    } data;
+} HOST_LINK_EVENT_T;
+
+typedef struct
+{
+    /* Firmware buffers for notifications, packets sent per connection event
+     * and connection interval in microseconds
+     */
+    uint16                              buffers;
+    uint16                              per_event;
+    uint32                              interval;
+
+    /* Packets waiting in the firmware buffers */
+    uint16                              queued;
+
+    /* Whether radio Tx events are enabled */
+    bool                                radio_events;
+
+    /* Time of the next connection event */
+    uint32                              next_event;
+
+    /* Firmware events waiting to be delivered */
+    HOST_LINK_EVENT_T                   pending[HOST_LINK_MAX_EVENTS];
+    uint16                              num_pending;
+
+    /* Whether the collector is connected, and whether it keeps a bond with
+     * the application and the diversifier of that bond. They are kept by
+     * HostLinkInit.
+     */
+    bool                                connected;
+    bool                                bonded;
+    uint16                              div;
+
+    /* Connection parameter updates asked for by the application, the last
+     * parameters asked for, and whether the collector rejects them. The
+     * collector keeps the connection interval given to HostLinkInit, so
+     * that the timing of the link does not depend on the parameters.
+     */
+    uint16                              param_update_reqs;
+    ble_con_params                      params;
+    bool                                reject_param_updates;
+
+    /* Link statistics: connection events which sent data, packets sent and
+     * notifications refused for lack of buffers
+     */
+    uint32                              events;
+    uint32                              packets;
+    uint32                              failures;
+
+    /* Collector: sequence numbers of the measurements received, the number
+     * of contexts received and the last measurement and context
+     */
+    uint16                              seq_nums[HOST_LINK_MAX_RECORDS];
+    uint16                              num_meas;
+    uint16                              num_contexts;
+    uint8                               meas[MAX_LEN_MEAS_FIELDS];
+    uint16                              meas_len;
+    uint8                               context[MAX_LEN_CONTEXT_FIELDS];
+    uint16                              context_len;
+
+    /* Collector: last RACP indication, the number of indications, and the
+     * time the last one was received
+     */
+    uint8                               response[MAX_LEN_MEAS_FIELDS];
+    uint16                              response_len;
+    uint16                              indications;
+    uint32                              response_time;
+
+    /* Packets to be sent up to and including the last RACP indication, 0
+     * once it has been sent
+     */
+    uint16                              response_pos;
+
+    /* Result of the last access response */
+    uint16                              access_result;
+
+    /* Called after each connection event which sent data, to act on the
+     * service in the middle of a procedure, or NULL
+     */
+    void                                (*p_event_hook)(void);
+} HOST_LINK_T;
+
+/*============================================================================*
+ *  Public Data
+ *============================================================================*/
+
+extern HOST_LINK_T g_host_link;
+
+/*============================================================================*
+ *  Public Function Prototypes
+ *============================================================================*/
+
+/* Set up the link with the given firmware buffers, packets per connection
+ * event and connection interval in microseconds
+ */
+extern void HostLinkInit(uint16 buffers, uint16 per_event, uint32 interval);
+
+/* Power on the application, from erased NVM if 'erase' is TRUE, otherwise
+ * from the data it has left in NVM, and connect the collector to it
+ */
+extern void HostLinkPowerOn(bool erase);
+
+/* Enable the measurement and context notifications and the RACP
+ * indications
+ */
+extern void HostLinkSubscribe(void);
+
+/* Write a characteristic value */
+extern void HostLinkWrite(uint16 handle, const uint8 *p_value, uint16 len);
+
+/* Run the link until the application and the firmware are idle and no
+ * timer expires within HOST_LINK_IDLE_TIME
+ */
+extern void HostLinkRun(void);
+
+/* Confirm the last RACP indication */
+extern void HostLinkConfirmIndication(void);
+
+/* Forget the values received by the collector */
+extern void HostLinkClearReceived(void);
+
+/* Write an RACP request, run the link to the end of the procedure and
+ * confirm its response
+ */
+extern void HostLinkRequest(const uint8 *p_request, uint16 len);
+
+/* Number of records of the last Number Of Stored Records response, 0xFFFF
+ * if the last response was not one
+ */
+extern uint16 HostLinkNumOfRecords(void);
+
+/* Response value of the last Response Code indication, 0 if the last
+ * response was not one
+ */
+extern uint8 HostLinkResponseValue(void);
+
+#endif /* __HOST_LINK_H__ */
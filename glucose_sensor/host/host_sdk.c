@@ -0,0 +1,486 @@
+/******************************************************************************
+ *  FILE
+ *      host_sdk.c
+ *
+ *  DESCRIPTION
+ *      Host implementation of the SDK stand-in of sdk/host_sdk.h, apart from
+ *      GATT and the link supervisor which are emulated by host_link.c.
+ *      Time is a virtual clock in microseconds which only moves when the
+ *      host program advances it, timers are one shot and fire from
+ *      HostRunNextTimer, NVM is an array of words and the UART is fed by
+ *      HostUartReceive.
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_sdk.h"
+
+/*============================================================================*
+ *  Private Definitions
+ *============================================================================*/
+
+#define HOST_MAX_TIMERS                 (16)
+
+/*============================================================================*
+ *  Private Data Types
+ *============================================================================*/
+
+typedef struct
+{
+    timer_callback_arg                  handler;
+    uint32                              expiry;
+    bool                                active;
+} HOST_TIMER_T;
+
+/*============================================================================*
+ *  Public Data
+ *============================================================================*/
+
+HOST_SDK_DATA_T g_host_sdk;
+
+/*============================================================================*
+ *  Private Data
+ *============================================================================*/
+
+static HOST_TIMER_T g_host_timers[HOST_MAX_TIMERS];
+
+/*============================================================================*
+ *  Public Function Implementations
+ *============================================================================*/
+
+/* Virtual clock */
+
+extern uint16 TimeGet16(void)
+{
+    return (uint16)g_host_sdk.now;
+}
+
+extern uint32 TimeGet32(void)
+{
+    return g_host_sdk.now;
+}
+
+extern void TimeDelayUSec(uint16 delay)
+{
+    g_host_sdk.now += delay;
+}
+
+/* Timers */
+
+extern void TimerInit(uint16 num_timers, void *p_timers)
+{
+    (void)num_timers;
+    (void)p_timers;
+    memset(g_host_timers, 0, sizeof(g_host_timers));
+}
+
+extern timer_id TimerCreate(uint32 delay, bool repeat,
+                            timer_callback_arg handler)
+{
+    uint16 tid;
+
+    (void)repeat;
+
+    for(tid = 0; tid < HOST_MAX_TIMERS; tid++)
+    {
+        if(!g_host_timers[tid].active)
+        {
+            g_host_timers[tid].handler = handler;
+            g_host_timers[tid].expiry = g_host_sdk.now + delay;
+            g_host_timers[tid].active = TRUE;
+            return tid;
+        }
+    }
+
+    return TIMER_INVALID;
+}
+
+extern bool TimerDelete(timer_id tid)
+{
+    if(tid < HOST_MAX_TIMERS && g_host_timers[tid].active)
+    {
+        g_host_timers[tid].active = FALSE;
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      HostNextTimerExpiry
+ *
+ *  DESCRIPTION
+ *      This function looks for the timer which expires first.
+ *
+ *  RETURNS/MODIFIES
+ *      FALSE if no timer is running, otherwise TRUE with its expiry time
+ *      in 'p_expiry'.
+ *
+ *----------------------------------------------------------------------------*/
+extern bool HostNextTimerExpiry(uint32 *p_expiry)
+{
+    bool found = FALSE;
+    uint16 tid;
+
+    for(tid = 0; tid < HOST_MAX_TIMERS; tid++)
+    {
+        if(g_host_timers[tid].active &&
+           (!found ||
+            (int32)(g_host_timers[tid].expiry - *p_expiry) < 0))
+        {
+            *p_expiry = g_host_timers[tid].expiry;
+            found = TRUE;
+        }
+    }
+
+    return found;
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      HostRunNextTimer
+ *
+ *  DESCRIPTION
+ *      This function advances the clock to the timer which expires first,
+ *      if it is not already past it, and calls its handler.
+ *
+ *  RETURNS/MODIFIES
+ *      FALSE if no timer is running.
+ *
+ *----------------------------------------------------------------------------*/
+extern bool HostRunNextTimer(void)
+{
+    uint32 expiry = 0;
+    uint16 tid;
+
+    if(!HostNextTimerExpiry(&expiry))
+    {
+        return FALSE;
+    }
+
+    for(tid = 0; tid < HOST_MAX_TIMERS; tid++)
+    {
+        if(g_host_timers[tid].active && g_host_timers[tid].expiry == expiry)
+        {
+            break;
+        }
+    }
+
+    if((int32)(expiry - g_host_sdk.now) > 0)
+    {
+        g_host_sdk.now = expiry;
+    }
+
+    g_host_timers[tid].active = FALSE;
+    g_host_timers[tid].handler(tid);
+
+    return TRUE;
+}
+
+/* Memory and buffers */
+
+extern void HostMemCopy(void *dst, const void *src, uint32 octets)
+{
+    memmove(dst, src, octets);
+}
+
+extern void HostMemSet(void *dst, uint16 val, uint16 len, uint16 unit)
+{
+    uint8 *p_dst = (uint8 *)dst;
+
+    /* Words are filled with the whole value, octets with its low octet */
+    while(len--)
+    {
+        *p_dst++ = (uint8)val;
+
+        if(unit == 2)
+        {
+            *p_dst++ = (uint8)(val >> 8);
+        }
+    }
+}
+
+extern uint8 BufReadUint8(uint8 **p_buf)
+{
+    return *(*p_buf)++;
+}
+
+extern uint16 BufReadUint16(uint8 **p_buf)
+{
+    uint16 val = (uint16)((*p_buf)[0] | ((*p_buf)[1] << 8));
+
+    *p_buf += 2;
+    return val;
+}
+
+extern void BufWriteUint8(uint8 **p_buf, uint8 val)
+{
+    *(*p_buf)++ = val;
+}
+
+extern void BufWriteUint16(uint8 **p_buf, uint16 val)
+{
+    *(*p_buf)++ = (uint8)val;
+    *(*p_buf)++ = (uint8)(val >> 8);
+}
+
+/* NVM, PIO and CS keys */
+
+extern sys_status NvmRead(uint16 *buffer, uint16 length, uint16 offset)
+{
+    if((uint32)offset + length > HOST_NVM_WORDS)
+    {
+        Panic(0xFFFF);
+    }
+
+    memcpy(buffer, &g_host_sdk.nvm[offset], length * sizeof(uint16));
+    g_host_sdk.nvm_reads++;
+    return sys_status_success;
+}
+
+extern sys_status NvmWrite(uint16 *buffer, uint16 length, uint16 offset)
+{
+    if((uint32)offset + length > HOST_NVM_WORDS)
+    {
+        Panic(0xFFFF);
+    }
+
+    if(g_host_sdk.nvm_power_loss)
+    {
+        if(!g_host_sdk.nvm_writes_left)
+        {
+            return sys_status_success;
+        }
+
+        g_host_sdk.nvm_writes_left--;
+    }
+
+    memcpy(&g_host_sdk.nvm[offset], buffer, length * sizeof(uint16));
+    g_host_sdk.nvm_writes++;
+    return sys_status_success;
+}
+
+extern void NvmDisable(void)
+{
+    g_host_sdk.nvm_disables++;
+}
+
+extern void NvmConfigureI2cEeprom(void)
+{
+}
+
+extern void PioSetI2CPullMode(pio_i2c_pull_mode mode)
+{
+    (void)mode;
+}
+
+extern uint16 CSReadUserKey(uint16 index)
+{
+    (void)index;
+    return 0;
+}
+
+/* Panic */
+
+extern void Panic(uint16 code)
+{
+    fprintf(stderr, "Panic 0x%04x\n", code);
+    exit(2);
+}
+
+/* UART: octets are received from the host program by HostUartReceive and
+ * those sent are recorded
+ */
+
+extern void UartInit(uart_data_in_fn rx_fn, uart_data_out_fn tx_fn,
+                     uint16 *rx_buffer, uint16 rx_size,
+                     uint16 *tx_buffer, uint16 tx_size,
+                     uart_data_mode mode)
+{
+    (void)tx_fn; (void)rx_buffer; (void)rx_size;
+    (void)tx_buffer; (void)tx_size; (void)mode;
+
+    g_host_sdk.uart_rx_fn = rx_fn;
+    g_host_sdk.uart_rx_len = 0;
+    g_host_sdk.uart_rx_needed = 1;
+}
+
+extern void UartConfig(uint16 baud_rate, uint16 flags)
+{
+    (void)baud_rate;
+    (void)flags;
+}
+
+extern void UartEnable(bool enable)
+{
+    (void)enable;
+}
+
+extern void UartRead(uint16 bytes, uint16 flags)
+{
+    (void)flags;
+
+    g_host_sdk.uart_rx_needed = bytes;
+}
+
+extern bool UartWrite(const uint8 *p_data, uint16 size)
+{
+    /* Octets are sent straight away, those which do not fit in the record
+     * are not kept
+     */
+    if(size > HOST_UART_TX_BYTES - g_host_sdk.uart_tx_len)
+    {
+        size = HOST_UART_TX_BYTES - g_host_sdk.uart_tx_len;
+    }
+
+    memcpy(&g_host_sdk.uart_tx[g_host_sdk.uart_tx_len], p_data, size);
+    g_host_sdk.uart_tx_len += size;
+    return TRUE;
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      HostUartReceive
+ *
+ *  DESCRIPTION
+ *      This function receives octets on the UART. As the UART driver does,
+ *      the application is called with all the octets received once there
+ *      are as many as it has asked for, and is told how many it has taken
+ *      and how many it needs next.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+extern void HostUartReceive(const uint8 *p_data, uint16 len)
+{
+    uint16 used;
+    uint16 needed;
+
+    while(len)
+    {
+        used = HOST_UART_RX_BYTES - g_host_sdk.uart_rx_len;
+
+        if(used == 0)
+        {
+            fprintf(stderr, "UART receive buffer overflow\n");
+            exit(2);
+        }
+
+        if(used > len)
+        {
+            used = len;
+        }
+
+        memcpy(&g_host_sdk.uart_rx[g_host_sdk.uart_rx_len], p_data, used);
+        g_host_sdk.uart_rx_len += used;
+        p_data += used;
+        len -= used;
+
+        while(g_host_sdk.uart_rx_fn && g_host_sdk.uart_rx_len &&
+              g_host_sdk.uart_rx_len >= g_host_sdk.uart_rx_needed)
+        {
+            needed = 0;
+            used = g_host_sdk.uart_rx_fn(g_host_sdk.uart_rx,
+                                         g_host_sdk.uart_rx_len, &needed);
+
+            g_host_sdk.uart_rx_len -= used;
+            memmove(g_host_sdk.uart_rx, &g_host_sdk.uart_rx[used],
+                    g_host_sdk.uart_rx_len);
+            g_host_sdk.uart_rx_needed = needed ? needed : 1;
+
+            if(used == 0)
+            {
+                break;
+            }
+        }
+    }
+}
+
+/* PIOs, battery and sleep */
+
+extern void PioSetModes(uint32 mask, pio_mode mode)
+{
+    (void)mask;
+    (void)mode;
+}
+
+extern void PioSetPullModes(uint32 mask, pio_pull_mode mode)
+{
+    (void)mask;
+    (void)mode;
+}
+
+extern void PioSetEventMask(uint32 mask, pio_event_mode mode)
+{
+    (void)mask;
+    (void)mode;
+}
+
+extern void PioSetDir(uint16 pio, bool output)
+{
+    (void)pio;
+    (void)output;
+}
+
+extern void PioSet(uint16 pio, bool value)
+{
+    if(value)
+    {
+        g_host_sdk.pios |= 1UL << pio;
+    }
+    else
+    {
+        g_host_sdk.pios &= ~(1UL << pio);
+    }
+}
+
+extern uint32 PioGets(void)
+{
+    return g_host_sdk.pios;
+}
+
+extern bool PioConfigPWM(uint16 index, pio_pwm_mode mode,
+                         uint8 dull_on_time, uint8 dull_off_time,
+                         uint8 dull_hold_time, uint8 bright_on_time,
+                         uint8 bright_off_time, uint8 bright_hold_time,
+                         uint8 ramp_rate)
+{
+    (void)index; (void)mode; (void)dull_on_time; (void)dull_off_time;
+    (void)dull_hold_time; (void)bright_on_time; (void)bright_off_time;
+    (void)bright_hold_time; (void)ramp_rate;
+    return TRUE;
+}
+
+extern void PioEnablePWM(uint16 index, bool enable)
+{
+    (void)index;
+    (void)enable;
+}
+
+extern uint16 BatteryReadVoltage(void)
+{
+    return g_host_sdk.battery_mv;
+}
+
+extern bool CSReadBdaddr(BD_ADDR_T *p_addr)
+{
+    memset(p_addr, 0, sizeof(*p_addr));
+    return TRUE;
+}
+
+extern void SleepWakeOnUartRX(bool enable)
+{
+    (void)enable;
+}
+
+/* Strings */
+
+extern uint16 StrLen(const char *string)
+{
+    return (uint16)strlen(string);
+}
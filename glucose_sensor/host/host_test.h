@@ -0,0 +1,37 @@
+/******************************************************************************
+ *  FILE
+ *      host_test.h
+ *
+ *  DESCRIPTION
+ *      Checks of the host test programs. A failed check is reported with
+ *      its location and the program carries on, returning the number of
+ *      failed checks from main through HOST_TEST_RESULT.
+ *
+ ******************************************************************************/
+
+#ifndef __HOST_TEST_H__
+#define __HOST_TEST_H__
+
+#include <stdio.h>
+
+static unsigned int g_host_test_checks;
+static unsigned int g_host_test_failures;
+
+#define CHECK(cond)                                                         \
+    do                                                                      \
+    {                                                                       \
+        g_host_test_checks++;                                               \
+        if(!(cond))                                                         \
+        {                                                                   \
+            fprintf(stderr, "%s:%d: check failed: %s\n",                    \
+                    __FILE__, __LINE__, #cond);                             \
+            g_host_test_failures++;                                         \
+        }                                                                   \
+    } while(0)
+
+#define HOST_TEST_RESULT(name)                                              \
+    (printf("%s: %u checks, %u failed\n", (name),                           \
+            g_host_test_checks, g_host_test_failures),                      \
+     g_host_test_failures != 0)
+
+#endif /* __HOST_TEST_H__ */
@@ -0,0 +1,2 @@
+/* Host stand-in for the SDK header bt_event_types.h, see host_sdk.h */
+#include "host_sdk.h"
@@ -0,0 +1,2 @@
+/* Host stand-in for the SDK header config_store.h, see host_sdk.h */
+#include "host_sdk.h"
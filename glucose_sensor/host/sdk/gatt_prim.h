@@ -0,0 +1,2 @@
+/* Host stand-in for the SDK header gatt_prim.h, see host_sdk.h */
+#include "host_sdk.h"
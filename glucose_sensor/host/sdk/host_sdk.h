@@ -0,0 +1,560 @@
+/******************************************************************************
+ *  FILE
+ *      host_sdk.h
+ *
+ *  DESCRIPTION
+ *      Stand-in for the parts of the CSR uEnergy SDK used by the protocol
+ *      independent sources of the glucose sensor, so that they can be built
+ *      and tested on the host. Every SDK header included by those sources
+ *      is a one line header of this directory including this file.
+ *
+ *      The XAP addresses 16-bit words. A uint8 takes a whole word there and
+ *      the lengths given to MemCopy, MemSet, NvmRead and NvmWrite are in
+ *      words. On the host a uint8 takes an octet, so MemCopy and MemSet
+ *      scale the length by the size of the element pointed to, and the
+ *      word sizes of nvm_access.h are defined here for octets.
+ *
+ ******************************************************************************/
+
+#ifndef __HOST_SDK_H__
+#define __HOST_SDK_H__
+
+#include <stdint.h>
+
+/*============================================================================*
+ *  Types (types.h, status.h)
+ *============================================================================*/
+
+typedef uint8_t                         uint8;
+typedef uint16_t                        uint16;
+typedef uint32_t                        uint32;
+typedef int8_t                          int8;
+typedef int16_t                         int16;
+typedef int32_t                         int32;
+typedef uint16                          bool;
+
+#define TRUE                            (1)
+#define FALSE                           (0)
+
+#ifndef NULL
+#define NULL                            ((void *)0)
+#endif
+
+typedef enum
+{
+    sys_status_success = 0,
+    sys_status_failed = 1
+} sys_status;
+
+/* Words taken by 'x' and by an array of 'n' uint8, see nvm_access.h */
+#define SIZEOF_WORDS(x)                 ((uint16)((sizeof(x) + 1) / 2))
+#define UINT8_ARRAY_WORDS(n)            ((uint16)(((n) + 1) / 2))
+
+/*============================================================================*
+ *  Time and timers (time.h, timer.h)
+ *============================================================================*/
+
+#define MILLISECOND                     ((uint32)1000)
+#define SECOND                          ((uint32)1000 * MILLISECOND)
+#define MINUTE                          ((uint32)60 * SECOND)
+
+#define SIZEOF_APP_TIMER                (4)
+#define TIMER_INVALID                   ((timer_id)0xFFFF)
+
+typedef uint16 timer_id;
+typedef void (*timer_callback_arg)(timer_id tid);
+
+extern uint16 TimeGet16(void);
+extern uint32 TimeGet32(void);
+extern void TimeDelayUSec(uint16 delay);
+
+extern void TimerInit(uint16 num_timers, void *p_timers);
+extern timer_id TimerCreate(uint32 delay, bool repeat,
+                            timer_callback_arg handler);
+extern bool TimerDelete(timer_id tid);
+
+/*============================================================================*
+ *  Memory and buffers (mem.h, buf_utils.h)
+ *============================================================================*/
+
+/* Size in octets of the unit of length of MemCopy and MemSet for the
+ * destination 'p': one for octet data, a word otherwise
+ */
+#define HOST_MEM_UNIT(p)                _Generic((p),                       \
+                                                 uint8 *: 1,                \
+                                                 const uint8 *: 1,          \
+                                                 default: 2)
+
+#define MemCopy(dst, src, len)          \
+                HostMemCopy((dst), (src), (len) * HOST_MEM_UNIT(dst))
+#define MemSet(dst, val, len)           \
+                HostMemSet((dst), (val), (len), HOST_MEM_UNIT(dst))
+
+extern void HostMemCopy(void *dst, const void *src, uint32 octets);
+extern uint16 StrLen(const char *string);
+extern void HostMemSet(void *dst, uint16 val, uint16 len, uint16 unit);
+
+extern uint8 BufReadUint8(uint8 **p_buf);
+extern uint16 BufReadUint16(uint8 **p_buf);
+extern void BufWriteUint8(uint8 **p_buf, uint8 val);
+extern void BufWriteUint16(uint8 **p_buf, uint16 val);
+
+/*============================================================================*
+ *  Bluetooth addresses and HCI (bluetooth.h, bt_event_types.h)
+ *============================================================================*/
+
+typedef struct
+{
+    uint32                              lap;
+    uint8                               uap;
+    uint16                              nap;
+} BD_ADDR_T;
+
+typedef struct
+{
+    uint16                              type;
+    BD_ADDR_T                           addr;
+} TYPED_BD_ADDR_T;
+
+#define L2CA_PUBLIC_ADDR_TYPE           (0x00)
+#define L2CA_RANDOM_ADDR_TYPE           (0x01)
+
+#define BD_ADDR_NAP_RANDOM_TYPE_MASK    (0xC000)
+#define BD_ADDR_NAP_RANDOM_TYPE_RESOLVABLE (0x4000)
+
+#define HCI_SUCCESS                     (0x00)
+#define HCI_ERROR_CONN_TIMEOUT          (0x08)
+#define HCI_ERROR_OETC_USER             (0x13)
+#define HCI_ERROR_CONN_TERM_LOCAL_HOST  (0x16)
+
+/*============================================================================*
+ *  GATT (gatt.h, gatt_prim.h, gatt_uuid.h)
+ *============================================================================*/
+
+#define gatt_status_app_mask            (0x80)
+#define gatt_status_read_not_permitted  (0x02)
+#define gatt_status_write_not_permitted (0x03)
+#define gatt_status_unlikely_error      (0x0e)
+
+#define ATT_ACCESS_READ                 (0x0001)
+#define ATT_ACCESS_WRITE                (0x0002)
+#define ATT_ACCESS_PERMISSION           (0x8000)
+#define ATT_ACCESS_WRITE_COMPLETE       (0x4000)
+
+#define L2CAP_CONNECTION_SLAVE_UNDIRECTED (0x1000)
+#define L2CAP_CONNECTION_SLAVE_WHITELIST  (0x2000)
+#define L2CAP_OWN_ADDR_TYPE_PUBLIC      (0x0000)
+#define L2CAP_PEER_ADDR_TYPE_PUBLIC     (0x0000)
+
+typedef struct
+{
+    uint16                              cid;
+    uint16                              handle;
+    uint16                              flags;
+    uint16                              offset;
+    uint16                              size_value;
+    uint8                               *value;
+} GATT_ACCESS_IND_T;
+
+typedef struct
+{
+    uint16                              cid;
+    uint16                              handle;
+    sys_status                          result;
+} GATT_CHAR_VAL_IND_CFM_T;
+
+typedef struct
+{
+    sys_status                          result;
+} GATT_ADD_DB_CFM_T;
+
+typedef struct
+{
+    TYPED_BD_ADDR_T                     bd_addr;
+    uint16                              cid;
+    sys_status                          result;
+} GATT_CONNECT_CFM_T;
+
+extern void GattInit(void);
+extern void GattInstallServerWrite(void);
+extern void GattAddDatabaseReq(uint16 length, uint16 *p_database);
+extern void GattConnectReq(TYPED_BD_ADDR_T *p_addr, uint16 flags);
+extern void GattCancelConnectReq(void);
+extern void GattDisconnectReq(uint16 ucid);
+extern void GattCharValueNotification(uint16 ucid, uint16 handle,
+                                      uint16 size, const uint8 *value);
+extern void GattCharValueIndication(uint16 ucid, uint16 handle,
+                                    uint16 size, const uint8 *value);
+extern void GattAccessRsp(uint16 ucid, uint16 handle, uint16 result,
+                          uint16 size, const uint8 *value);
+
+/*============================================================================*
+ *  Link supervisor (ls_app_if.h, bluetooth.h, bt_event_types.h)
+ *============================================================================*/
+
+typedef enum
+{
+    ls_err_none = 0,
+    ls_err_arg,
+    ls_err_failed
+} ls_err;
+
+typedef enum
+{
+    radio_event_none = 0,
+    radio_event_tx_data
+} radio_event;
+
+typedef struct
+{
+    uint16                              con_max_interval;
+    uint16                              con_min_interval;
+    uint16                              con_slave_latency;
+    uint16                              con_super_timeout;
+} ble_con_params;
+
+typedef enum
+{
+    ad_src_advertise = 0,
+    ad_src_scan_rsp
+} ad_src;
+
+#define AD_TYPE_SERVICE_UUID_16BIT_LIST (0x03)
+#define AD_TYPE_LOCAL_NAME_SHORT        (0x08)
+#define AD_TYPE_LOCAL_NAME_COMPLETE     (0x09)
+#define AD_TYPE_TX_POWER                (0x0A)
+#define AD_TYPE_APPEARANCE              (0x19)
+
+extern void LsRadioEventNotification(uint16 ucid, radio_event event);
+extern ls_err LsConnectionParamUpdateReq(TYPED_BD_ADDR_T *p_addr,
+                                         ble_con_params *p_params);
+extern ls_err LsStoreAdvScanData(uint16 len, uint8 *p_data, ad_src src);
+extern ls_err LsReadTransmitPowerLevel(int8 *p_level);
+extern void LsResetWhiteList(void);
+extern ls_err LsAddWhiteListDevice(TYPED_BD_ADDR_T *p_addr);
+
+/*============================================================================*
+ *  GAP (gap_app_if.h)
+ *============================================================================*/
+
+typedef enum { gap_role_peripheral = 0 } gap_role;
+typedef enum { gap_mode_discover_limited = 0 } gap_mode_discover;
+typedef uint16 gap_mode_connect;
+#define gap_mode_connect_no             (0)
+#define gap_mode_connect_undirected     (1)
+typedef enum { gap_mode_bond_yes = 0 } gap_mode_bond;
+typedef enum { gap_mode_security_unauthenticate = 0 } gap_mode_security;
+
+extern ls_err GapSetMode(gap_role role, gap_mode_discover discover,
+                         gap_mode_connect connect, gap_mode_bond bond,
+                         gap_mode_security security);
+extern ls_err GapSetAdvInterval(uint32 interval_min, uint32 interval_max);
+
+/*============================================================================*
+ *  Security manager (security.h)
+ *============================================================================*/
+
+typedef enum
+{
+    SM_DIV_REVOKED = 0,
+    SM_DIV_APPROVED
+} sm_div_verdict;
+
+#define sm_status_repeated_attempts     (0x0109)
+
+typedef struct
+{
+    uint16                              div;
+    uint16                              irk[8];
+} SM_KEYSET_T;
+
+typedef struct
+{
+    uint16                              cid;
+    uint16                              div;
+} SM_DIV_APPROVE_IND_T;
+
+typedef struct
+{
+    uint16                              cid;
+    SM_KEYSET_T                         *keys;
+} SM_KEYS_IND_T;
+
+typedef struct
+{
+    void                                *data;
+} SM_PAIRING_AUTH_IND_T;
+
+typedef struct
+{
+    TYPED_BD_ADDR_T                     bd_addr;
+    uint16                              status;
+} SM_SIMPLE_PAIRING_COMPLETE_IND_T;
+
+extern void SMInit(uint16 diversifier);
+extern void SMRequestSecurityLevel(TYPED_BD_ADDR_T *p_addr);
+extern void SMDivApproval(uint16 cid, sm_div_verdict verdict);
+extern void SMPairingAuthRsp(void *data, bool accept);
+extern int16 SMPrivacyMatchAddress(TYPED_BD_ADDR_T *p_addr, uint16 *p_irks,
+                                   uint16 num_irks, uint16 irk_size);
+
+/*============================================================================*
+ *  Link manager events (main.h, bt_event_types.h, ls_app_if.h)
+ *============================================================================*/
+
+typedef enum
+{
+    GATT_ADD_DB_CFM = 0x0100,
+    GATT_CONNECT_CFM,
+    GATT_CANCEL_CONNECT_CFM,
+    GATT_ACCESS_IND,
+    GATT_DISCONNECT_IND,
+    GATT_DISCONNECT_CFM,
+    GATT_CHAR_VAL_NOT_CFM,
+    GATT_CHAR_VAL_IND_CFM,
+    LM_EV_CONNECTION_COMPLETE = 0x0200,
+    LM_EV_DISCONNECT_COMPLETE,
+    LM_EV_ENCRYPTION_CHANGE,
+    LM_EV_CONNECTION_UPDATE,
+    LM_EV_NUMBER_COMPLETED_PACKETS,
+    SM_DIV_APPROVE_IND = 0x0300,
+    SM_KEYS_IND,
+    SM_PAIRING_AUTH_IND,
+    SM_SIMPLE_PAIRING_COMPLETE_IND,
+    LS_CONNECTION_PARAM_UPDATE_CFM = 0x0400,
+    LS_CONNECTION_PARAM_UPDATE_IND,
+    LS_RADIO_EVENT_IND
+} lm_event_code;
+
+typedef struct
+{
+    uint16                              status;
+    uint16                              conn_interval;
+    uint16                              conn_latency;
+    uint16                              supervision_timeout;
+} HCI_EV_DATA_ULP_CONNECTION_T;
+
+typedef struct
+{
+    uint16                              status;
+    uint16                              reason;
+} HCI_EV_DATA_DISCONNECT_COMPLETE_T;
+
+typedef struct
+{
+    uint16                              status;
+    bool                                enc_enable;
+} HCI_EV_DATA_ENCRYPTION_CHANGE_T;
+
+typedef struct
+{
+    HCI_EV_DATA_ULP_CONNECTION_T        data;
+} LM_EV_CONNECTION_COMPLETE_T;
+
+typedef struct
+{
+    HCI_EV_DATA_ULP_CONNECTION_T        data;
+} LM_EV_CONNECTION_UPDATE_T;
+
+typedef struct
+{
+    HCI_EV_DATA_DISCONNECT_COMPLETE_T   data;
+} LM_EV_DISCONNECT_COMPLETE_T;
+
+typedef struct
+{
+    HCI_EV_DATA_ENCRYPTION_CHANGE_T     data;
+} LM_EV_ENCRYPTION_CHANGE_T;
+
+typedef struct
+{
+    ls_err                              status;
+} LS_CONNECTION_PARAM_UPDATE_CFM_T;
+
+typedef struct
+{
+    ls_err                              status;
+} LS_CONNECTION_PARAM_UPDATE_IND_T;
+
+typedef union
+{
+    LM_EV_CONNECTION_COMPLETE_T         connection_complete;
+    LM_EV_CONNECTION_UPDATE_T           connection_update;
+    LM_EV_DISCONNECT_COMPLETE_T         disconnect_complete;
+    LM_EV_ENCRYPTION_CHANGE_T           enc_change;
+} LM_EVENT_T;
+
+/*============================================================================*
+ *  NVM, PIO, battery and CS keys (nvm.h, i2c.h, pio.h, pio_ctrlr.h,
+ *  battery.h, config_store.h)
+ *============================================================================*/
+
+#define PIO_DIRECTION_INPUT             (FALSE)
+#define PIO_DIRECTION_OUTPUT            (TRUE)
+
+typedef enum
+{
+    pio_mode_user = 0,
+    pio_mode_pwm0,
+    pio_mode_pwm1
+} pio_mode;
+
+typedef enum
+{
+    pio_mode_strong_pull_up = 0
+} pio_pull_mode;
+
+typedef enum
+{
+    pio_event_mode_both = 0
+} pio_event_mode;
+
+typedef enum
+{
+    pio_pwm_mode_push_pull = 0
+} pio_pwm_mode;
+
+typedef enum
+{
+    pio_i2c_pull_mode_strong_pull_down = 0
+} pio_i2c_pull_mode;
+
+extern sys_status NvmRead(uint16 *buffer, uint16 length, uint16 offset);
+extern sys_status NvmWrite(uint16 *buffer, uint16 length, uint16 offset);
+extern void NvmDisable(void);
+extern void NvmConfigureI2cEeprom(void);
+extern void PioSetI2CPullMode(pio_i2c_pull_mode mode);
+extern void PioSetModes(uint32 mask, pio_mode mode);
+extern void PioSetPullModes(uint32 mask, pio_pull_mode mode);
+extern void PioSetEventMask(uint32 mask, pio_event_mode mode);
+extern void PioSetDir(uint16 pio, bool output);
+extern void PioSet(uint16 pio, bool value);
+extern uint32 PioGets(void);
+extern bool PioConfigPWM(uint16 index, pio_pwm_mode mode,
+                         uint8 dull_on_time, uint8 dull_off_time,
+                         uint8 dull_hold_time, uint8 bright_on_time,
+                         uint8 bright_off_time, uint8 bright_hold_time,
+                         uint8 ramp_rate);
+extern void PioEnablePWM(uint16 index, bool enable);
+extern uint16 BatteryReadVoltage(void);
+extern uint16 CSReadUserKey(uint16 index);
+extern bool CSReadBdaddr(BD_ADDR_T *p_addr);
+
+/*============================================================================*
+ *  System events, sleep and panic (sys_events.h, sleep.h, panic.h)
+ *============================================================================*/
+
+typedef enum
+{
+    sys_event_battery_low = 0,
+    sys_event_pio_changed
+} sys_event_id;
+
+typedef struct
+{
+    uint32                              pio_cause;
+    uint32                              pio_state;
+} pio_changed_data;
+
+typedef uint16 sleep_state;
+
+extern void SleepWakeOnUartRX(bool enable);
+extern void Panic(uint16 code);
+
+/*============================================================================*
+ *  UART (uart.h)
+ *============================================================================*/
+
+#define UART_BUF_SIZE_BYTES_32          (32)
+#define UART_BUF_SIZE_BYTES_64          (64)
+#define UART_BUF_SIZE_BYTES_128         (128)
+
+#define UART_DECLARE_BUFFER(name, size) uint16 name[(size) / 2]
+
+typedef enum
+{
+    uart_data_unpacked = 0,
+    uart_data_packed
+} uart_data_mode;
+
+typedef uint16 (*uart_data_in_fn)(void *p_data, uint16 data_count,
+                                  uint16 *p_req_data_count);
+typedef void (*uart_data_out_fn)(void);
+
+extern void UartInit(uart_data_in_fn rx_fn, uart_data_out_fn tx_fn,
+                     uint16 *rx_buffer, uint16 rx_size,
+                     uint16 *tx_buffer, uint16 tx_size,
+                     uart_data_mode mode);
+extern void UartConfig(uint16 baud_rate, uint16 flags);
+extern void UartEnable(bool enable);
+extern void UartRead(uint16 bytes, uint16 flags);
+extern bool UartWrite(const uint8 *p_data, uint16 size);
+
+#define DebugWriteString(s)
+
+/*============================================================================*
+ *  Application entry points called by the firmware (main.h)
+ *============================================================================*/
+
+extern void AppPowerOnReset(void);
+extern void AppInit(sleep_state last_sleep_state);
+extern void AppProcessSystemEvent(sys_event_id id, void *data);
+extern bool AppProcessLmEvent(lm_event_code event_code,
+                              LM_EVENT_T *p_event_data);
+
+/*============================================================================*
+ *  Host control of the stand-in, not part of the SDK
+ *============================================================================*/
+
+/* Words of NVM */
+#define HOST_NVM_WORDS                  (4096)
+
+/* Octets of the UART receive buffer and of the record of those sent */
+#define HOST_UART_RX_BYTES              (UART_BUF_SIZE_BYTES_64)
+#define HOST_UART_TX_BYTES              (1024)
+
+typedef struct
+{
+    /* Virtual clock in microseconds */
+    uint32                              now;
+
+    /* NVM contents and access counts */
+    uint16                              nvm[HOST_NVM_WORDS];
+    uint32                              nvm_reads;
+    uint32                              nvm_writes;
+    uint32                              nvm_disables;
+
+    /* Power loss: when set, only 'nvm_writes_left' more writes reach the
+     * NVM and the later ones are lost
+     */
+    bool                                nvm_power_loss;
+    uint32                              nvm_writes_left;
+
+    /* UART: the octets received and not yet taken by the application, the
+     * number it waits for before it is called, and the first octets it has
+     * sent since 'uart_tx_len' was cleared
+     */
+    uart_data_in_fn                     uart_rx_fn;
+    uint8                               uart_rx[HOST_UART_RX_BYTES];
+    uint16                              uart_rx_len;
+    uint16                              uart_rx_needed;
+    uint8                               uart_tx[HOST_UART_TX_BYTES];
+    uint16                              uart_tx_len;
+
+    /* Battery voltage in mV and the state of the PIOs */
+    uint16                              battery_mv;
+    uint32                              pios;
+} HOST_SDK_DATA_T;
+
+extern HOST_SDK_DATA_T g_host_sdk;
+
+/* Look for the timer which expires first */
+extern bool HostNextTimerExpiry(uint32 *p_expiry);
+
+/* Advance the clock to the timer which expires first and fire it */
+extern bool HostRunNextTimer(void);
+
+/* Receive octets on the UART, calling the application as they arrive */
+extern void HostUartReceive(const uint8 *p_data, uint16 len);
+
+#endif /* __HOST_SDK_H__ */
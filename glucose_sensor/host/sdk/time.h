@@ -0,0 +1,5 @@
+/* Host stand-in for the SDK header time.h, see host_sdk.h. The C library
+ * header of the same name is included as well for the host programs.
+ */
+#include_next <time.h>
+#include "host_sdk.h"
@@ -0,0 +1,159 @@
+/******************************************************************************
+ *  FILE
+ *      test_crc.c
+ *
+ *  DESCRIPTION
+ *      Host test of the table driven CRC-CCITT of Calc_CRC.c, with the 256
+ *      and the 16 entry tables, against the bitwise calculation it
+ *      replaced: whole buffers, buffers received in parts and byte by
+ *      byte updates.
+ *
+ ******************************************************************************/
+
+#include "crc_ref.h"
+#include "host_test.h"
+
+/*============================================================================*
+ *  Private Definitions
+ *============================================================================*/
+
+/* Longest buffer of the test, longer than any meter frame */
+#define TEST_MAX_LEN                    (300)
+
+/* Buffers of each length */
+#define TEST_BUFFERS_PER_LEN            (8)
+
+/*============================================================================*
+ *  Private Data
+ *============================================================================*/
+
+static uint32 g_random = 12345;
+
+/*============================================================================*
+ *  Private Function Implementations
+ *============================================================================*/
+
+static uint8 randomOctet(void)
+{
+    g_random = g_random * 1103515245UL + 12345;
+    return (uint8)(g_random >> 16);
+}
+
+/* CRC of the buffer a byte at a time */
+static uint16 updateEach(uint16 (*p_update)(uint16, uint8), uint16 crc,
+                         const uint8 *p_buf, uint16 len)
+{
+    uint16 i;
+
+    for(i = 0; i < len; i++)
+    {
+        crc = p_update(crc, p_buf[i]);
+    }
+
+    return crc;
+}
+
+/*----------------------------------------------------------------------------*
+ *  Known check value of CRC-CCITT with seed 0xFFFF
+ *----------------------------------------------------------------------------*/
+static void testCheckValue(void)
+{
+    const unsigned char check[] = "123456789";
+
+    CHECK(crcRefCalculate(CRC_CCITT_SEED, check, 9) == 0x29B1);
+    CHECK(crc_calculate_crc(CRC_CCITT_SEED, check, 9) == 0x29B1);
+    CHECK(crc_calculate_crc_nibble(CRC_CCITT_SEED, check, 9) == 0x29B1);
+
+    /* No buffer leaves the CRC as it is */
+    CHECK(crc_calculate_crc(0x1234, NULL, 9) == 0x1234);
+    CHECK(crc_calculate_crc_nibble(0x1234, NULL, 9) == 0x1234);
+}
+
+/*----------------------------------------------------------------------------*
+ *  Random buffers of every length up to TEST_MAX_LEN from random seeds,
+ *  whole, split in two parts and a byte at a time
+ *----------------------------------------------------------------------------*/
+static void testRandomBuffers(void)
+{
+    uint8 buf[TEST_MAX_LEN];
+    uint16 len;
+    uint16 n;
+    uint16 i;
+    uint16 seed;
+    uint16 split;
+    uint16 ref;
+    uint32 mismatches = 0;
+
+    for(len = 0; len <= TEST_MAX_LEN; len++)
+    {
+        for(n = 0; n < TEST_BUFFERS_PER_LEN; n++)
+        {
+            for(i = 0; i < len; i++)
+            {
+                buf[i] = randomOctet();
+            }
+
+            seed = n ? (uint16)(randomOctet() << 8 | randomOctet()) :
+                       CRC_CCITT_SEED;
+            split = len ? randomOctet() % len : 0;
+            ref = crcRefCalculate(seed, buf, len);
+
+            if(crc_calculate_crc(seed, buf, len) != ref ||
+               crc_calculate_crc_nibble(seed, buf, len) != ref ||
+               crc_calculate_crc(crc_calculate_crc(seed, buf, split),
+                                 buf + split, len - split) != ref ||
+               crc_calculate_crc_nibble(
+                            crc_calculate_crc_nibble(seed, buf, split),
+                            buf + split, len - split) != ref ||
+               updateEach(crc_update_crc, seed, buf, len) != ref ||
+               updateEach(crc_update_crc_nibble, seed, buf, len) != ref)
+            {
+                mismatches++;
+            }
+        }
+    }
+
+    CHECK(mismatches == 0);
+}
+
+/*----------------------------------------------------------------------------*
+ *  Every byte value from every CRC value
+ *----------------------------------------------------------------------------*/
+static void testAllSteps(void)
+{
+    uint32 crc;
+    uint16 byte;
+    uint8 value;
+    uint16 ref;
+    uint32 mismatches = 0;
+
+    for(crc = 0; crc <= 0xFFFF; crc++)
+    {
+        for(byte = 0; byte <= 0xFF; byte++)
+        {
+            value = (uint8)byte;
+            ref = crcRefCalculate((uint16)crc, &value, 1);
+
+            if(crc_update_crc((uint16)crc, value) != ref ||
+               crc_update_crc_nibble((uint16)crc, value) != ref)
+            {
+                mismatches++;
+            }
+        }
+    }
+
+    CHECK(mismatches == 0);
+}
+
+/*============================================================================*
+ *  Public Function Implementations
+ *============================================================================*/
+
+int main(void)
+{
+    testCheckValue();
+    testRandomBuffers();
+    testAllSteps();
+
+    return HOST_TEST_RESULT("test_crc");
+}
@@ -0,0 +1,211 @@
+/******************************************************************************
+ *  FILE
+ *      test_date.c
+ *
+ *  DESCRIPTION
+ *      Host test of the date conversion of uartio.c: calcDate against the
+ *      year by year calculation it replaced, and calcEpoch as its inverse,
+ *      over every day from 1970 up to the 32 bit limit in 2106.
+ *
+ ******************************************************************************/
+
+#include "uartio.h"
+#include "host_test.h"
+
+/*============================================================================*
+ *  Private Definitions
+ *============================================================================*/
+
+/* Last day of 32 bit epochs, 2106-02-07 */
+#define TEST_LAST_DAY                   (0xFFFFFFFFUL / 86400UL)
+
+/* Random epochs checked after the days */
+#define TEST_RANDOM_EPOCHS              (200000UL)
+
+/*============================================================================*
+ *  Private Data
+ *============================================================================*/
+
+static uint32 g_random = 12345;
+
+/*============================================================================*
+ *  Private Function Implementations
+ *============================================================================*/
+
+static uint32 random32(void)
+{
+    g_random = g_random * 1103515245UL + 12345;
+    return (g_random >> 16) | ((g_random & 0xFFFF) << 16);
+}
+
+/* calcDate of the original uartio.c */
+static void calcDateRef(TIME_UNIX_CONV *tm, uint32 meterEpoch)
+{
+    static const uint8 daysInMonth[12] =
+                        {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    uint32 seconds, minutes, hours, days, year, month;
+    uint32 dayOfWeek;
+    bool leapYear;
+    uint16 daysInYear;
+    uint8 dim;
+
+    seconds = meterEpoch;
+
+    minutes  = seconds / 60;
+    seconds -= minutes * 60;
+    hours    = minutes / 60;
+    minutes -= hours   * 60;
+    days     = hours   / 24;
+    hours   -= days    * 24;
+
+    year      = 1970;
+    dayOfWeek = 4;
+
+    for(;;)
+    {
+        leapYear = (year % 4 == 0 && (year % 100 != 0 || year % 400 == 0));
+        daysInYear = leapYear ? 366 : 365;
+
+        if(days >= daysInYear)
+        {
+            dayOfWeek += leapYear ? 2 : 1;
+            days      -= daysInYear;
+            if(dayOfWeek >= 7)
+                dayOfWeek -= 7;
+            ++year;
+        }
+        else
+        {
+            tm->tm_yday = days;
+            dayOfWeek  += days;
+            dayOfWeek  %= 7;
+
+            for(month = 0; month < 12; ++month)
+            {
+                dim = daysInMonth[month];
+
+                if(month == 1 && leapYear)
+                    ++dim;
+
+                if(days >= dim)
+                    days -= dim;
+                else
+                    break;
+            }
+            break;
+        }
+    }
+
+    tm->tm_sec  = seconds % 60;
+    tm->tm_min  = minutes % 3600;
+    tm->tm_hour = hours % 216000;
+    tm->tm_mday = (days + 1);
+    tm->tm_mon  = month + 1;
+    tm->tm_year = year;
+    tm->tm_wday = dayOfWeek;
+}
+
+/* Convert 'epoch' both ways, returning FALSE on any difference */
+static bool checkEpoch(uint32 epoch)
+{
+    TIME_UNIX_CONV tm;
+    TIME_UNIX_CONV ref;
+
+    calcDate(&tm, epoch);
+    calcDateRef(&ref, epoch);
+
+    return tm.tm_sec == ref.tm_sec && tm.tm_min == ref.tm_min &&
+           tm.tm_hour == ref.tm_hour && tm.tm_mday == ref.tm_mday &&
+           tm.tm_mon == ref.tm_mon && tm.tm_yday == ref.tm_yday &&
+           tm.tm_year == ref.tm_year && tm.tm_wday == ref.tm_wday &&
+           calcEpoch(&tm) == epoch;
+}
+
+/*----------------------------------------------------------------------------*
+ *  The first, middle and last second and a random second of every day
+ *----------------------------------------------------------------------------*/
+static void testEveryDay(void)
+{
+    uint32 day;
+    uint32 start;
+    uint32 last;
+    uint32 mismatches = 0;
+
+    for(day = 0; day <= TEST_LAST_DAY; day++)
+    {
+        start = day * 86400UL;
+        last = (day == TEST_LAST_DAY) ? 0xFFFFFFFFUL : start + 86399UL;
+
+        if(!checkEpoch(start) || !checkEpoch(start + 43199UL) ||
+           !checkEpoch(last) ||
+           !checkEpoch(start + random32() % (last - start + 1)))
+        {
+            mismatches++;
+        }
+    }
+
+    CHECK(mismatches == 0);
+}
+
+/*----------------------------------------------------------------------------*
+ *  Random epochs, which seldom share the day of the last conversion
+ *----------------------------------------------------------------------------*/
+static void testRandomEpochs(void)
+{
+    uint32 n;
+    uint32 mismatches = 0;
+
+    for(n = 0; n < TEST_RANDOM_EPOCHS; n++)
+    {
+        if(!checkEpoch(random32()))
+        {
+            mismatches++;
+        }
+    }
+
+    CHECK(mismatches == 0);
+}
+
+/*----------------------------------------------------------------------------*
+ *  Known dates either side of the base changes and the leap days
+ *----------------------------------------------------------------------------*/
+static void testKnownDates(void)
+{
+    TIME_UNIX_CONV tm;
+
+    calcDate(&tm, 0);
+    CHECK(tm.tm_year == 1970 && tm.tm_mon == 1 && tm.tm_mday == 1 &&
+          tm.tm_wday == 4);
+
+    /* 2000-02-29 23:59:59 and 2000-03-01 00:00:00 */
+    calcDate(&tm, 951868799UL);
+    CHECK(tm.tm_year == 2000 && tm.tm_mon == 2 && tm.tm_mday == 29 &&
+          tm.tm_hour == 23 && tm.tm_min == 59 && tm.tm_sec == 59);
+    calcDate(&tm, 951868800UL);
+    CHECK(tm.tm_year == 2000 && tm.tm_mon == 3 && tm.tm_mday == 1 &&
+          tm.tm_hour == 0 && tm.tm_min == 0 && tm.tm_sec == 0);
+
+    /* 2100-02-28 is followed by 2100-03-01 */
+    calcDate(&tm, 4107542400UL - 86400UL);
+    CHECK(tm.tm_year == 2100 && tm.tm_mon == 2 && tm.tm_mday == 28);
+    calcDate(&tm, 4107542400UL);
+    CHECK(tm.tm_year == 2100 && tm.tm_mon == 3 && tm.tm_mday == 1);
+
+    /* 2106-02-07 06:28:15 */
+    calcDate(&tm, 0xFFFFFFFFUL);
+    CHECK(tm.tm_year == 2106 && tm.tm_mon == 2 && tm.tm_mday == 7 &&
+          tm.tm_hour == 6 && tm.tm_min == 28 && tm.tm_sec == 15);
+}
+
+/*============================================================================*
+ *  Public Function Implementations
+ *============================================================================*/
+
+int main(void)
+{
+    testKnownDates();
+    testEveryDay();
+    testRandomEpochs();
+
+    return HOST_TEST_RESULT("test_date");
+}
@@ -0,0 +1,491 @@
+/******************************************************************************
+ *  FILE
+ *      test_meter.c
+ *
+ *  DESCRIPTION
+ *      Host test of the download of the records of the meter by uartio.c.
+ *      The octets of a meter are replayed on the UART in pieces of varying
+ *      size, in answer to the requests the application sends: whole
+ *      downloads, downloads of the new records only, downloads resumed
+ *      from NVM after a power on, garbage, corrupted frames and frames of
+ *      the Arduino. The records downloaded are read back through the
+ *      emulated link of host_link.c.
+ *
+ ******************************************************************************/
+
+#include <string.h>
+
+#include "app_gatt_db.h"
+#include "glucose_service.h"
+#include "uartio.h"
+#include "host_link.h"
+#include "host_test.h"
+
+/*============================================================================*
+ *  Private Definitions
+ *============================================================================*/
+
+/* Meter frames: STX, length, link, 0x05 and the command, then the data,
+ * ETX and the CRC
+ */
+#define METER_STX                       (0x02)
+#define METER_ETX                       (0x03)
+#define METER_HEAD_LEN                  (5)
+#define METER_TAIL_LEN                  (3)
+#define METER_ACK_LEN                   (6)
+#define METER_MAX_FRAME_LEN             (32)
+
+/* Commands of the requests of the application */
+#define METER_CMD_SERIAL_NO             (0x0B)
+#define METER_CMD_RECORDS               (0x1F)
+
+/* Link octet of the request for a record, that of the request for the
+ * number of records being 0
+ */
+#define METER_LINK_RECORD               (0x03)
+
+#define METER_SERIAL_NO_LEN             (9)
+#define METER_MAX_RECORDS               (32)
+
+/* Time the application waits for a reply, and the number of times a
+ * request is sent before the download is given up
+ */
+#define METER_REPLY_TIMEOUT             (500 * MILLISECOND)
+#define METER_ATTEMPTS                  (4)
+
+/* Frames of the Arduino */
+#define ARDUINO_FRAME_LEN               (9)
+
+/* Offset of the glucose concentration in a measurement with a time offset */
+#define MEAS_CONCENTRATION_OFFSET       (12)
+
+/* 2015-05-15 15:04:05 */
+#define TEST_EPOCH                      (1431702245UL)
+
+/*============================================================================*
+ *  Private Data Types
+ *============================================================================*/
+
+typedef struct
+{
+    /* Serial number */
+    uint8                               serial_no[METER_SERIAL_NO_LEN];
+
+    /* Records, 0 being the newest */
+    uint32                              epochs[METER_MAX_RECORDS];
+    uint16                              results[METER_MAX_RECORDS];
+    uint16                              num_records;
+
+    /* Octets of the UART sent by the application which have been answered */
+    uint16                              tx_pos;
+
+    /* Requests received, by kind, and ACKs received */
+    uint16                              serial_reqs;
+    uint16                              count_reqs;
+    uint16                              record_reqs;
+    uint16                              acks;
+
+    /* Faults of the next reply: garbage before it and a corrupted CRC */
+    bool                                garbage;
+    bool                                corrupt;
+
+    /* Whether the meter answers at all */
+    bool                                silent;
+} TEST_METER_T;
+
+/*============================================================================*
+ *  Private Data
+ *============================================================================*/
+
+static TEST_METER_T g_meter;
+
+/* Sizes of the pieces the octets are received in, in turn */
+static const uint16 g_piece_sizes[] = {1, 2, 7, 3, 64, 5};
+static uint16 g_piece;
+
+/*============================================================================*
+ *  Private Function Implementations
+ *============================================================================*/
+
+/* Receive octets on the UART in pieces of varying size */
+static void feed(const uint8 *p_data, uint16 len)
+{
+    uint16 size;
+
+    while(len)
+    {
+        size = g_piece_sizes[g_piece++ %
+                             (sizeof(g_piece_sizes) / sizeof(uint16))];
+        if(size > len)
+        {
+            size = len;
+        }
+
+        HostUartReceive(p_data, size);
+        p_data += size;
+        len -= size;
+    }
+}
+
+/* Complete a frame of 'len' octets with its ETX and CRC */
+static void sealFrame(uint8 *frame, uint16 len)
+{
+    uint16 crc;
+
+    frame[1] = (uint8)len;
+    frame[len - 3] = METER_ETX;
+    crc = crc_calculate_crc(CRC_CCITT_SEED, frame, len - 2);
+    frame[len - 2] = (uint8)(crc & 0xFF);
+    frame[len - 1] = (uint8)(crc >> 8);
+}
+
+/* Send the ACK of a request and a reply of 'data_len' octets of data */
+static void reply(uint8 cmd, const uint8 *p_data, uint16 data_len)
+{
+    static const uint8 garbage[] = {0x55, 0x02, 0x40, 0x00, 0xAA, 0x03};
+    uint8 ack[METER_ACK_LEN] = {METER_STX, 0, 0x06};
+    uint8 frame[METER_MAX_FRAME_LEN] = {METER_STX, 0, 0x00, 0x05};
+    uint16 len = METER_HEAD_LEN + data_len + METER_TAIL_LEN;
+
+    if(g_meter.silent)
+    {
+        return;
+    }
+
+    frame[4] = cmd;
+    memcpy(frame + METER_HEAD_LEN, p_data, data_len);
+    sealFrame(frame, len);
+    sealFrame(ack, METER_ACK_LEN);
+
+    if(g_meter.garbage)
+    {
+        /* A stray STX with a length out of range, then noise */
+        g_meter.garbage = FALSE;
+        feed(garbage, sizeof(garbage));
+    }
+
+    if(g_meter.corrupt)
+    {
+        g_meter.corrupt = FALSE;
+        frame[len - 1] ^= 0x5A;
+    }
+
+    feed(ack, METER_ACK_LEN);
+    feed(frame, len);
+}
+
+/* Answer a request of the application */
+static void answer(const uint8 *frame)
+{
+    uint8 data[6];
+    uint16 idx;
+
+    if(frame[4] == METER_CMD_SERIAL_NO)
+    {
+        g_meter.serial_reqs++;
+        reply(METER_CMD_SERIAL_NO, g_meter.serial_no, METER_SERIAL_NO_LEN);
+    }
+    else if(frame[2] != METER_LINK_RECORD)
+    {
+        g_meter.count_reqs++;
+        data[0] = LE8_L(g_meter.num_records);
+        data[1] = LE8_H(g_meter.num_records);
+        reply(METER_CMD_RECORDS, data, 2);
+    }
+    else
+    {
+        g_meter.record_reqs++;
+        idx = (uint16)(frame[5] | (frame[6] << 8));
+        CHECK(idx < g_meter.num_records);
+
+        data[0] = (uint8)g_meter.epochs[idx];
+        data[1] = (uint8)(g_meter.epochs[idx] >> 8);
+        data[2] = (uint8)(g_meter.epochs[idx] >> 16);
+        data[3] = (uint8)(g_meter.epochs[idx] >> 24);
+        data[4] = LE8_L(g_meter.results[idx]);
+        data[5] = LE8_H(g_meter.results[idx]);
+        reply(METER_CMD_RECORDS, data, 6);
+    }
+}
+
+/* Answer the frames the application has sent since the last call. Returns
+ * the number of requests received.
+ */
+static uint16 serveRequests(void)
+{
+    const uint8 *frame;
+    uint16 len;
+    uint16 crc;
+    uint16 requests = 0;
+
+    while(g_meter.tx_pos < g_host_sdk.uart_tx_len)
+    {
+        frame = &g_host_sdk.uart_tx[g_meter.tx_pos];
+        len = frame[1];
+
+        /* The application only sends whole, valid frames */
+        CHECK(frame[0] == METER_STX && len >= METER_ACK_LEN &&
+              g_meter.tx_pos + len <= g_host_sdk.uart_tx_len);
+        if(frame[0] != METER_STX || len < METER_ACK_LEN)
+        {
+            g_meter.tx_pos = g_host_sdk.uart_tx_len;
+            break;
+        }
+
+        crc = crc_calculate_crc(CRC_CCITT_SEED, frame, len - 2);
+        CHECK(frame[len - 3] == METER_ETX &&
+              frame[len - 2] == (uint8)(crc & 0xFF) &&
+              frame[len - 1] == (uint8)(crc >> 8));
+
+        g_meter.tx_pos += len;
+
+        if(len == METER_ACK_LEN)
+        {
+            g_meter.acks++;
+        }
+        else
+        {
+            answer(frame);
+            requests++;
+        }
+    }
+
+    return requests;
+}
+
+/* Forget the octets sent and the requests answered */
+static void clearMeter(void)
+{
+    g_host_sdk.uart_tx_len = 0;
+    g_meter.tx_pos = 0;
+    g_meter.serial_reqs = 0;
+    g_meter.count_reqs = 0;
+    g_meter.record_reqs = 0;
+    g_meter.acks = 0;
+}
+
+/* Download the new records of the meter. The application sends its next
+ * request as soon as a reply is received. A request left unanswered is
+ * resent when the reply timer expires, so the timers are run one at a time
+ * for the meter to answer each request. The link is run at the end.
+ */
+static void sync(void)
+{
+    uint32 expiry = 0;
+
+    clearMeter();
+    MeterSync();
+
+    for(;;)
+    {
+        while(serveRequests())
+            ;
+
+        if(!HostNextTimerExpiry(&expiry) ||
+           (int32)(expiry - g_host_sdk.now) > (int32)METER_REPLY_TIMEOUT)
+        {
+            break;
+        }
+
+        HostRunNextTimer();
+    }
+
+    HostLinkRun();
+}
+
+/* Make the meter take a record */
+static void takeRecord(uint32 epoch, uint16 result)
+{
+    memmove(&g_meter.epochs[1], &g_meter.epochs[0],
+            g_meter.num_records * sizeof(uint32));
+    memmove(&g_meter.results[1], &g_meter.results[0],
+            g_meter.num_records * sizeof(uint16));
+
+    g_meter.epochs[0] = epoch;
+    g_meter.results[0] = result;
+    g_meter.num_records++;
+}
+
+static uint16 countAll(void)
+{
+    uint8 count_all[] = {REPORT_NUMBER_OF_STORED_RECORDS, ALL_RECORDS};
+
+    HostLinkRequest(count_all, sizeof(count_all));
+    return HostLinkNumOfRecords();
+}
+
+/* Glucose concentration of the newest record of the store */
+static uint16 lastResult(void)
+{
+    uint8 report_last[] = {REPORT_STORED_RECORDS, LAST_RECORD};
+    const uint8 *conc = &g_host_link.meas[MEAS_CONCENTRATION_OFFSET];
+
+    HostLinkRequest(report_last, sizeof(report_last));
+    return (uint16)(conc[0] | (conc[1] << 8));
+}
+
+/*----------------------------------------------------------------------------*
+ *  A meter which does not answer: the request is resent on the reply timer
+ *  and the download is given up
+ *----------------------------------------------------------------------------*/
+static void testNoMeter(void)
+{
+    g_meter.silent = TRUE;
+
+    /* Power on starts a download */
+    clearMeter();
+    HostLinkPowerOn(TRUE);
+    HostLinkSubscribe();
+    serveRequests();
+    CHECK(g_meter.serial_reqs == METER_ATTEMPTS && g_meter.acks == 0);
+
+    sync();
+    CHECK(g_meter.serial_reqs == METER_ATTEMPTS && g_meter.acks == 0);
+    CHECK(g_meter.count_reqs == 0);
+
+    g_meter.silent = FALSE;
+    CHECK(countAll() == 0);
+}
+
+/*----------------------------------------------------------------------------*
+ *  Downloads of all the records, of the new ones only, and of none after a
+ *  power on which restores the state of the download from NVM
+ *----------------------------------------------------------------------------*/
+static void testDownload(void)
+{
+    uint16 i;
+
+    memcpy(g_meter.serial_no, "GLU000001", METER_SERIAL_NO_LEN);
+    g_meter.num_records = 0;
+
+    for(i = 0; i < 5; i++)
+    {
+        takeRecord(TEST_EPOCH + i * 3600UL, 100 + i);
+    }
+
+    sync();
+    CHECK(g_meter.serial_reqs == 1 && g_meter.count_reqs == 1);
+    CHECK(g_meter.record_reqs == 5);
+
+    /* Each reply is acknowledged */
+    CHECK(g_meter.acks == 7);
+    CHECK(countAll() == 5);
+    CHECK(lastResult() == 104);
+
+    /* Only the records taken since are downloaded, the newest downloaded
+     * being probed where it is expected
+     */
+    takeRecord(TEST_EPOCH + 5 * 3600UL, 105);
+    takeRecord(TEST_EPOCH + 6 * 3600UL, 106);
+    sync();
+    CHECK(g_meter.record_reqs == 1 + 2);
+    CHECK(countAll() == 7);
+    CHECK(lastResult() == 106);
+
+    /* Nothing new */
+    sync();
+    CHECK(g_meter.record_reqs == 1);
+    CHECK(countAll() == 7);
+
+    /* The download carries on from NVM after a power on */
+    HostLinkPowerOn(FALSE);
+    HostLinkSubscribe();
+    sync();
+    CHECK(countAll() == 7);
+
+    takeRecord(TEST_EPOCH + 7 * 3600UL, 107);
+    sync();
+    CHECK(g_meter.record_reqs == 1 + 1);
+    CHECK(countAll() == 8);
+    CHECK(lastResult() == 107);
+
+    /* Another meter has none of its records downloaded */
+    memcpy(g_meter.serial_no, "GLU000002", METER_SERIAL_NO_LEN);
+    g_meter.num_records = 0;
+    takeRecord(TEST_EPOCH + 8 * 3600UL, 108);
+    takeRecord(TEST_EPOCH + 9 * 3600UL, 109);
+    sync();
+    CHECK(g_meter.record_reqs == 2);
+    CHECK(countAll() == 10);
+    CHECK(lastResult() == 109);
+}
+
+/*----------------------------------------------------------------------------*
+ *  Garbage before a frame is skipped, and a corrupted frame is dropped and
+ *  its request resent
+ *----------------------------------------------------------------------------*/
+static void testFaults(void)
+{
+    uint16 count = countAll();
+
+    takeRecord(TEST_EPOCH + 10 * 3600UL, 110);
+    takeRecord(TEST_EPOCH + 11 * 3600UL, 111);
+
+    g_meter.garbage = TRUE;
+    sync();
+    CHECK(g_meter.serial_reqs == 1);
+    CHECK(countAll() == count + 2);
+    CHECK(lastResult() == 111);
+
+    takeRecord(TEST_EPOCH + 12 * 3600UL, 112);
+
+    g_meter.corrupt = TRUE;
+    sync();
+    CHECK(g_meter.serial_reqs == 2);
+    CHECK(countAll() == count + 3);
+    CHECK(lastResult() == 112);
+
+    /* Both faults on one reply */
+    takeRecord(TEST_EPOCH + 13 * 3600UL, 113);
+
+    g_meter.garbage = TRUE;
+    g_meter.corrupt = TRUE;
+    sync();
+    CHECK(g_meter.serial_reqs == 2);
+    CHECK(countAll() == count + 4);
+    CHECK(lastResult() == 113);
+}
+
+/*----------------------------------------------------------------------------*
+ *  A frame of the Arduino is echoed and its measurement stored
+ *----------------------------------------------------------------------------*/
+static void testArduino(void)
+{
+    uint32 epoch = TEST_EPOCH + 20 * 3600UL;
+    uint8 frame[ARDUINO_FRAME_LEN] =
+    {
+        'a', 'b', 'c', 0x00, 0x78,
+        (uint8)(epoch >> 24), (uint8)(epoch >> 16), (uint8)(epoch >> 8),
+        (uint8)epoch
+    };
+    uint8 noise[] = {'a', 'x', 0x00};
+    uint16 count = countAll();
+
+    clearMeter();
+
+    /* A false start is skipped */
+    feed(noise, sizeof(noise));
+    feed(frame, ARDUINO_FRAME_LEN);
+
+    CHECK(g_host_sdk.uart_tx_len == ARDUINO_FRAME_LEN &&
+          memcmp(g_host_sdk.uart_tx, frame, ARDUINO_FRAME_LEN) == 0);
+    CHECK(countAll() == count + 1);
+    CHECK(lastResult() == 0x78);
+}
+
+/*============================================================================*
+ *  Public Function Implementations
+ *============================================================================*/
+
+int main(void)
+{
+    HostLinkInit(HOST_LINK_DEFAULT_BUFFERS, HOST_LINK_DEFAULT_PER_EVENT,
+                 HOST_LINK_DEFAULT_INTERVAL);
+
+    testNoMeter();
+    testDownload();
+    testFaults();
+    testArduino();
+
+    return HOST_TEST_RESULT("test_meter");
+}
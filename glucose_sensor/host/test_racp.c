@@ -0,0 +1,1215 @@
+/******************************************************************************
+ *  FILE
+ *      test_racp.c
+ *
+ *  DESCRIPTION
+ *      Host test of the record queue of the glucose service and of the
+ *      record access control point procedures run on it, through the
+ *      emulated link of host_link.c.
+ *
+ ******************************************************************************/
+
+#include <string.h>
+
+#include "app_gatt_db.h"
+#include "glucose_service.h"
+#include "glucose_sensor.h"
+#include "gap_conn_params.h"
+#include "host_link.h"
+#include "host_test.h"
+
+/*============================================================================*
+ *  Private Definitions
+ *============================================================================*/
+
+#define MAX_RECORDS                     MAX_NUMBER_GLUCOSE_MEASUREMENTS
+#define LOG_ENTRIES                     NVM_RECORD_LOG_ENTRIES
+
+/* NVM of the glucose service, which follows that of the application and of
+ * the GAP service (see readPersistentStore)
+ */
+#define GLUCOSE_NVM_OFFSET              (NVM_MAX_APP_MEMORY_WORDS + 1 + \
+                                         DEVICE_NAME_MAX_LENGTH)
+#define GLUCOSE_NVM(offset)             (g_host_sdk.nvm[GLUCOSE_NVM_OFFSET + \
+                                                        (offset)])
+
+/* Length of a date time field of a user facing time operand */
+#define DATE_TIME_LEN                   (7)
+
+/* Time offset of the measurements added by addRecord, in minutes */
+#define RECORD_TIME_OFFSET              (0x00FF)
+
+/* 2015-05-15 15:04:05 */
+#define TEST_EPOCH                      (1431702245UL)
+
+/*============================================================================*
+ *  Private Function Implementations
+ *============================================================================*/
+
+/* Add a measurement with all the optional fields, of base time 'epoch' */
+static void addRecord(uint32 epoch)
+{
+    uint8 meas[] = {LE8_L(RECORD_TIME_OFFSET), LE8_H(RECORD_TIME_OFFSET),
+                    0x46, 0xb0, 0x11, 0x00, 0x00};
+    uint8 context[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13};
+
+    AddGlucoseMeasurementToQueue(0x1f, meas, sizeof(meas),
+                                 0xff, context, sizeof(context), epoch);
+}
+
+/* Add a measurement with no context */
+static void addShortRecord(void)
+{
+    uint8 meas[7] = {0};
+
+    AddGlucoseMeasurementToQueue(0x0f, meas, sizeof(meas), 0, NULL, 0, 0);
+}
+
+static void addRecords(uint16 num, uint32 epoch)
+{
+    while(num--)
+    {
+        addRecord(epoch++);
+    }
+}
+
+/* Encode 'epoch' as a date time field, independently of calcDate */
+static void encodeDateTime(uint8 *p_value, uint32 epoch)
+{
+    int32 days = (int32)(epoch / 86400) + 719468;
+    uint32 secs = epoch % 86400;
+    int32 era = days / 146097;
+    int32 doe = days - era * 146097;
+    int32 yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int32 doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int32 mp = (5 * doy + 2) / 153;
+    int32 month = mp < 10 ? mp + 3 : mp - 9;
+    int32 year = yoe + era * 400 + (month <= 2);
+
+    p_value[0] = LE8_L(year);
+    p_value[1] = LE8_H(year);
+    p_value[2] = (uint8)month;
+    p_value[3] = (uint8)(doy - (153 * mp + 2) / 5 + 1);
+    p_value[4] = (uint8)(secs / 3600);
+    p_value[5] = (uint8)(secs / 60 % 60);
+    p_value[6] = (uint8)(secs % 60);
+}
+
+/* Requests with no operand, one or two sequence numbers, one or two user
+ * facing times
+ */
+static void request(uint8 opcode, uint8 operator)
+{
+    uint8 value[2];
+
+    value[0] = opcode;
+    value[1] = operator;
+    HostLinkRequest(value, 2);
+}
+
+static void requestSeqNum(uint8 opcode, uint8 operator, uint16 seq_num)
+{
+    uint8 value[5];
+
+    value[0] = opcode;
+    value[1] = operator;
+    value[2] = SEQUENCE_NUMBER;
+    value[3] = LE8_L(seq_num);
+    value[4] = LE8_H(seq_num);
+    HostLinkRequest(value, 5);
+}
+
+static void requestSeqNumRange(uint8 opcode, uint16 min, uint16 max)
+{
+    uint8 value[7];
+
+    value[0] = opcode;
+    value[1] = WITHIN_RANGE_OF;
+    value[2] = SEQUENCE_NUMBER;
+    value[3] = LE8_L(min);
+    value[4] = LE8_H(min);
+    value[5] = LE8_L(max);
+    value[6] = LE8_H(max);
+    HostLinkRequest(value, 7);
+}
+
+static void requestTime(uint8 opcode, uint8 operator, uint32 time)
+{
+    uint8 value[3 + DATE_TIME_LEN];
+
+    value[0] = opcode;
+    value[1] = operator;
+    value[2] = USER_FACING_TIME;
+    encodeDateTime(&value[3], time);
+    HostLinkRequest(value, sizeof(value));
+}
+
+static void requestTimeRange(uint8 opcode, uint32 min, uint32 max)
+{
+    uint8 value[3 + 2 * DATE_TIME_LEN];
+
+    value[0] = opcode;
+    value[1] = WITHIN_RANGE_OF;
+    value[2] = USER_FACING_TIME;
+    encodeDateTime(&value[3], min);
+    encodeDateTime(&value[3 + DATE_TIME_LEN], max);
+    HostLinkRequest(value, sizeof(value));
+}
+
+/* Count the records from a date time given field by field, 0xFFFF if the
+ * operand is refused
+ */
+static uint16 countFromDate(uint16 year, uint8 month, uint8 day, uint8 hour,
+                            uint8 minute, uint8 second)
+{
+    uint8 value[3 + DATE_TIME_LEN] = {REPORT_NUMBER_OF_STORED_RECORDS,
+                                      GREATER_THAN_OR_EQUAL_TO,
+                                      USER_FACING_TIME};
+
+    value[3] = LE8_L(year);
+    value[4] = LE8_H(year);
+    value[5] = month;
+    value[6] = day;
+    value[7] = hour;
+    value[8] = minute;
+    value[9] = second;
+    HostLinkRequest(value, sizeof(value));
+
+    return HostLinkNumOfRecords();
+}
+
+static uint16 countAll(void)
+{
+    request(REPORT_NUMBER_OF_STORED_RECORDS, ALL_RECORDS);
+    return HostLinkNumOfRecords();
+}
+
+static uint16 firstSeqNum(void)
+{
+    request(REPORT_STORED_RECORDS, FIRST_RECORD);
+    return g_host_link.seq_nums[0];
+}
+
+static uint16 lastSeqNum(void)
+{
+    request(REPORT_STORED_RECORDS, LAST_RECORD);
+    return g_host_link.seq_nums[0];
+}
+
+/* Whether a timer of the service is running. The timers of the connection
+ * run for longer than HOST_LINK_IDLE_TIME.
+ */
+static bool serviceTimerRunning(void)
+{
+    uint32 expiry;
+
+    return HostNextTimerExpiry(&expiry) &&
+           (int32)(expiry - g_host_sdk.now) <= (int32)HOST_LINK_IDLE_TIME;
+}
+
+/* Run the timers up to the expiry of the connection parameter update
+ * timer, then the link
+ */
+static void runConnParamTimer(void)
+{
+    while(g_gs_data.conn_param_update_tid != TIMER_INVALID &&
+          HostRunNextTimer())
+        ;
+
+    HostLinkRun();
+}
+
+/* Power on from erased NVM and connect */
+static void freshStart(void)
+{
+    HostLinkInit(HOST_LINK_DEFAULT_BUFFERS, HOST_LINK_DEFAULT_PER_EVENT,
+                 HOST_LINK_DEFAULT_INTERVAL);
+    HostLinkPowerOn(TRUE);
+    HostLinkSubscribe();
+}
+
+/* Power off and on again, then reconnect */
+static void restart(void)
+{
+    HostLinkPowerOn(FALSE);
+    HostLinkSubscribe();
+}
+
+/*----------------------------------------------------------------------------*
+ *  Reports and counts on a full store, with notifications pumped on their
+ *  confirmations and with the firmware running out of buffers
+ *----------------------------------------------------------------------------*/
+static void testReport(void)
+{
+    uint16 pass;
+
+    freshStart();
+
+    /* Sequence numbers 1 to 250, of which the newest are kept */
+    addRecords(250, 1000);
+
+    for(pass = 0; pass < 2; pass++)
+    {
+        if(pass)
+        {
+            HostLinkInit(3, 2, HOST_LINK_DEFAULT_INTERVAL);
+        }
+
+        request(REPORT_STORED_RECORDS, ALL_RECORDS);
+        CHECK(g_host_link.num_meas == MAX_RECORDS);
+        CHECK(g_host_link.num_contexts == MAX_RECORDS);
+        CHECK(g_host_link.seq_nums[0] == 250 - MAX_RECORDS + 1);
+        CHECK(g_host_link.seq_nums[MAX_RECORDS - 1] == 250);
+        CHECK(g_host_link.response[0] == RESPONSE_CODE);
+        CHECK(g_host_link.response[2] == REPORT_STORED_RECORDS);
+        CHECK(HostLinkResponseValue() == RESPONSE_CODE_SUCCESS);
+
+        requestSeqNum(REPORT_STORED_RECORDS, LESS_THAN_OR_EQUAL_TO, 60);
+        CHECK(g_host_link.num_meas == 60 - (250 - MAX_RECORDS));
+        CHECK(g_host_link.seq_nums[g_host_link.num_meas - 1] == 60);
+
+        requestSeqNum(REPORT_STORED_RECORDS, GREATER_THAN_OR_EQUAL_TO, 240);
+        CHECK(g_host_link.num_meas == 11 && g_host_link.seq_nums[0] == 240);
+
+        requestSeqNumRange(REPORT_STORED_RECORDS, 70, 79);
+        CHECK(g_host_link.num_meas == 10 && g_host_link.seq_nums[0] == 70);
+
+        requestSeqNumRange(REPORT_STORED_RECORDS, 10, 20);
+        CHECK(g_host_link.num_meas == 0);
+        CHECK(HostLinkResponseValue() == NO_RECORDS_FOUND);
+
+        CHECK(firstSeqNum() == 250 - MAX_RECORDS + 1);
+        CHECK(g_host_link.num_meas == 1);
+        CHECK(lastSeqNum() == 250);
+        CHECK(g_host_link.num_meas == 1);
+
+        CHECK(countAll() == MAX_RECORDS);
+
+        requestSeqNum(REPORT_NUMBER_OF_STORED_RECORDS,
+                      LESS_THAN_OR_EQUAL_TO, 60);
+        CHECK(HostLinkNumOfRecords() == 60 - (250 - MAX_RECORDS));
+    }
+
+    /* The second pass has run with flow control */
+    CHECK(g_host_link.failures != 0);
+    CHECK(!g_gs_data.bulk_transfer);
+}
+
+/* Records added on each connection event of a report */
+static uint16 g_records_per_event;
+
+static void addRecordsOnEvent(void)
+{
+    addRecords(g_records_per_event, 5000);
+}
+
+/*----------------------------------------------------------------------------*
+ *  Reports of a full store while new records overwrite the oldest ones,
+ *  which are dropped from the report if they have not been sent yet
+ *----------------------------------------------------------------------------*/
+static void testReportWhileAdding(void)
+{
+    uint16 pass;
+    uint16 i;
+    bool ordered;
+
+    for(pass = 0; pass < 4; pass++)
+    {
+        freshStart();
+        addRecords(MAX_RECORDS, 1000);
+
+        if(pass & 1)
+        {
+            HostLinkInit(3, 2, HOST_LINK_DEFAULT_INTERVAL);
+            HostLinkSubscribe();
+        }
+
+        /* Fewer records than are sent per event, then more */
+        g_records_per_event = (pass & 2) ? 8 : 1;
+        g_host_link.p_event_hook = addRecordsOnEvent;
+
+        request(REPORT_STORED_RECORDS, ALL_RECORDS);
+        g_host_link.p_event_hook = NULL;
+
+        CHECK(HostLinkResponseValue() == RESPONSE_CODE_SUCCESS);
+        CHECK(g_host_link.num_meas > 0);
+        CHECK(g_host_link.num_contexts <= g_host_link.num_meas);
+        CHECK(g_host_link.seq_nums[0] == 1);
+
+        /* Records are overwritten before they are sent only if the 
+         * notifications wait for the radio and fall behind
+         */
+        CHECK((g_host_link.num_meas < MAX_RECORDS) == (pass == 3));
+
+        /* Only records of the store at the request are sent, in order */
+        ordered = TRUE;
+        for(i = 1; i < g_host_link.num_meas; i++)
+        {
+            ordered = ordered && 
+                      g_host_link.seq_nums[i] > g_host_link.seq_nums[i - 1];
+        }
+        CHECK(ordered);
+        CHECK(g_host_link.seq_nums[g_host_link.num_meas - 1] <= MAX_RECORDS);
+
+        CHECK(countAll() == MAX_RECORDS);
+        CHECK(lastSeqNum() > MAX_RECORDS);
+    }
+}
+
+/*----------------------------------------------------------------------------*
+ *  Deletes, which leave holes in the queue until it is compacted
+ *----------------------------------------------------------------------------*/
+static void testDelete(void)
+{
+    uint16 first = 250 - MAX_RECORDS + 1;
+
+    freshStart();
+    addRecords(250, 1000);
+
+    requestSeqNumRange(DELETE_STORED_RECORDS, 70, 79);
+    CHECK(g_host_link.response[2] == DELETE_STORED_RECORDS);
+    CHECK(HostLinkResponseValue() == RESPONSE_CODE_SUCCESS);
+    CHECK(countAll() == MAX_RECORDS - 10);
+
+    request(REPORT_STORED_RECORDS, ALL_RECORDS);
+    CHECK(g_host_link.num_meas == MAX_RECORDS - 10);
+    CHECK(g_host_link.seq_nums[69 - first] == 69);
+    CHECK(g_host_link.seq_nums[70 - first] == 80);
+
+    requestSeqNumRange(REPORT_STORED_RECORDS, 65, 85);
+    CHECK(g_host_link.num_meas == 11);
+
+    request(DELETE_STORED_RECORDS, FIRST_RECORD);
+    request(DELETE_STORED_RECORDS, LAST_RECORD);
+    request(REPORT_STORED_RECORDS, ALL_RECORDS);
+    CHECK(g_host_link.num_meas == MAX_RECORDS - 12);
+    CHECK(g_host_link.seq_nums[0] == first + 1);
+    CHECK(g_host_link.seq_nums[g_host_link.num_meas - 1] == 249);
+
+    /* Left 61 to 69 and 80 to 239 */
+    requestSeqNum(DELETE_STORED_RECORDS, LESS_THAN_OR_EQUAL_TO, 60);
+    requestSeqNum(DELETE_STORED_RECORDS, GREATER_THAN_OR_EQUAL_TO, 240);
+    request(REPORT_STORED_RECORDS, ALL_RECORDS);
+    CHECK(g_host_link.num_meas == 169);
+    CHECK(g_host_link.seq_nums[0] == 61);
+    CHECK(g_host_link.seq_nums[168] == 239);
+
+    requestSeqNumRange(DELETE_STORED_RECORDS, 100, 100);
+    requestSeqNumRange(DELETE_STORED_RECORDS, 120, 121);
+    requestSeqNum(REPORT_NUMBER_OF_STORED_RECORDS, LESS_THAN_OR_EQUAL_TO, 110);
+    CHECK(HostLinkNumOfRecords() == 39);
+
+    /* Reconnecting compacts the queue */
+    GlucoseDataInit();
+    request(REPORT_STORED_RECORDS, ALL_RECORDS);
+    CHECK(g_host_link.num_meas == 166);
+    CHECK(g_host_link.seq_nums[28] == 99 && g_host_link.seq_nums[29] == 101);
+    CHECK(g_host_link.seq_nums[47] == 119 && g_host_link.seq_nums[48] == 122);
+
+    requestSeqNumRange(REPORT_STORED_RECORDS, 100, 121);
+    CHECK(g_host_link.num_meas == 19);
+    CHECK(g_host_link.seq_nums[0] == 101 && g_host_link.seq_nums[18] == 119);
+
+    requestSeqNumRange(DELETE_STORED_RECORDS, 101, 101);
+    addRecords(5, 5000);
+    request(REPORT_STORED_RECORDS, ALL_RECORDS);
+    CHECK(g_host_link.num_meas == 170);
+    CHECK(g_host_link.seq_nums[169] == 255);
+
+    request(DELETE_STORED_RECORDS, ALL_RECORDS);
+    CHECK(countAll() == 0);
+    request(REPORT_STORED_RECORDS, ALL_RECORDS);
+    CHECK(HostLinkResponseValue() == NO_RECORDS_FOUND);
+}
+
+/*----------------------------------------------------------------------------*
+ *  Abort of a report as soon as the collector writes it
+ *----------------------------------------------------------------------------*/
+static void testAbort(void)
+{
+    uint8 report_all[] = {REPORT_STORED_RECORDS, ALL_RECORDS};
+    uint8 abort_op[] = {ABORT_OPERATION, OPERATOR_NULL};
+
+    freshStart();
+    addRecords(50, 1000);
+
+#ifdef ENABLE_PTS_WORKAROUNDS
+    g_pts_abort_test = TRUE;
+#endif /* ENABLE_PTS_WORKAROUNDS */
+
+    HostLinkClearReceived();
+    HostLinkWrite(HANDLE_RECORD_ACCESS_CONTROL_POINT, report_all, 2);
+    CHECK(g_host_link.num_meas == 1 && g_gs_data.bulk_transfer);
+
+    HostLinkWrite(HANDLE_RECORD_ACCESS_CONTROL_POINT, abort_op, 2);
+    CHECK(g_host_link.response[2] == ABORT_OPERATION);
+    CHECK(HostLinkResponseValue() == RESPONSE_CODE_SUCCESS);
+    CHECK(!g_gs_data.bulk_transfer && !g_host_link.radio_events);
+
+    /* Nothing more is sent once the first notification is confirmed */
+    HostLinkRun();
+    HostLinkConfirmIndication();
+    CHECK(g_host_link.num_meas == 1 && g_host_link.indications == 1);
+    CHECK(!serviceTimerRunning());
+
+#ifdef ENABLE_PTS_WORKAROUNDS
+    g_pts_abort_test = FALSE;
+#endif /* ENABLE_PTS_WORKAROUNDS */
+
+    CHECK(countAll() == 50);
+}
+
+/*----------------------------------------------------------------------------*
+ *  A full store drops its oldest records for the new ones
+ *----------------------------------------------------------------------------*/
+static void testFullStore(void)
+{
+    uint16 last;
+
+    freshStart();
+    addRecords(MAX_RECORDS, 9000);
+    last = lastSeqNum();
+    CHECK(last == MAX_RECORDS);
+
+    requestSeqNumRange(DELETE_STORED_RECORDS, 100, 100);
+    CHECK(countAll() == MAX_RECORDS - 1);
+
+    addRecord(1);
+    CHECK(firstSeqNum() == 2);
+    CHECK(countAll() == MAX_RECORDS - 1);
+
+    addRecord(2);
+    CHECK(firstSeqNum() == 3);
+    request(REPORT_STORED_RECORDS, ALL_RECORDS);
+    CHECK(g_host_link.num_meas == MAX_RECORDS - 1);
+    CHECK(g_host_link.seq_nums[MAX_RECORDS - 2] == last + 2);
+
+    /* Records with no context take less of the arena, their number is
+     * the limit
+     */
+    request(DELETE_STORED_RECORDS, ALL_RECORDS);
+    last = last + 2;
+
+    while(last < 2 * MAX_RECORDS + 50)
+    {
+        addShortRecord();
+        last++;
+    }
+
+    CHECK(countAll() == MAX_RECORDS);
+    request(REPORT_STORED_RECORDS, ALL_RECORDS);
+    CHECK(g_host_link.num_meas == MAX_RECORDS &&
+          g_host_link.num_contexts == 0);
+    CHECK(g_host_link.seq_nums[0] == last - MAX_RECORDS + 1);
+    CHECK(g_host_link.seq_nums[MAX_RECORDS - 1] == last);
+}
+
+/*----------------------------------------------------------------------------*
+ *  Values of the measurement and context characteristics
+ *----------------------------------------------------------------------------*/
+static void testRecordValue(void)
+{
+    uint8 meas[] = {0x1f, 0, 0, 0xdf, 0x07, 5, 15, 15, 4, 5,
+                    0xff, 0x00, 0x46, 0xb0, 0x11, 0x00, 0x00};
+    uint8 context[] = {0xff, 0, 0, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12,
+                       13};
+    uint16 seq_num;
+
+    freshStart();
+    addRecords(3, 1000);
+    addRecord(TEST_EPOCH);
+
+    request(REPORT_STORED_RECORDS, LAST_RECORD);
+    seq_num = g_host_link.seq_nums[0];
+    CHECK(seq_num == 4);
+
+    meas[1] = context[1] = LE8_L(seq_num);
+    meas[2] = context[2] = LE8_H(seq_num);
+
+    CHECK(g_host_link.num_meas == 1 && g_host_link.num_contexts == 1);
+    CHECK(g_host_link.meas_len == sizeof(meas) &&
+          memcmp(g_host_link.meas, meas, sizeof(meas)) == 0);
+    CHECK(g_host_link.context_len == sizeof(context) &&
+          memcmp(g_host_link.context, context, sizeof(context)) == 0);
+}
+
+/*----------------------------------------------------------------------------*
+ *  Restoring the records from the NVM record log on power on
+ *----------------------------------------------------------------------------*/
+static void testNvmRestore(void)
+{
+    uint16 last;
+    uint16 num;
+
+    freshStart();
+    addRecords(30, 7000);
+    last = lastSeqNum();
+
+    requestSeqNumRange(DELETE_STORED_RECORDS, last - 27, last - 26);
+    request(DELETE_STORED_RECORDS, LAST_RECORD);
+
+    restart();
+    request(REPORT_STORED_RECORDS, ALL_RECORDS);
+    CHECK(g_host_link.num_meas == 27);
+    CHECK(g_host_link.seq_nums[0] == last - 29);
+    CHECK(g_host_link.seq_nums[1] == last - 28);
+    CHECK(g_host_link.seq_nums[2] == last - 25);
+    CHECK(g_host_link.seq_nums[26] == last - 1);
+
+    /* Year 1970 */
+    lastSeqNum();
+    CHECK(g_host_link.meas[0] == 0x1f);
+    CHECK(g_host_link.meas[3] == 0xb2 && g_host_link.meas[4] == 0x07);
+
+    /* Sequence numbers are reserved in blocks, so those used after the
+     * last one written may be skipped
+     */
+    addRecord(1);
+    num = lastSeqNum();
+    CHECK(num > last && num <= last + 16 && (num - 1) % 16 == 0);
+
+    /* The log keeps the newest records */
+    addRecords(199, 7000);
+    last = lastSeqNum();
+    restart();
+    CHECK(countAll() == LOG_ENTRIES);
+    request(REPORT_STORED_RECORDS, ALL_RECORDS);
+    CHECK(g_host_link.seq_nums[LOG_ENTRIES - 1] == last);
+
+    request(DELETE_STORED_RECORDS, LAST_RECORD);
+    restart();
+    CHECK(countAll() == LOG_ENTRIES - 1);
+    CHECK(lastSeqNum() == last - 1);
+
+    /* An entry left from an older record is not restored */
+    addRecord(5);
+    last = lastSeqNum();
+    requestSeqNum(REPORT_NUMBER_OF_STORED_RECORDS, GREATER_THAN_OR_EQUAL_TO,
+                  last - (LOG_ENTRIES - 1));
+    num = HostLinkNumOfRecords();
+    CHECK(num > LOG_ENTRIES - 20 && num < LOG_ENTRIES);
+
+    GLUCOSE_NVM(NVM_RECORD_LOG_SEQ_NUM_OFFSET + last % LOG_ENTRIES) =
+                                                        last - LOG_ENTRIES;
+    restart();
+    CHECK(countAll() == num - 1);
+
+    request(DELETE_STORED_RECORDS, ALL_RECORDS);
+    restart();
+    CHECK(countAll() == 0);
+
+    addRecord(1);
+    restart();
+    CHECK(countAll() == 1);
+
+    /* Erasing the sequence number empties the log */
+    GlucoseSeqNumInit(GLUCOSE_NVM_OFFSET);
+    restart();
+    CHECK(countAll() == 0);
+}
+
+/*----------------------------------------------------------------------------*
+ *  A power loss after each NVM write of a record which reuses the log entry
+ *  of an older one: neither record is restored with the other's data
+ *----------------------------------------------------------------------------*/
+static void testNvmPowerLoss(void)
+{
+    uint16 seq_num = LOG_ENTRIES + 1;
+    uint32 writes = 0;
+
+    do
+    {
+        freshStart();
+        addRecords(LOG_ENTRIES, 0);
+
+        g_host_sdk.nvm_power_loss = TRUE;
+        g_host_sdk.nvm_writes_left = writes;
+        addRecord(TEST_EPOCH);
+        g_host_sdk.nvm_power_loss = FALSE;
+        restart();
+
+        /* Year 1970 */
+        requestSeqNumRange(REPORT_STORED_RECORDS, seq_num - LOG_ENTRIES,
+                           seq_num - LOG_ENTRIES);
+        CHECK(g_host_link.num_meas == 0 ||
+              (g_host_link.meas[3] == 0xb2 && g_host_link.meas[4] == 0x07));
+
+        /* Year 2015 */
+        requestSeqNumRange(REPORT_STORED_RECORDS, seq_num, seq_num);
+        CHECK(g_host_link.num_meas == 0 ||
+              (g_host_link.meas[3] == 0xdf && g_host_link.meas[4] == 0x07));
+
+        writes++;
+
+    } while(!g_host_sdk.nvm_writes_left);
+
+    /* The last pass lost no write */
+    CHECK(g_host_link.num_meas == 1);
+    CHECK(countAll() == LOG_ENTRIES);
+}
+
+/*----------------------------------------------------------------------------*
+ *  NVM writes made by bonding, adding records and deleting them
+ *----------------------------------------------------------------------------*/
+static void testNvmWrites(void)
+{
+    uint32 writes;
+    uint32 disables;
+    uint16 first;
+
+    freshStart();
+
+    writes = g_host_sdk.nvm_writes;
+    disables = g_host_sdk.nvm_disables;
+    GlucoseBondingNotify(TRUE);
+    CHECK(g_host_sdk.nvm_writes == writes + 1);
+    CHECK(g_host_sdk.nvm_disables == disables + 1);
+    CHECK(GLUCOSE_NVM(NVM_MEASUREMENT_CLIENT_CONFIG_OFFSET) ==
+                                        gatt_client_config_notification);
+    CHECK(GLUCOSE_NVM(NVM_RACP_CLIENT_CONFIG_OFFSET) ==
+                                        gatt_client_config_indication);
+
+    writes = g_host_sdk.nvm_writes;
+    disables = g_host_sdk.nvm_disables;
+    /* The entry is marked empty, then written and its sequence number */
+    addRecord(3);
+    CHECK(g_host_sdk.nvm_writes - writes <= 4);
+    CHECK(g_host_sdk.nvm_disables == disables + 1);
+
+    request(DELETE_STORED_RECORDS, ALL_RECORDS);
+    addRecords(20, 0);
+    first = firstSeqNum();
+
+    writes = g_host_sdk.nvm_writes;
+    requestSeqNumRange(DELETE_STORED_RECORDS, first + 2, first + 12);
+    CHECK(g_host_sdk.nvm_writes - writes <= 2);
+
+    restart();
+    CHECK(countAll() == 9);
+}
+
+/*----------------------------------------------------------------------------*
+ *  The user facing time filter, base time plus time offset
+ *----------------------------------------------------------------------------*/
+static void testTimeFilter(void)
+{
+    uint32 base = TEST_EPOCH;
+    uint32 user = TEST_EPOCH + RECORD_TIME_OFFSET * 60UL;
+    uint8 short_operand[] = {REPORT_NUMBER_OF_STORED_RECORDS,
+                             GREATER_THAN_OR_EQUAL_TO, USER_FACING_TIME,
+                             0xdf, 0x07, 5, 15, 15, 4};
+    uint8 before_1970[] = {REPORT_NUMBER_OF_STORED_RECORDS,
+                           GREATER_THAN_OR_EQUAL_TO, USER_FACING_TIME,
+                           0xb1, 0x07, 12, 31, 23, 59, 59};
+    uint16 first;
+    uint16 i;
+
+    freshStart();
+
+    /* One record an hour */
+    for(i = 0; i < 10; i++)
+    {
+        addRecord(base + i * 3600UL);
+    }
+    first = firstSeqNum();
+
+    requestTime(REPORT_NUMBER_OF_STORED_RECORDS, GREATER_THAN_OR_EQUAL_TO,
+                user + 5 * 3600UL);
+    CHECK(HostLinkNumOfRecords() == 5);
+
+    requestTime(REPORT_NUMBER_OF_STORED_RECORDS, LESS_THAN_OR_EQUAL_TO,
+                user + 5 * 3600UL);
+    CHECK(HostLinkNumOfRecords() == 6);
+
+    requestTimeRange(REPORT_NUMBER_OF_STORED_RECORDS,
+                     user + 2 * 3600UL, user + 4 * 3600UL);
+    CHECK(HostLinkNumOfRecords() == 3);
+
+    requestTimeRange(REPORT_NUMBER_OF_STORED_RECORDS,
+                     user + 2 * 3600UL - 1, user + 4 * 3600UL + 1);
+    CHECK(HostLinkNumOfRecords() == 3);
+
+    requestTimeRange(REPORT_STORED_RECORDS,
+                     user + 2 * 3600UL, user + 4 * 3600UL);
+    CHECK(g_host_link.num_meas == 3 && g_host_link.seq_nums[0] == first + 2);
+    CHECK(g_host_link.seq_nums[2] == first + 4);
+    CHECK(HostLinkResponseValue() == RESPONSE_CODE_SUCCESS);
+
+    requestTimeRange(REPORT_STORED_RECORDS,
+                     user + 20 * 3600UL, user + 30 * 3600UL);
+    CHECK(HostLinkResponseValue() == NO_RECORDS_FOUND);
+
+    /* Invalid operands */
+    requestTimeRange(REPORT_NUMBER_OF_STORED_RECORDS,
+                     user + 4 * 3600UL, user + 2 * 3600UL);
+    CHECK(HostLinkResponseValue() == INVALID_OPERAND);
+
+    HostLinkRequest(short_operand, sizeof(short_operand));
+    CHECK(HostLinkResponseValue() == INVALID_OPERAND);
+
+    HostLinkRequest(before_1970, sizeof(before_1970));
+    CHECK(HostLinkResponseValue() == INVALID_OPERAND);
+
+    /* Days which are not in their month, and times past 32 bits */
+    CHECK(countFromDate(2015, 4, 31, 0, 0, 0) == 0xFFFF);
+    CHECK(countFromDate(2015, 2, 29, 0, 0, 0) == 0xFFFF);
+    CHECK(countFromDate(2100, 2, 29, 0, 0, 0) == 0xFFFF);
+    CHECK(countFromDate(2106, 2, 7, 6, 28, 16) == 0xFFFF);
+    CHECK(countFromDate(2106, 12, 31, 23, 59, 59) == 0xFFFF);
+    CHECK(countFromDate(2107, 1, 1, 0, 0, 0) == 0xFFFF);
+    CHECK(countFromDate(0xFFFF, 1, 1, 0, 0, 0) == 0xFFFF);
+
+    CHECK(countFromDate(2015, 4, 30, 0, 0, 0) == 10);
+    CHECK(countFromDate(2016, 2, 29, 0, 0, 0) == 0);
+    CHECK(countFromDate(2000, 2, 29, 0, 0, 0) == 10);
+    CHECK(countFromDate(2106, 2, 7, 6, 28, 15) == 0);
+
+    /* The clock of the meter is set back: records are no longer in time
+     * order
+     */
+    addRecord(base);
+
+    requestTimeRange(REPORT_NUMBER_OF_STORED_RECORDS, user, user + 3600UL);
+    CHECK(HostLinkNumOfRecords() == 3);
+
+    requestTimeRange(REPORT_STORED_RECORDS, user, user + 3600UL);
+    CHECK(g_host_link.num_meas == 3);
+    CHECK(g_host_link.seq_nums[0] == first);
+    CHECK(g_host_link.seq_nums[1] == first + 1);
+    CHECK(g_host_link.seq_nums[2] == first + 10);
+
+    requestTime(REPORT_STORED_RECORDS, GREATER_THAN_OR_EQUAL_TO,
+                user + 8 * 3600UL);
+    CHECK(g_host_link.num_meas == 2 && g_host_link.seq_nums[0] == first + 8);
+
+    requestTimeRange(DELETE_STORED_RECORDS, user, user);
+    CHECK(countAll() == 9);
+
+    restart();
+    CHECK(countAll() == 9);
+
+    requestTime(REPORT_NUMBER_OF_STORED_RECORDS, LESS_THAN_OR_EQUAL_TO,
+                user + 3 * 3600UL);
+    CHECK(HostLinkNumOfRecords() == 3);
+
+    requestTime(DELETE_STORED_RECORDS, GREATER_THAN_OR_EQUAL_TO,
+                user + 5 * 3600UL);
+    CHECK(countAll() == 4);
+
+    request(DELETE_STORED_RECORDS, ALL_RECORDS);
+    addRecord(base);
+    addRecord(base + 60);
+    requestTimeRange(REPORT_NUMBER_OF_STORED_RECORDS, user, user + 60);
+    CHECK(HostLinkNumOfRecords() == 2);
+}
+
+/*----------------------------------------------------------------------------*
+ *  Reports of the records newer than the last sync of the collector
+ *----------------------------------------------------------------------------*/
+static void testSinceLastSync(void)
+{
+    uint8 with_operand[] = {REPORT_STORED_RECORDS, OPERATOR_SINCE_LAST_SYNC,
+                            0};
+    uint16 last;
+
+    freshStart();
+    addRecords(10, 100);
+
+    request(REPORT_NUMBER_OF_STORED_RECORDS, OPERATOR_SINCE_LAST_SYNC);
+    CHECK(HostLinkNumOfRecords() == 10);
+
+    request(REPORT_STORED_RECORDS, OPERATOR_SINCE_LAST_SYNC);
+    last = g_host_link.seq_nums[9];
+    CHECK(g_host_link.num_meas == 10 && g_gs_data.synced_seq_num == last);
+
+    request(REPORT_STORED_RECORDS, OPERATOR_SINCE_LAST_SYNC);
+    CHECK(g_host_link.num_meas == 0);
+    CHECK(HostLinkResponseValue() == NO_RECORDS_FOUND);
+    CHECK(g_gs_data.synced_seq_num == last);
+
+    addRecords(3, 200);
+    request(REPORT_NUMBER_OF_STORED_RECORDS, OPERATOR_SINCE_LAST_SYNC);
+    CHECK(HostLinkNumOfRecords() == 3 && g_gs_data.synced_seq_num == last);
+
+    request(REPORT_STORED_RECORDS, OPERATOR_SINCE_LAST_SYNC);
+    CHECK(g_host_link.num_meas == 3 && g_host_link.seq_nums[0] == last + 1);
+    CHECK(g_gs_data.synced_seq_num == last + 3);
+
+    HostLinkRequest(with_operand, sizeof(with_operand));
+    CHECK(HostLinkResponseValue() == INVALID_OPERAND);
+
+    /* Only reports reaching the newest record sync the collector */
+    addRecord(203);
+    requestSeqNumRange(REPORT_STORED_RECORDS, last, last + 1);
+    CHECK(g_host_link.num_meas == 2 && g_gs_data.synced_seq_num == last + 3);
+
+    request(REPORT_STORED_RECORDS, ALL_RECORDS);
+    CHECK(g_host_link.num_meas == 14 && g_gs_data.synced_seq_num == last + 4);
+
+    /* Sequence numbers wrap around past 0xFFFF, to the number which takes
+     * the NVM record log entry after that of 0xFFFF
+     */
+    freshStart();
+    GLUCOSE_NVM(NVM_GLUCOSE_SEQ_NUM) = 0xFFF0;
+    restart();
+    addRecords(15, 300);
+
+    request(REPORT_STORED_RECORDS, OPERATOR_SINCE_LAST_SYNC);
+    CHECK(g_host_link.num_meas == 15 && g_host_link.seq_nums[14] == 0xFFFF);
+    CHECK(g_gs_data.synced_seq_num == 0xFFFF);
+
+    request(REPORT_NUMBER_OF_STORED_RECORDS, OPERATOR_SINCE_LAST_SYNC);
+    CHECK(HostLinkNumOfRecords() == 0);
+    request(REPORT_STORED_RECORDS, OPERATOR_SINCE_LAST_SYNC);
+    CHECK(g_host_link.num_meas == 0);
+    CHECK(HostLinkResponseValue() == NO_RECORDS_FOUND);
+
+    addRecords(3, 400);
+    request(REPORT_STORED_RECORDS, OPERATOR_SINCE_LAST_SYNC);
+    CHECK(g_host_link.num_meas == 3 && g_host_link.seq_nums[0] == 16);
+    CHECK(g_gs_data.synced_seq_num == 18);
+
+    /* The records either side of the wrap are restored from NVM, those 
+     * deleted are not
+     */
+    restart();
+    CHECK(countAll() == 18);
+    CHECK(firstSeqNum() == 0xFFF1 && lastSeqNum() == 18);
+
+    request(REPORT_NUMBER_OF_STORED_RECORDS, OPERATOR_SINCE_LAST_SYNC);
+    CHECK(HostLinkNumOfRecords() == 0);
+
+    request(DELETE_STORED_RECORDS, ALL_RECORDS);
+    addRecords(2, 500);
+    restart();
+    CHECK(countAll() == 2);
+
+    /* The block reserved before the wrap ends at 0xFFFF, so the numbers 
+     * carry on past the wrap after a reset too
+     */
+    freshStart();
+    GLUCOSE_NVM(NVM_GLUCOSE_SEQ_NUM) = 0xFFF8;
+    restart();
+    addRecords(3, 600);
+    restart();
+    addRecords(1, 700);
+    CHECK(firstSeqNum() == 0xFFF9 && lastSeqNum() == 16);
+    restart();
+    CHECK(countAll() == 4 && lastSeqNum() == 16);
+}
+
+/*----------------------------------------------------------------------------*
+ *  Sequence number filters on a queue which holds records either side of
+ *  the wrap of sequence numbers
+ *----------------------------------------------------------------------------*/
+static void testSeqNumWrap(void)
+{
+    /* Without a wrap a large operand is after all the records */
+    freshStart();
+    addRecords(5, 300);
+    requestSeqNum(REPORT_STORED_RECORDS, LESS_THAN_OR_EQUAL_TO, 0xFFFF);
+    CHECK(g_host_link.num_meas == 5);
+    requestSeqNum(REPORT_STORED_RECORDS, GREATER_THAN_OR_EQUAL_TO, 65530);
+    CHECK(HostLinkResponseValue() == NO_RECORDS_FOUND);
+
+    /* 65530 to 65535, then 16 and 17 */
+    freshStart();
+    GLUCOSE_NVM(NVM_GLUCOSE_SEQ_NUM) = 65529;
+    restart();
+    addRecords(8, 400);
+    CHECK(firstSeqNum() == 65530 && lastSeqNum() == 17);
+
+    requestSeqNum(REPORT_STORED_RECORDS, LESS_THAN_OR_EQUAL_TO, 17);
+    CHECK(g_host_link.num_meas == 2);
+    CHECK(g_host_link.seq_nums[0] == 16 && g_host_link.seq_nums[1] == 17);
+
+    requestSeqNum(REPORT_NUMBER_OF_STORED_RECORDS, LESS_THAN_OR_EQUAL_TO, 17);
+    CHECK(HostLinkNumOfRecords() == 2);
+
+    requestSeqNum(REPORT_STORED_RECORDS, GREATER_THAN_OR_EQUAL_TO, 65530);
+    CHECK(g_host_link.num_meas == 6);
+    CHECK(g_host_link.seq_nums[0] == 65530 && 
+          g_host_link.seq_nums[5] == 65535);
+
+    requestSeqNum(REPORT_STORED_RECORDS, GREATER_THAN_OR_EQUAL_TO, 65533);
+    CHECK(g_host_link.num_meas == 3 && g_host_link.seq_nums[2] == 65535);
+
+    requestSeqNum(REPORT_STORED_RECORDS, GREATER_THAN_OR_EQUAL_TO, 17);
+    CHECK(g_host_link.num_meas == 1 && g_host_link.seq_nums[0] == 17);
+
+    /* Matches adjacent across the wrap form one span */
+    requestSeqNum(REPORT_STORED_RECORDS, GREATER_THAN_OR_EQUAL_TO, 16);
+    CHECK(g_host_link.num_meas == 8);
+    requestSeqNum(REPORT_STORED_RECORDS, LESS_THAN_OR_EQUAL_TO, 0xFFFF);
+    CHECK(g_host_link.num_meas == 8);
+
+    requestSeqNumRange(REPORT_STORED_RECORDS, 65531, 65533);
+    CHECK(g_host_link.num_meas == 3 && g_host_link.seq_nums[0] == 65531);
+
+    requestSeqNumRange(REPORT_STORED_RECORDS, 16, 17);
+    CHECK(g_host_link.num_meas == 2 && g_host_link.seq_nums[0] == 16);
+
+    requestSeqNumRange(REPORT_STORED_RECORDS, 18, 65529);
+    CHECK(HostLinkResponseValue() == NO_RECORDS_FOUND);
+
+    /* Deletions */
+    requestSeqNum(DELETE_STORED_RECORDS, GREATER_THAN_OR_EQUAL_TO, 65534);
+    CHECK(HostLinkResponseValue() == RESPONSE_CODE_SUCCESS);
+    requestSeqNum(DELETE_STORED_RECORDS, LESS_THAN_OR_EQUAL_TO, 16);
+    request(REPORT_STORED_RECORDS, ALL_RECORDS);
+    CHECK(g_host_link.num_meas == 5);
+    CHECK(g_host_link.seq_nums[3] == 65533 && g_host_link.seq_nums[4] == 17);
+
+    restart();
+    CHECK(countAll() == 5);
+}
+
+/*----------------------------------------------------------------------------*
+ *  Counts and reports of the same query share its result
+ *----------------------------------------------------------------------------*/
+static void testQueryResult(void)
+{
+    uint16 first;
+
+    freshStart();
+    addRecords(10, 300);
+    first = firstSeqNum();
+
+    requestSeqNum(REPORT_NUMBER_OF_STORED_RECORDS, GREATER_THAN_OR_EQUAL_TO,
+                  first + 3);
+    CHECK(HostLinkNumOfRecords() == 7);
+
+    requestSeqNum(REPORT_STORED_RECORDS, GREATER_THAN_OR_EQUAL_TO, first + 3);
+    CHECK(g_host_link.num_meas == 7 && g_host_link.seq_nums[0] == first + 3);
+
+    requestSeqNum(REPORT_NUMBER_OF_STORED_RECORDS, GREATER_THAN_OR_EQUAL_TO,
+                  first + 3);
+    CHECK(HostLinkNumOfRecords() == 7);
+
+    requestSeqNum(REPORT_NUMBER_OF_STORED_RECORDS, LESS_THAN_OR_EQUAL_TO,
+                  first + 3);
+    CHECK(HostLinkNumOfRecords() == 4);
+
+    /* A new record and a delete change the result */
+    addRecord(310);
+    requestSeqNum(REPORT_NUMBER_OF_STORED_RECORDS, GREATER_THAN_OR_EQUAL_TO,
+                  first + 3);
+    CHECK(HostLinkNumOfRecords() == 8);
+
+    requestSeqNumRange(DELETE_STORED_RECORDS, first + 5, first + 5);
+    requestSeqNum(REPORT_NUMBER_OF_STORED_RECORDS, GREATER_THAN_OR_EQUAL_TO,
+                  first + 3);
+    CHECK(HostLinkNumOfRecords() == 7);
+
+    requestSeqNum(REPORT_STORED_RECORDS, GREATER_THAN_OR_EQUAL_TO, first + 3);
+    CHECK(g_host_link.num_meas == 7);
+    CHECK(g_host_link.seq_nums[1] == first + 4);
+    CHECK(g_host_link.seq_nums[2] == first + 6);
+
+    CHECK(countAll() == 10);
+    request(DELETE_STORED_RECORDS, ALL_RECORDS);
+    CHECK(countAll() == 0);
+}
+
+/*----------------------------------------------------------------------------*
+ *  Deletes run in time slices, and aborts of them
+ *----------------------------------------------------------------------------*/
+static void testSlicedDelete(void)
+{
+    uint8 delete_range[7] = {DELETE_STORED_RECORDS, WITHIN_RANGE_OF,
+                             SEQUENCE_NUMBER};
+    uint8 report_all[] = {REPORT_STORED_RECORDS, ALL_RECORDS};
+    uint8 abort_op[] = {ABORT_OPERATION, OPERATOR_NULL};
+    uint8 delete_time[3 + 2 * DATE_TIME_LEN];
+    uint16 indications;
+    uint16 first;
+    uint32 user;
+
+    freshStart();
+    addRecords(50, 400);
+    first = firstSeqNum();
+
+    delete_range[3] = LE8_L(first);
+    delete_range[4] = LE8_H(first);
+    delete_range[5] = LE8_L(first + 49);
+    delete_range[6] = LE8_H(first + 49);
+
+    /* The response waits for the last slice, a record added meanwhile is
+     * kept
+     */
+    indications = g_host_link.indications;
+    HostLinkWrite(HANDLE_RECORD_ACCESS_CONTROL_POINT, delete_range, 7);
+    CHECK(g_host_link.indications == indications);
+    addRecord(500);
+    HostLinkRun();
+    HostLinkConfirmIndication();
+    CHECK(g_host_link.indications == indications + 1);
+    CHECK(HostLinkResponseValue() == RESPONSE_CODE_SUCCESS);
+    CHECK(countAll() == 1);
+
+    /* An abort stops the delete after its first slice */
+    request(DELETE_STORED_RECORDS, ALL_RECORDS);
+    addRecords(50, 600);
+    first = firstSeqNum();
+
+    delete_range[3] = LE8_L(first);
+    delete_range[4] = LE8_H(first);
+    delete_range[5] = LE8_L(first + 49);
+    delete_range[6] = LE8_H(first + 49);
+
+    indications = g_host_link.indications;
+    HostLinkWrite(HANDLE_RECORD_ACCESS_CONTROL_POINT, delete_range, 7);
+    HostLinkWrite(HANDLE_RECORD_ACCESS_CONTROL_POINT, abort_op, 2);
+    CHECK(g_host_link.indications == indications + 1);
+    CHECK(g_host_link.response[2] == ABORT_OPERATION);
+    CHECK(HostLinkResponseValue() == RESPONSE_CODE_SUCCESS);
+    CHECK(!serviceTimerRunning());
+    HostLinkRun();
+    HostLinkConfirmIndication();
+    CHECK(g_host_link.indications == indications + 1);
+    CHECK(countAll() == 42);
+    CHECK(firstSeqNum() == first + 8);
+
+    /* An abort of a report takes effect straight away */
+    HostLinkClearReceived();
+    indications = g_host_link.indications;
+    HostLinkWrite(HANDLE_RECORD_ACCESS_CONTROL_POINT, report_all, 2);
+    CHECK(g_host_link.num_meas == 1 && g_gs_data.bulk_transfer);
+    HostLinkWrite(HANDLE_RECORD_ACCESS_CONTROL_POINT, abort_op, 2);
+    CHECK(g_host_link.indications == indications + 1);
+    CHECK(!g_gs_data.bulk_transfer && !g_host_link.radio_events);
+    HostLinkRun();
+    HostLinkConfirmIndication();
+    CHECK(g_host_link.num_meas == 1);
+    CHECK(countAll() == 42);
+
+    /* A reconnection finishes a delete in progress */
+    HostLinkWrite(HANDLE_RECORD_ACCESS_CONTROL_POINT, delete_range, 7);
+    GlucoseDataInit();
+    CHECK(!serviceTimerRunning());
+    CHECK(countAll() == 0);
+
+    /* A record added to a full store while the oldest records are being 
+     * deleted takes the place of a deleted one, and is not deleted itself
+     */
+    freshStart();
+    addRecords(MAX_RECORDS, 700);
+    first = firstSeqNum();
+
+    delete_range[3] = LE8_L(first);
+    delete_range[4] = LE8_H(first);
+    delete_range[5] = LE8_L(first + 15);
+    delete_range[6] = LE8_H(first + 15);
+
+    HostLinkWrite(HANDLE_RECORD_ACCESS_CONTROL_POINT, delete_range, 7);
+    addRecord(800);
+    HostLinkRun();
+    HostLinkConfirmIndication();
+    CHECK(HostLinkResponseValue() == RESPONSE_CODE_SUCCESS);
+    CHECK(countAll() == MAX_RECORDS - 15);
+    CHECK(firstSeqNum() == first + 16 && lastSeqNum() == first + MAX_RECORDS);
+
+    addRecords(16, 900);
+    CHECK(countAll() == MAX_RECORDS);
+    request(REPORT_STORED_RECORDS, ALL_RECORDS);
+    CHECK(g_host_link.num_meas == MAX_RECORDS);
+
+    /* A delete of the records either side of the wrap of sequence numbers, 
+     * 65526 to 65535 and 16 to 35, while new records overwrite the oldest
+     * ones
+     */
+    freshStart();
+    GLUCOSE_NVM(NVM_GLUCOSE_SEQ_NUM) = 65515;
+    restart();
+    addRecords(MAX_RECORDS, 1000);
+    CHECK(firstSeqNum() == 65516);
+
+    user = 1000 + RECORD_TIME_OFFSET * 60UL;
+    delete_time[0] = DELETE_STORED_RECORDS;
+    delete_time[1] = WITHIN_RANGE_OF;
+    delete_time[2] = USER_FACING_TIME;
+    encodeDateTime(&delete_time[3], user + 10);
+    encodeDateTime(&delete_time[3 + DATE_TIME_LEN], user + 39);
+
+    HostLinkWrite(HANDLE_RECORD_ACCESS_CONTROL_POINT, delete_time,
+                  sizeof(delete_time));
+    addRecords(12, 5000);
+    HostLinkRun();
+    HostLinkConfirmIndication();
+    CHECK(HostLinkResponseValue() == RESPONSE_CODE_SUCCESS);
+    CHECK(countAll() == MAX_RECORDS - 28);
+
+    /* 20 records of the store were before the wrap */
+    CHECK(firstSeqNum() == 36);
+    CHECK(lastSeqNum() == 16 + (MAX_RECORDS - 20) + 12 - 1);
+}
+
+/*----------------------------------------------------------------------------*
+ *  The bulk transfer parameters of a report are not requested while the
+ *  timer of the connection parameter update procedure runs, and requests
+ *  rejected by the collector are not sent again for each report
+ *----------------------------------------------------------------------------*/
+static void testConnParamBackOff(void)
+{
+    uint16 i;
+
+    /* The parameters of the link do not comply, a request is due on the
+     * timer started on encryption
+     */
+    freshStart();
+    g_host_link.reject_param_updates = TRUE;
+    addRecords(20, 1000);
+
+    request(REPORT_STORED_RECORDS, ALL_RECORDS);
+    CHECK(g_host_link.num_meas == 20 && !g_gs_data.bulk_transfer);
+    CHECK(g_host_link.param_update_reqs == 0);
+
+    for(i = 1; i <= MAX_NUM_CONN_PARAM_UPDATE_REQS; i++)
+    {
+        runConnParamTimer();
+        CHECK(g_host_link.param_update_reqs == i);
+        CHECK(g_host_link.params.con_min_interval ==
+              PREFERRED_MIN_CON_INTERVAL);
+
+        /* Rejected, the request is sent again after Tgap(conn_param_timeout)
+         * only
+         */
+        request(REPORT_STORED_RECORDS, ALL_RECORDS);
+        CHECK(g_host_link.num_meas == 20);
+        CHECK(g_host_link.param_update_reqs == i);
+    }
+
+    /* The collector is not asked again on this connection */
+    CHECK(g_gs_data.conn_param_update_tid == TIMER_INVALID);
+    request(REPORT_STORED_RECORDS, ALL_RECORDS);
+    CHECK(g_host_link.param_update_reqs == MAX_NUM_CONN_PARAM_UPDATE_REQS);
+
+    g_host_link.reject_param_updates = FALSE;
+}
+
+/*============================================================================*
+ *  Public Function Implementations
+ *============================================================================*/
+
+int main(void)
+{
+    testReport();
+    testReportWhileAdding();
+    testDelete();
+    testAbort();
+    testFullStore();
+    testRecordValue();
+    testNvmRestore();
+    testNvmPowerLoss();
+    testNvmWrites();
+    testTimeFilter();
+    testSinceLastSync();
+    testSeqNumWrap();
+    testQueryResult();
+    testSlicedDelete();
+    testConnParamBackOff();
+
+    CHECK(!g_gs_data.bulk_transfer);
+
+    return HOST_TEST_RESULT("test_racp");
+}
@@ -20,6 +20,7 @@
 #include <pio.h>
 #include <nvm.h>
 #include <i2c.h>
+#include <mem.h>
 
 /*============================================================================*
  *  Local Header Files
@@ -27,6 +28,76 @@
 
 #include "nvm_access.h"
 
+/*============================================================================*
+ *  Private Data Types
+ *============================================================================*/
+
+/* NVM transaction data type. Within a transaction the NVM is kept enabled 
+ * and the writes are staged, adjacent or overlapping writes being merged 
+ * into a single NVM write.
+ */
+typedef struct
+{
+    /* Number of nested transactions in progress */
+    uint16                              depth;
+
+    /* Word offset and length of the staged write */
+    uint16                              offset;
+    uint16                              length;
+
+    /* Words of the staged write */
+    uint16                              words[NVM_TRANSACTION_MAX_WORDS];
+
+} NVM_TRANSACTION_T;
+
+/*============================================================================*
+ *  Private Data
+ *============================================================================*/
+
+/* NVM transaction data */
+static NVM_TRANSACTION_T g_nvm_transaction;
+
+/*============================================================================*
+ *  Private Function Prototypes
+ *============================================================================*/
+
+/* This function writes the staged words to the NVM */
+static void flushStagedWrite(void);
+
+/*============================================================================*
+ *  Private Function Implementations
+ *============================================================================*/
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      flushStagedWrite
+ *
+ *  DESCRIPTION
+ *      This function writes the words staged by the NVM transaction to the 
+ *      NVM. The NVM is left enabled.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+static void flushStagedWrite(void)
+{
+    sys_status result;
+
+    if(g_nvm_transaction.length)
+    {
+        result = NvmWrite(g_nvm_transaction.words, g_nvm_transaction.length,
+                          g_nvm_transaction.offset);
+        g_nvm_transaction.length = 0;
+
+        /* If NvmWrite fails, report panic */
+        if(sys_status_success != result)
+        {
+            Nvm_Disable();
+            ReportPanic(app_panic_nvm_write);
+        }
+    }
+}
 
 /*============================================================================*
  *  Public Function Implementations
@@ -73,10 +144,25 @@ extern void Nvm_Disable(void)
 extern void Nvm_Read(uint16* buffer, uint16 length, uint16 offset)
 {
     sys_status result;
+
+    /* The read has to return the words written earlier in the transaction */
+    if(g_nvm_transaction.length &&
+       offset < g_nvm_transaction.offset + g_nvm_transaction.length &&
+       g_nvm_transaction.offset < offset + length)
+    {
+        flushStagedWrite();
+    }
+
     /* NvmRead automatically enables the NVM before reading */
     result = NvmRead(buffer, length, offset);
-    /* Disable NVM after reading/writing */
-    Nvm_Disable();
+
+    /* Disable NVM after reading/writing unless a transaction is in 
+     * progress
+     */
+    if(!g_nvm_transaction.depth)
+    {
+        Nvm_Disable();
+    }
 
     /* If NvmRead fails, report panic */
     if(sys_status_success != result)
@@ -107,10 +193,50 @@ extern void Nvm_Read(uint16* buffer, uint16 length, uint16 offset)
 extern void Nvm_Write(uint16* buffer, uint16 length, uint16 offset)
 {
     sys_status result;
-    /* NvmWrite automatically enables the NVM before writing */
-    result = NvmWrite(buffer, length, offset);
-    /* Disable NVM after reading/writing */
-    Nvm_Disable();
+
+    if(g_nvm_transaction.depth)
+    {
+        /* Merge the write with the staged one if it starts inside it or 
+         * right after it and the result fits in the staging buffer.
+         */
+        if(!g_nvm_transaction.length ||
+           offset < g_nvm_transaction.offset ||
+           offset > g_nvm_transaction.offset + g_nvm_transaction.length ||
+           offset + length > 
+                g_nvm_transaction.offset + NVM_TRANSACTION_MAX_WORDS)
+        {
+            flushStagedWrite();
+            g_nvm_transaction.offset = offset;
+        }
+
+        if(length > NVM_TRANSACTION_MAX_WORDS)
+        {
+            /* Too long to be staged, write it straight away */
+            result = NvmWrite(buffer, length, offset);
+        }
+        else
+        {
+            MemCopy(&g_nvm_transaction.words[offset - 
+                                             g_nvm_transaction.offset],
+                    buffer, length);
+
+            if(offset + length > 
+                    g_nvm_transaction.offset + g_nvm_transaction.length)
+            {
+                g_nvm_transaction.length = 
+                                offset + length - g_nvm_transaction.offset;
+            }
+
+            result = sys_status_success;
+        }
+    }
+    else
+    {
+        /* NvmWrite automatically enables the NVM before writing */
+        result = NvmWrite(buffer, length, offset);
+        /* Disable NVM after reading/writing */
+        Nvm_Disable();
+    }
 
     /* If NvmWrite fails, report panic */
     if(sys_status_success != result)
@@ -118,3 +244,47 @@ extern void Nvm_Write(uint16* buffer, uint16 length, uint16 offset)
         ReportPanic(app_panic_nvm_write);
     }
 }
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      Nvm_BeginTransaction
+ *
+ *  DESCRIPTION
+ *      Start a batch of NVM reads and writes. The NVM stays enabled until 
+ *      the batch is committed and the writes are staged, so that runs of 
+ *      adjacent writes reach the NVM as a single write. Transactions may be 
+ *      nested, only the outermost commit completes the batch.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+
+extern void Nvm_BeginTransaction(void)
+{
+    g_nvm_transaction.depth++;
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      Nvm_CommitTransaction
+ *
+ *  DESCRIPTION
+ *      Complete a batch of NVM reads and writes. The staged writes are 
+ *      written to the NVM and the NVM is disabled.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+
+extern void Nvm_CommitTransaction(void)
+{
+    if(g_nvm_transaction.depth && --g_nvm_transaction.depth == 0)
+    {
+        flushStagedWrite();
+
+        /* Disable NVM after reading/writing */
+        Nvm_Disable();
+    }
+}
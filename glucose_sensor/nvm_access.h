@@ -25,6 +25,25 @@
  *============================================================================*/
 #include "app_gatt.h"
 
+/*============================================================================*
+ *  Public Definitions
+ *============================================================================*/
+
+/* Maximum number of words of adjacent writes merged into one NVM write in 
+ * an NVM transaction
+ */
+#define NVM_TRANSACTION_MAX_WORDS                   (32)
+
+/* Number of words taken by 'x' and by an array of 'n' uint8, for the 
+ * lengths of the NVM and memory functions which are in words. On the XAP 
+ * sizeof counts words and a uint8 takes a whole word. A build for a target
+ * with octet addressing defines them before including this file.
+ */
+#ifndef SIZEOF_WORDS
+#define SIZEOF_WORDS(x)                             (sizeof(x))
+#define UINT8_ARRAY_WORDS(n)                        (n)
+#endif /* SIZEOF_WORDS */
+
 /*============================================================================*
  *  Public Function Prototypes
  *============================================================================*/
@@ -40,4 +59,10 @@ extern void Nvm_Read(uint16* buffer, uint16 length, uint16 offset);
 /* Write words to the NVM store after preparing the NVM to be writable */
 extern void Nvm_Write(uint16* buffer, uint16 length, uint16 offset);
 
+/* Start a batch of NVM reads and writes which keeps the NVM enabled */
+extern void Nvm_BeginTransaction(void);
+
+/* Complete a batch of NVM reads and writes and disable the NVM */
+extern void Nvm_CommitTransaction(void);
+
 #endif /* _NVM_ACCESS_H_ */
\ No newline at end of file
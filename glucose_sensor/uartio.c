@@ -16,6 +16,8 @@
  *============================================================================*/
 
 #include <uart.h>           /* Functions to interface with the chip's UART */
+#include <mem.h>            /* Memory library */
+#include <timer.h>          /* Chip timer functions */
 
 /*============================================================================*
  *  Local Header Files
@@ -24,16 +26,160 @@
 #include "uartio.h"         /* Header file to this source file */
 #include "byte_queue.h"     /* Byte queue API */
 #include "glucose_sensor.h"
+#include "nvm_access.h"     /* Non-volatile memory access */
 #include <string.h>
 #include <time.h> 
 
 
 
-#define READ_SERIAL_NO 0
-#define READ_RECORD_NO 1
-#define READ_RECORDS 2
-#define SEND_ACK 3
-#define CRC_SEED 0xFFFF
+/* Meter protocol framing */
+#define METER_STX                   (0x02)
+#define METER_ETX                   (0x03)
+#define METER_ACK_FRAME_LEN         (6)
+#define METER_MIN_FRAME_LEN         (METER_ACK_FRAME_LEN)
+#define METER_MAX_FRAME_LEN         (32)
+#define METER_CRC_LEN               (2)
+
+/* Offset of the data in a reply frame of the meter, after STX, length, link,
+ * 0x05 and the command
+ */
+#define METER_REPLY_DATA_OFFSET     (5)
+#define METER_SERIAL_NO_LEN         (9)
+
+/* Frames of 'a', 'b', 'c', 2 octets of result and 4 octets of time in 
+ * seconds since 1970, all big endian
+ */
+#define ARDUINO_FRAME_LEN           (9)
+
+/* Time to wait for the reply of the meter before resending a request */
+#define METER_REPLY_TIMEOUT         (500 * MILLISECOND)
+
+/* Number of times a request is resent before the download is given up */
+#define METER_MAX_RETRIES           (3)
+
+/* Length of the record request after its constant head */
+#define READ_RECORD_TAIL_LEN        (5)
+
+/* CRC of the constant head of the record request */
+#define READ_RECORD_HEAD_CRC        (0x785F)
+
+/* Invalid record index */
+#define METER_INVALID_RECORD_IDX    (0xFFFF)
+
+/* The offset of data being stored in NVM for the meter link. This offset is
+ * added to the meter link offset to NVM region (see g_meter_data.nvm_offset)
+ * to get the absolute offset at which this data is stored in NVM
+ */
+
+/* Serial number of the meter downloaded from */
+#define METER_NVM_SERIAL_NO_OFFSET  (0)
+
+/* Time of the newest record downloaded, two words */
+#define METER_NVM_LAST_EPOCH_OFFSET (METER_NVM_SERIAL_NO_OFFSET + \
+                                     METER_SERIAL_NO_LEN)
+
+/* Number of meter records up to and including the newest record downloaded */
+#define METER_NVM_SYNCED_OFFSET     (METER_NVM_LAST_EPOCH_OFFSET + 2)
+
+/* Number of words of NVM memory used by the meter link */
+#define METER_NVM_MEMORY_WORDS      (METER_NVM_SYNCED_OFFSET + 1)
+
+/*============================================================================*
+ *  Private Data Types
+ *============================================================================*/
+
+/* Meter link states */
+typedef enum
+{
+    /* No request in progress */
+    meter_state_idle = 0,
+
+    /* Waiting for the serial number of the meter */
+    meter_state_read_serial_no,
+
+    /* Waiting for the number of records stored in the meter */
+    meter_state_read_no_of_records,
+
+    /* Waiting for a record probed to find the new records */
+    meter_state_find_record,
+
+    /* Waiting for a record of the meter */
+    meter_state_read_record
+
+} meter_state;
+
+/* Meter link data type */
+typedef struct
+{
+    /* Current state of the meter link */
+    meter_state                         state;
+
+    /* Timer for the reply of the meter */
+    timer_id                            reply_tid;
+
+    /* Number of times the current request has been resent */
+    uint16                              retries;
+
+    /* Number of records stored in the meter */
+    uint16                              no_of_records;
+
+    /* Index of the record being read, 0 being the newest */
+    uint16                              record_idx;
+
+    /* Range of indices in which the newest record downloaded before is 
+     * being searched
+     */
+    uint16                              search_lo;
+    uint16                              search_hi;
+
+    /* Time of the newest record downloaded, 0 if none */
+    uint32                              last_epoch;
+
+    /* Number of meter records up to and including the newest record 
+     * downloaded, i.e. the meter index of that record plus one when the 
+     * meter held 'synced_count' records
+     */
+    uint16                              synced_count;
+
+    /* Index at which the newest record downloaded is expected, probed 
+     * first when searching for the new records
+     */
+    uint16                              guess_idx;
+
+    /* NVM offset at which the meter link data is stored */
+    uint16                              nvm_offset;
+
+    /* Link bit of the next record ACK */
+    bool                                ack_odd;
+
+    /* Serial number of the meter */
+    uint8                               serial_no[METER_SERIAL_NO_LEN];
+
+    /* Frame being received and its length so far */
+    uint8                               rx_frame[METER_MAX_FRAME_LEN];
+    uint16                              rx_len;
+
+    /* CRC of the first 'rx_crc_len' bytes of the frame being received, 
+     * accumulated as the bytes arrive
+     */
+    uint16                              rx_crc;
+    uint16                              rx_crc_len;
+
+} METER_DATA_T;
+
+/* Date of the last day converted by calcDate */
+typedef struct
+{
+    /* TRUE once a day has been converted */
+    bool                                valid;
+
+    /* Days since 1970 */
+    uint16                              day;
+
+    /* Date fields of that day */
+    TIME_UNIX_CONV                      date;
+
+} DATE_CACHE_T;
 
 /*============================================================================*
  *  Private Data
@@ -50,6 +196,40 @@ UART_DECLARE_BUFFER(rx_buffer, UART_BUF_SIZE_BYTES_64);
 /* Create 64-byte transmit buffer for UART data */
 UART_DECLARE_BUFFER(tx_buffer, UART_BUF_SIZE_BYTES_64);
 
+/* Meter link data */
+static METER_DATA_T g_meter_data;
+
+/* Date of the last day converted, consecutive records mostly share it */
+static DATE_CACHE_T g_date_cache;
+
+/* Constant request frames of the meter, with their CRCs */
+static const uint8 read_serial_no_frame[] =
+{
+    0x02, 0x12, 0x00, 0x05, 0x0B, 0x02, 0x00, 0x00, 0x00, 0x00, 0x84, 0x6A,
+    0xE8, 0x73, 0x00, 0x03, 0x9B, 0xEA
+};
+
+static const uint8 read_no_of_records_frame[] =
+{
+    0x02, 0x0A, 0x00, 0x05, 0x1F, 0xF5, 0x01, 0x03, 0x38, 0xAA
+};
+
+static const uint8 ack_odd_frame[METER_ACK_FRAME_LEN] =
+{
+    0x02, 0x06, 0x07, 0x03, 0xFC, 0x72
+};
+
+static const uint8 ack_even_frame[METER_ACK_FRAME_LEN] =
+{
+    0x02, 0x06, 0x04, 0x03, 0xAF, 0x27
+};
+
+/* Head of the record request, followed by the record index, ETX and CRC */
+static const uint8 read_record_head[] =
+{
+    0x02, 0x0A, 0x03, 0x05, 0x1F
+};
+
 /*============================================================================*
  *  Private Function Prototypes
  *============================================================================*/
@@ -65,29 +245,48 @@ static void uartTxDataCallback(void);
 /* Transmit waiting data over UART */
 static void sendPendingData(void);
 
-/* Transmit the sleep state over UART */
-static void protocolHandler(void);
-static TIME_UNIX_CONV timeMeter;
-static uint8 rxflag=0;
-static uint16 recordNo=0;
-//static uint16 recordToRead=0x0000;
-static uint8 status=0;
-static bool error=FALSE;
-//static bool finishedReading=FALSE;
-static bool ackFlag=TRUE;
-//static uint8 serialNoArrayCRC[15];
-//static uint8 serialNoArray[9];
-//static uint8 noOfRecordsArrayCRC[8];
-//static uint8 noOfRecordsArray[2];
-//static uint8 recordsArrayCRC[14];
-static uint8 buffer[9];
-//static uint8 recordsArray[8];
+/* Return the length of the frame being received */
+static uint16 rxFrameLength(void);
+
+/* Restart the frame being received at its next possible start */
+static void rxResync(void);
+
+/* Add the received bytes covered by the CRC to the CRC of the frame */
+static void rxCrcUpdate(void);
+
+/* Validate and hand on the frame being received once it is complete */
+static bool rxFrameComplete(void);
+
+/* Add received bytes to the frame being received */
+static uint16 meterRxData(const uint8 *p_data, uint16 length);
+
+/* Return the number of bytes needed to complete the frame being received */
+static uint16 meterRxNeeded(void);
+
+/* Handle a frame received from the Arduino */
+static void handleArduinoFrame(const uint8 *frame);
+
+/* Handle a frame received from the meter */
+static void handleMeterFrame(const uint8 *frame, uint16 length);
+
+/* Move the meter link to a new state and send its request */
+static void meterSetState(meter_state new_state);
+
+/* Send the request of the current state and wait for the reply */
+static void sendMeterRequest(void);
+
+/* Resend the request when the meter has not replied */
+static void meterReplyTimerHandler(timer_id tid);
+
+/* Write the sync high-water mark to NVM */
+static void meterWriteSyncToNvm(void);
+
+/* Queue the requests of the meter and the ACK of its replies */
 static void readSerialNo(void);
 static void sendAck(bool odd);
 static void readNoOfRecords(void);
-static void readRecords(/*uint16 startRecord,*/uint16 noOfRecords );
-void AddGlucoseMeasData(uint16 result);
-void calcDate(TIME_UNIX_CONV  *tm,uint32 meterEpoch);
+static void readRecords(uint16 recordIdx);
+void AddGlucoseMeasData(uint16 result, uint32 epoch);
 
 /*============================================================================*
  *  Private Function Implementations
@@ -110,192 +309,813 @@ void calcDate(TIME_UNIX_CONV  *tm,uint32 meterEpoch);
  *      length [in]        Number of bytes ('unpacked') or words ('packed')
  *                         received
  *
- *      p_additional_req_data_length [out]
- *                         Number of additional bytes ('unpacked') or words
- *                         ('packed') this application wishes to receive
+ *      p_additional_req_data_length [out]
+ *                         Number of additional bytes ('unpacked') or words
+ *                         ('packed') this application wishes to receive
+ *
+ * RETURNS
+ *      The number of bytes ('unpacked') or words ('packed') that have been
+ *      processed out of the available data.
+ *----------------------------------------------------------------------------*/
+static uint16 uartRxDataCallback(void   *p_rx_buffer,
+                                 uint16  length,
+                                 uint16 *p_additional_req_data_length)
+{
+    uint16 used = 0;
+
+    while(used < length)
+    {
+        used += meterRxData((const uint8 *)p_rx_buffer + used, 
+                            length - used);
+    }
+
+    /* Inform the UART driver how many bytes are needed to complete the 
+     * frame, so that the callback is called once per frame rather than 
+     * once per byte
+     */
+    *p_additional_req_data_length = meterRxNeeded();
+    
+    /* Return the number of bytes that have been processed */
+    return length;
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      uartTxDataCallback
+ *
+ *  DESCRIPTION
+ *      This is an internal callback function (of type uart_data_out_fn) that
+ *      will be called by the UART driver when data transmission over the UART
+ *      is finished. See DebugInit in the Firmware Library documentation for
+ *      details.
+ *
+ * PARAMETERS
+ *      None
+ *
+ * RETURNS
+ *      Nothing
+ *----------------------------------------------------------------------------*/
+static void uartTxDataCallback(void)
+{
+    /* Send any pending data waiting to be sent */
+    sendPendingData();
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      sendPendingData
+ *
+ *  DESCRIPTION
+ *      Send buffered data over UART that was waiting to be sent.
+ *
+ * PARAMETERS
+ *      None
+ *
+ * RETURNS
+ *      Nothing
+ *----------------------------------------------------------------------------*/
+static void sendPendingData(void)
+{
+    /* Loop until the byte queue is empty */
+    while (BQGetDataSize() > 0)
+    {
+        uint8 byte = '\0';
+        
+        /* Read the next byte in the queue */
+        if (BQPeekBytes(&byte, 1) > 0)
+        {
+            /* Frames are binary, send the byte as it is */
+            bool ok_to_commit = UartWrite(&byte, 1);
+
+            if (ok_to_commit)
+            {
+                /* Now that UART driver has accepted this data
+                 * remove the data from the buffer
+                 */
+                BQCommitLastPeek();
+            }
+            else
+            {
+                /* If UART doesn't have enough space available to accommodate
+                 * this data, postpone sending data and leave it in the buffer
+                 * to try again later.
+                 */
+                break;
+            }
+        }
+        else
+        {
+            /* Couldn't read data for some reason. Postpone sending data and
+             * try again later.
+            */
+            break;
+        }
+    }
+}
+
+
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      rxFrameLength
+ *
+ *  DESCRIPTION
+ *      Return the length of the frame being received, or 0 if it is not 
+ *      known yet. Meter frames start with STX followed by the frame length,
+ *      Arduino frames start with 'a' and have a fixed length.
+ *
+ * PARAMETERS
+ *      None
+ *
+ * RETURNS
+ *      Length of the frame being received
+ *----------------------------------------------------------------------------*/
+static uint16 rxFrameLength(void)
+{
+    if(g_meter_data.rx_len == 0)
+    {
+        return 0;
+    }
+
+    if(g_meter_data.rx_frame[0] == 'a')
+    {
+        return ARDUINO_FRAME_LEN;
+    }
+
+    return (g_meter_data.rx_len < 2) ? 0 : g_meter_data.rx_frame[1];
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      rxResync
+ *
+ *  DESCRIPTION
+ *      Drop the first byte of the frame being received and restart the 
+ *      frame at the next byte which can start a frame, so that a frame 
+ *      following garbage is not lost.
+ *
+ * PARAMETERS
+ *      None
+ *
+ * RETURNS
+ *      Nothing
+ *----------------------------------------------------------------------------*/
+static void rxResync(void)
+{
+    uint8 *frame = g_meter_data.rx_frame;
+    uint16 i;
+
+    for(i = 1; i < g_meter_data.rx_len; i++)
+    {
+        if(frame[i] == METER_STX || frame[i] == 'a')
+        {
+            break;
+        }
+    }
+
+    g_meter_data.rx_len -= i;
+    MemCopy(frame, frame + i, g_meter_data.rx_len);
+
+    /* The CRC of the new frame is accumulated again */
+    g_meter_data.rx_crc_len = 0;
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      rxCrcUpdate
+ *
+ *  DESCRIPTION
+ *      Add the bytes received since the last call to the CRC of the frame 
+ *      being received, up to the CRC field of the frame.
+ *
+ * PARAMETERS
+ *      None
+ *
+ * RETURNS
+ *      Nothing
+ *----------------------------------------------------------------------------*/
+static void rxCrcUpdate(void)
+{
+    uint16 frame_len = rxFrameLength();
+    uint16 end = g_meter_data.rx_len;
+
+    if(frame_len > METER_CRC_LEN && end > frame_len - METER_CRC_LEN)
+    {
+        end = frame_len - METER_CRC_LEN;
+    }
+
+    if(g_meter_data.rx_crc_len == 0)
+    {
+        g_meter_data.rx_crc = CRC_CCITT_SEED;
+    }
+
+    if(end > g_meter_data.rx_crc_len)
+    {
+        g_meter_data.rx_crc = crc_calculate_crc(g_meter_data.rx_crc,
+                            g_meter_data.rx_frame + g_meter_data.rx_crc_len,
+                            end - g_meter_data.rx_crc_len);
+        g_meter_data.rx_crc_len = end;
+    }
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      rxFrameComplete
+ *
+ *  DESCRIPTION
+ *      Check the frame being received. A complete frame is validated and 
+ *      handed to the protocol layer, an invalid one is dropped.
+ *
+ * PARAMETERS
+ *      None
+ *
+ * RETURNS
+ *      TRUE if more bytes are needed to complete the frame
+ *----------------------------------------------------------------------------*/
+static bool rxFrameComplete(void)
+{
+    uint8 *frame = g_meter_data.rx_frame;
+    uint16 frame_len = rxFrameLength();
+    uint16 crc;
+
+    if(frame_len == 0)
+    {
+        return FALSE;
+    }
+
+    if(frame[0] == METER_STX &&
+       (frame_len < METER_MIN_FRAME_LEN || frame_len > METER_MAX_FRAME_LEN))
+    {
+        /* Not a valid frame length */
+        rxResync();
+        return TRUE;
+    }
+
+    if(g_meter_data.rx_len < frame_len)
+    {
+        return FALSE;
+    }
+
+    if(frame[0] == 'a')
+    {
+        if(frame[1] != 'b' || frame[2] != 'c')
+        {
+            rxResync();
+            return TRUE;
+        }
+
+        g_meter_data.rx_len = 0;
+        g_meter_data.rx_crc_len = 0;
+        handleArduinoFrame(frame);
+        return TRUE;
+    }
+
+    /* Only the bytes received last are left to add to the CRC */
+    rxCrcUpdate();
+    crc = g_meter_data.rx_crc;
+
+    if(frame[frame_len - METER_CRC_LEN - 1] != METER_ETX ||
+       frame[frame_len - 2] != (uint8)(crc & 0xff) ||
+       frame[frame_len - 1] != (uint8)(crc >> 8))
+    {
+        /* The request is resent when the reply timer expires */
+        rxResync();
+        return TRUE;
+    }
+
+    g_meter_data.rx_len = 0;
+    g_meter_data.rx_crc_len = 0;
+    handleMeterFrame(frame, frame_len);
+    return TRUE;
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      meterRxData
+ *
+ *  DESCRIPTION
+ *      Add received bytes to the frame being received. Bytes outside a 
+ *      frame are skipped, the rest are copied up to the end of the frame.
+ *
+ * PARAMETERS
+ *      p_data [in]        Received bytes
+ *      length [in]        Number of received bytes
+ *
+ * RETURNS
+ *      Number of bytes consumed
+ *----------------------------------------------------------------------------*/
+static uint16 meterRxData(const uint8 *p_data, uint16 length)
+{
+    uint16 used = 0;
+    uint16 needed;
+
+    if(g_meter_data.rx_len == 0)
+    {
+        /* Hunt for the start of a frame */
+        while(used < length && p_data[used] != METER_STX &&
+              p_data[used] != 'a')
+        {
+            used++;
+        }
+
+        if(used == length)
+        {
+            return used;
+        }
+    }
+
+    needed = meterRxNeeded();
+    if(needed > length - used)
+    {
+        needed = length - used;
+    }
+
+    MemCopy(g_meter_data.rx_frame + g_meter_data.rx_len, p_data + used,
+            needed);
+    g_meter_data.rx_len += needed;
+    used += needed;
+
+    /* Add the bytes to the CRC while they are at hand */
+    rxCrcUpdate();
+
+    /* Handle the frame, and any frame left by a resync */
+    while(rxFrameComplete())
+        ;
+
+    return used;
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      meterRxNeeded
+ *
+ *  DESCRIPTION
+ *      Return the number of bytes needed to complete the header or the body
+ *      of the frame being received.
+ *
+ * PARAMETERS
+ *      None
+ *
+ * RETURNS
+ *      Number of bytes needed, at least 1
+ *----------------------------------------------------------------------------*/
+static uint16 meterRxNeeded(void)
+{
+    uint16 frame_len = rxFrameLength();
+
+    if(frame_len == 0)
+    {
+        /* Start byte or length byte */
+        return 1;
+    }
+
+    return frame_len - g_meter_data.rx_len;
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      handleArduinoFrame
+ *
+ *  DESCRIPTION
+ *      Handle a frame received from the Arduino. The frame is echoed and 
+ *      its measurement is stored.
+ *
+ * PARAMETERS
+ *      frame [in]         Frame of ARDUINO_FRAME_LEN bytes
+ *
+ * RETURNS
+ *      Nothing
+ *----------------------------------------------------------------------------*/
+static void handleArduinoFrame(const uint8 *frame)
+{
+    uint16 result;
+    uint32 dateTime;
+
+    result = (uint16)(frame[4] | (frame[3] << 8));
+    dateTime = ((uint32)frame[5] << 24) | ((uint32)frame[6] << 16) |
+               ((uint32)frame[7] << 8) | (uint32)frame[8];
+
+    /* Echo the frame */
+    BQForceQueueBytes(frame, ARDUINO_FRAME_LEN);
+    sendPendingData();
+
+    AddGlucoseMeasData(result, dateTime);
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      handleMeterFrame
+ *
+ *  DESCRIPTION
+ *      Handle a valid frame received from the meter. The meter acknowledges
+ *      each request before it replies. A reply is acknowledged and the ACK 
+ *      is sent together with the next request, so that the meter prepares
+ *      the next record while the current one is being stored.
+ *
+ *      Records are fetched oldest first, the meter numbering its records 
+ *      from the newest. When records have been downloaded before, the 
+ *      records newer than the last one downloaded are found by probing 
+ *      records at growing distances from the newest one and then bisecting,
+ *      so that only the new records are fetched.
+ *
+ * PARAMETERS
+ *      frame [in]         Frame including STX, ETX and CRC
+ *      length [in]        Length of the frame
+ *
+ * RETURNS
+ *      Nothing
+ *----------------------------------------------------------------------------*/
+static void handleMeterFrame(const uint8 *frame, uint16 length)
+{
+    const uint8 *data = frame + METER_REPLY_DATA_OFFSET;
+    uint16 result;
+    uint32 dateTime;
+    uint16 i;
+
+    if(length == METER_ACK_FRAME_LEN)
+    {
+        /* The meter has acknowledged the request, wait for the reply */
+        return;
+    }
+
+    switch(g_meter_data.state)
+    {
+        case meter_state_read_serial_no:
+        {
+            if(length < METER_REPLY_DATA_OFFSET + METER_SERIAL_NO_LEN)
+                break;
+
+            for(i = 0; i < METER_SERIAL_NO_LEN; i++)
+            {
+                if(g_meter_data.serial_no[i] != data[i])
+                    break;
+            }
+
+            if(i < METER_SERIAL_NO_LEN)
+            {
+                /* Another meter, none of its records has been downloaded */
+                MemCopy(g_meter_data.serial_no, data, METER_SERIAL_NO_LEN);
+                g_meter_data.last_epoch = 0;
+                g_meter_data.synced_count = 0;
+
+                Nvm_BeginTransaction();
+
+                /* Typecast of uint8 to uint16 or vice-versa shall not have 
+                 * any side affects as both types (uint8 and uint16) take one
+                 * word memory on XAP
+                 */
+                Nvm_Write((uint16 *)g_meter_data.serial_no, 
+                          UINT8_ARRAY_WORDS(METER_SERIAL_NO_LEN),
+                          g_meter_data.nvm_offset + 
+                          METER_NVM_SERIAL_NO_OFFSET);
+                meterWriteSyncToNvm();
+
+                Nvm_CommitTransaction();
+            }
+
+            sendAck(TRUE);
+            meterSetState(meter_state_read_no_of_records);
+        }
+        break;
+
+        case meter_state_read_no_of_records:
+        {
+            if(length < METER_REPLY_DATA_OFFSET + 2)
+                break;
+
+            g_meter_data.no_of_records = (uint16)(data[0] | (data[1] << 8));
+            sendAck(TRUE);
+
+            /* The link bit of the record ACKs alternates from here */
+            g_meter_data.ack_odd = FALSE;
+
+            if(g_meter_data.no_of_records == 0)
+            {
+                meterSetState(meter_state_idle);
+            }
+            else if(g_meter_data.last_epoch == 0)
+            {
+                /* Nothing downloaded yet, fetch all the records */
+                g_meter_data.record_idx = g_meter_data.no_of_records - 1;
+                meterSetState(meter_state_read_record);
+            }
+            else
+            {
+                /* Find the records newer than the last one downloaded. The
+                 * meter adds records at index 0, so that record is expected
+                 * at the index of the number of records taken since. It is
+                 * probed first, otherwise the search starts with the newest
+                 * record.
+                 */
+                g_meter_data.search_lo = 0;
+                g_meter_data.search_hi = g_meter_data.no_of_records;
+                g_meter_data.record_idx = 0;
+                g_meter_data.guess_idx = METER_INVALID_RECORD_IDX;
+
+                if(g_meter_data.synced_count &&
+                   g_meter_data.synced_count <= g_meter_data.no_of_records)
+                {
+                    g_meter_data.guess_idx = g_meter_data.no_of_records - 
+                                             g_meter_data.synced_count;
+                    g_meter_data.record_idx = g_meter_data.guess_idx;
+                }
+
+                meterSetState(meter_state_find_record);
+            }
+        }
+        break;
+
+        case meter_state_find_record:
+        {
+            if(length < METER_REPLY_DATA_OFFSET + 6)
+                break;
+
+            dateTime = (uint32)data[0] | ((uint32)data[1] << 8) |
+                       ((uint32)data[2] << 16) | ((uint32)data[3] << 24);
+
+            sendAck(g_meter_data.ack_odd);
+            g_meter_data.ack_odd = !g_meter_data.ack_odd;
+
+            /* Records before 'search_lo' are new, records from 'search_hi'
+             * have been downloaded before
+             */
+            if(g_meter_data.record_idx == g_meter_data.guess_idx &&
+               dateTime == g_meter_data.last_epoch)
+            {
+                /* The records before the expected index are the new ones */
+                g_meter_data.search_lo = g_meter_data.record_idx;
+                g_meter_data.search_hi = g_meter_data.record_idx;
+            }
+            else if(dateTime > g_meter_data.last_epoch)
+            {
+                g_meter_data.search_lo = g_meter_data.record_idx + 1;
+            }
+            else
+            {
+                g_meter_data.search_hi = g_meter_data.record_idx;
+            }
+
+            g_meter_data.guess_idx = METER_INVALID_RECORD_IDX;
+
+            if(g_meter_data.search_lo < g_meter_data.search_hi)
+            {
+                if(g_meter_data.search_hi == g_meter_data.no_of_records)
+                {
+                    /* No old record found yet, double the distance */
+                    g_meter_data.record_idx = g_meter_data.search_lo << 1;
+
+                    if(g_meter_data.record_idx >= g_meter_data.no_of_records)
+                    {
+                        g_meter_data.record_idx = 
+                                            g_meter_data.no_of_records - 1;
+                    }
+                }
+                else
+                {
+                    g_meter_data.record_idx = (g_meter_data.search_lo + 
+                                               g_meter_data.search_hi) >> 1;
+                }
+
+                meterSetState(meter_state_find_record);
+            }
+            else if(g_meter_data.search_lo)
+            {
+                /* Fetch the new records, oldest first */
+                g_meter_data.record_idx = g_meter_data.search_lo - 1;
+                meterSetState(meter_state_read_record);
+            }
+            else
+            {
+                /* No new record */
+                meterSetState(meter_state_idle);
+
+                if(g_meter_data.synced_count != g_meter_data.no_of_records)
+                {
+                    /* The newest record downloaded is still the newest one
+                     * of the meter
+                     */
+                    g_meter_data.synced_count = g_meter_data.no_of_records;
+                    meterWriteSyncToNvm();
+                }
+            }
+        }
+        break;
+
+        case meter_state_read_record:
+        {
+            if(length < METER_REPLY_DATA_OFFSET + 6)
+                break;
+
+            dateTime = (uint32)data[0] | ((uint32)data[1] << 8) |
+                       ((uint32)data[2] << 16) | ((uint32)data[3] << 24);
+            result = (uint16)(data[4] | (data[5] << 8));
+
+            /* Number of meter records up to and including this one */
+            i = g_meter_data.no_of_records - g_meter_data.record_idx;
+
+            sendAck(g_meter_data.ack_odd);
+            g_meter_data.ack_odd = !g_meter_data.ack_odd;
+
+            /* Request the next record before storing this one */
+            if(g_meter_data.record_idx)
+            {
+                g_meter_data.record_idx--;
+                meterSetState(meter_state_read_record);
+            }
+            else
+            {
+                meterSetState(meter_state_idle);
+            }
+
+            /* A record taken while downloading shifts the numbering of the
+             * records, so a record may be received twice.
+             */
+            if(dateTime > g_meter_data.last_epoch)
+            {
+                g_meter_data.last_epoch = dateTime;
+                g_meter_data.synced_count = i;
+
+                /* Store the record and the high-water mark together, so 
+                 * that a reset never downloads the record again
+                 */
+                Nvm_BeginTransaction();
+
+                AddGlucoseMeasData(result, dateTime);
+                meterWriteSyncToNvm();
+
+                Nvm_CommitTransaction();
+            }
+        }
+        break;
+
+        default:
+            /* Unsolicited frame */
+        break;
+    }
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      meterSetState
+ *
+ *  DESCRIPTION
+ *      Move the meter link to a new state and send the request of that 
+ *      state, along with any queued ACK.
+ *
+ * PARAMETERS
+ *      new_state [in]     New meter link state
+ *
+ * RETURNS
+ *      Nothing
+ *----------------------------------------------------------------------------*/
+static void meterSetState(meter_state new_state)
+{
+    g_meter_data.state = new_state;
+    g_meter_data.retries = 0;
+
+    if(new_state == meter_state_idle)
+    {
+        TimerDelete(g_meter_data.reply_tid);
+        g_meter_data.reply_tid = TIMER_INVALID;
+
+        /* Send the last ACK */
+        sendPendingData();
+    }
+    else
+    {
+        sendMeterRequest();
+    }
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      sendMeterRequest
+ *
+ *  DESCRIPTION
+ *      Send the request of the current state and start the reply timer.
+ *
+ * PARAMETERS
+ *      None
+ *
+ * RETURNS
+ *      Nothing
+ *----------------------------------------------------------------------------*/
+static void sendMeterRequest(void)
+{
+    switch(g_meter_data.state)
+    {
+        case meter_state_read_serial_no:
+            readSerialNo();
+        break;
+
+        case meter_state_read_no_of_records:
+            readNoOfRecords();
+        break;
+
+        case meter_state_find_record: /* FALLTHROUGH */
+        case meter_state_read_record:
+            readRecords(g_meter_data.record_idx);
+        break;
+
+        default:
+            return;
+    }
+
+    /* Send the request with any ACK queued before it */
+    sendPendingData();
+
+    TimerDelete(g_meter_data.reply_tid);
+    g_meter_data.reply_tid = TimerCreate(METER_REPLY_TIMEOUT, TRUE,
+                                         meterReplyTimerHandler);
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      meterReplyTimerHandler
+ *
+ *  DESCRIPTION
+ *      Resend the request when the meter has not replied in time. The 
+ *      download is given up after METER_MAX_RETRIES attempts.
+ *
+ * PARAMETERS
+ *      tid [in]           Expired timer
+ *
+ * RETURNS
+ *      Nothing
+ *----------------------------------------------------------------------------*/
+static void meterReplyTimerHandler(timer_id tid)
+{
+    if(tid != g_meter_data.reply_tid)
+    {
+        return;
+    }
+
+    g_meter_data.reply_tid = TIMER_INVALID;
+
+    /* Drop any partial frame */
+    g_meter_data.rx_len = 0;
+    g_meter_data.rx_crc_len = 0;
+
+    if(g_meter_data.retries++ < METER_MAX_RETRIES)
+    {
+        sendMeterRequest();
+    }
+    else
+    {
+        meterSetState(meter_state_idle);
+    }
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      meterWriteSyncToNvm
+ *
+ *  DESCRIPTION
+ *      Write the time of the newest record downloaded and the number of
+ *      meter records up to and including it to NVM.
+ *
+ * PARAMETERS
+ *      None
+ *
+ * RETURNS
+ *      Nothing
+ *----------------------------------------------------------------------------*/
+static void meterWriteSyncToNvm(void)
+{
+    uint16 sync_data[3];
+
+    sync_data[0] = (uint16)(g_meter_data.last_epoch & 0xFFFF);
+    sync_data[1] = (uint16)(g_meter_data.last_epoch >> 16);
+    sync_data[2] = g_meter_data.synced_count;
+
+    Nvm_Write(sync_data, 3, 
+              g_meter_data.nvm_offset + METER_NVM_LAST_EPOCH_OFFSET);
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      readSerialNo
+ *
+ *  DESCRIPTION
+ *      Queue the request for the serial number of the meter.
+ *
+ * PARAMETERS
+ *      None
  *
  * RETURNS
- *      The number of bytes ('unpacked') or words ('packed') that have been
- *      processed out of the available data.
+ *      Nothing
  *----------------------------------------------------------------------------*/
-static uint16 uartRxDataCallback(void   *p_rx_buffer,
-                                 uint16  length,
-                                 uint16 *p_additional_req_data_length)
+static void readSerialNo(void)
 {
-
-
-    int i=0;
-    if(length>0)
-    {
-            for(i=0;i<9;i++){
-                buffer[i]=(char)*((char *)p_rx_buffer+i);
-            }
-    
-    if(buffer[0]==0x61 && buffer[1]==0x62 && buffer[2]==0x63){
-        uint16 result=(uint16)(buffer[4]|(buffer[3]<<8));
-        uint32 dateTimeL=(uint32)(buffer[8]|(buffer[7]<<8));
-        uint32 dateTimeH=(uint32)(buffer[6]|(buffer[5]<<8));
-               
-                 
-                uint32 dateTime=(uint32)((dateTimeL|dateTimeH<<16));
-                calcDate(&timeMeter,dateTime);
-                
-const uint8  message_len = (sizeof(buffer))/sizeof(uint8);
-  
-    /* Add opening message to byte queue */
-    BQForceQueueBytes(buffer, message_len);    
-    sendPendingData();
-    TimeDelayUSec(50000);                 
-                
-                
-                AddGlucoseMeasData(result);
-    }
-    }       
-        
-/*
-    if ( length > 0 )
-    {
-     
-       
-        switch(status){
-            uint8 crc[2];
-            case READ_SERIAL_NO:
-            {
-                if(rxflag>5 && rxflag<21){
-                    serialNoArrayCRC[rxflag-6]=(char)*(char *)p_rx_buffer;
-                if (rxflag>10 && rxflag<20){                   
-                    serialNoArray[rxflag-11]=(char)*(char *)p_rx_buffer;
-                 
-                }
-                }
-                if(rxflag>=21){
-                crc[rxflag-21]=(char)*(char *)p_rx_buffer;
-                
-            }
-            if(rxflag>=22)
-            {
-            uint16 crcrtn=crc_calculate_crc(CRC_SEED,serialNoArrayCRC,sizeof(serialNoArrayCRC)/sizeof(uint8));
-           
-            if(crc[0]==(crcrtn<<8)>>8 && crc[1]==(uint8)crcrtn>>8) 
-            {  
-                error=FALSE;
-              }
-            else{
-                error=TRUE;
-            }
-        }
-            } 
-            break;
-            case READ_RECORD_NO:
-            {
-             if(rxflag>5 && rxflag<14){
-                    noOfRecordsArrayCRC[rxflag-6]=(char)*(char *)p_rx_buffer;
-                  if(rxflag>10 && rxflag<13){
-                      noOfRecordsArray[rxflag-11]=(char)*(char *)p_rx_buffer;
-                      
-                  
-                  }
-                }
-            if(rxflag>=14){
-                crc[rxflag-14]=(char)*(char *)p_rx_buffer;
-                
-            }
-            if(rxflag>=15)
-            {
-            uint16 crcrtn=crc_calculate_crc(CRC_SEED,noOfRecordsArrayCRC,sizeof(noOfRecordsArrayCRC)/sizeof(uint8));
-           
-            if(crc[0]==(crcrtn<<8)>>8 && crc[1]==(uint8)crcrtn>>8) 
-            {  
-                recordNo=(uint16)(noOfRecordsArray[0]|(noOfRecordsArray[1]<<8));//uint16 of the no of records
-                error=FALSE;
-              
-            }
-            else{
-                error=TRUE;
-            }
-        }
-        }
-            break;
-            case READ_RECORDS:
-            {
-             if(rxflag>5 && rxflag<20){
-                    recordsArrayCRC[rxflag-6]=(char)*(char *)p_rx_buffer;
-                    if(rxflag>10 && rxflag<19){
-                        recordsArray[rxflag-11]=(char)*(char *)p_rx_buffer;
-                    
-                }
-                }
-            if(rxflag>=20){
-                crc[rxflag-20]=(uint8)*(uint8 *)p_rx_buffer;
-            }
-            if(rxflag>=21){
-            uint16 crcrtn=crc_calculate_crc(CRC_SEED,recordsArrayCRC,sizeof(recordsArrayCRC)/sizeof(uint8));
-           
-            if(crc[0]==(crcrtn<<8)>>8 && crc[1]==(uint8)crcrtn>>8) 
-            {  
-                error=FALSE;
-                uint16 result=(uint16)(recordsArray[4]|(recordsArray[5]<<8));
-                uint32 dateTimeL=(uint32)(recordsArray[0]|(recordsArray[1]<<8));
-                uint32 dateTimeH=(uint32)(recordsArray[2]|(recordsArray[3]<<8));
-                
-                 
-                uint32 dateTime=(uint32)((dateTimeL|dateTimeH<<16));
-                calcDate(&timeMeter,dateTime);
-                
-                uint16 result=(uint16)(recordsArray[4]|(recordsArray[5]<<8));
-                AddGlucoseMeasData(result);
-                
-                ackFlag=!ackFlag;
-                sendAck(ackFlag);
-                
-                
-                recordToRead++; 
-              
-                if(recordToRead>=recordNo){
-                    finishedReading=TRUE;
-                }
-                if(!finishedReading){
-              
-                
-            }
-                
-              
-            }
-            else{
-                error=TRUE;
-            }
-       }
-        }
-            break;
-            
-                    
-        }
-     
-        
-         rxflag+=1;
-       
-    }*/
-    
-   
-    
-    /* Inform the UART driver that we'd like to receive another byte when it
-     * becomes available
-     */
-    *p_additional_req_data_length = (uint16)1;
-    
-    /* Return the number of bytes that have been processed */
-    return length;
+    BQForceQueueBytes(read_serial_no_frame, sizeof(read_serial_no_frame));
 }
 
 /*----------------------------------------------------------------------------*
  *  NAME
- *      uartTxDataCallback
+ *      readNoOfRecords
  *
  *  DESCRIPTION
- *      This is an internal callback function (of type uart_data_out_fn) that
- *      will be called by the UART driver when data transmission over the UART
- *      is finished. See DebugInit in the Firmware Library documentation for
- *      details.
+ *      Queue the request for the number of records stored in the meter.
  *
  * PARAMETERS
  *      None
@@ -303,213 +1123,66 @@ const uint8  message_len = (sizeof(buffer))/sizeof(uint8);
  * RETURNS
  *      Nothing
  *----------------------------------------------------------------------------*/
-static void uartTxDataCallback(void)
+static void readNoOfRecords(void)
 {
-    /* Send any pending data waiting to be sent */
-    sendPendingData();
+    BQForceQueueBytes(read_no_of_records_frame, 
+                      sizeof(read_no_of_records_frame));
 }
 
 /*----------------------------------------------------------------------------*
  *  NAME
- *      sendPendingData
+ *      readRecords
  *
  *  DESCRIPTION
- *      Send buffered data over UART that was waiting to be sent. Perform some
- *      translation to ensured characters are properly displayed.
+ *      Queue the request for a record of the meter. The constant head of 
+ *      the frame is queued as it is and only the index and the end of the 
+ *      frame are added to the CRC of the head.
  *
  * PARAMETERS
- *      None
+ *      recordIdx [in]     Index of the record, 0 being the newest
  *
  * RETURNS
  *      Nothing
  *----------------------------------------------------------------------------*/
-static void sendPendingData(void)
+static void readRecords(uint16 recordIdx)
 {
-    /* Loop until the byte queue is empty */
-    while (BQGetDataSize() > 0)
-    {
-        uint8 byte = '\0';
-        
-        /* Read the next byte in the queue */
-        if (BQPeekBytes(&byte, 1) > 0)
-        {
-            bool ok_to_commit = FALSE;
-            
-            /* Check if Enter key was pressed */
-            if (byte == '\r')
-            {
-                /* Echo carriage return and newline */
-                const uint8 data[] = {byte, '\n'};
-                
-                ok_to_commit = UartWrite(data, sizeof(data)/sizeof(uint8));
-            }
-            else if (byte == '\b')
-            /* If backspace key was pressed */
-            {
-                /* Issue backspace, overwrite previous character on the
-                 * terminal, then issue another backspace
-                 */
-                const uint8 data[] = {byte, ' ', byte};
-                
-                ok_to_commit = UartWrite(data, sizeof(data)/sizeof(uint8));
-            }
-            else
-            {
-                /* Echo the character */
-                ok_to_commit = UartWrite(&byte, 1);
-            }
+    uint8 tail[READ_RECORD_TAIL_LEN];
+    uint16 crc;
 
-            if (ok_to_commit)
-            {
-                /* Now that UART driver has accepted this data
-                 * remove the data from the buffer
-                 */
-                BQCommitLastPeek();
-            }
-            else
-            {
-                /* If UART doesn't have enough space available to accommodate
-                 * this data, postpone sending data and leave it in the buffer
-                 * to try again later.
-                 */
-                break;
-            }
-        }
-        else
-        {
-            /* Couldn't read data for some reason. Postpone sending data and
-             * try again later.
-            */
-            break;
-        }
-    }
-}
+    tail[0] = (uint8)(recordIdx & 0xFF);
+    tail[1] = (uint8)(recordIdx >> 8);
+    tail[2] = METER_ETX;
 
+    crc = crc_update_crc(READ_RECORD_HEAD_CRC, tail[0]);
+    crc = crc_update_crc(crc, tail[1]);
+    crc = crc_update_crc(crc, tail[2]);
 
+    tail[3] = (uint8)(crc & 0xFF);
+    tail[4] = (uint8)(crc >> 8);
+
+    BQForceQueueBytes(read_record_head, sizeof(read_record_head));
+    BQForceQueueBytes(tail, READ_RECORD_TAIL_LEN);
+}
 
 /*----------------------------------------------------------------------------*
  *  NAME
- *      protocolHandler
+ *      sendAck
  *
  *  DESCRIPTION
- *      Translate the sleep state code and transmit over UART.
+ *      Queue an ACK, which is sent with the next request.
  *
  * PARAMETERS
- *      state [in]     Sleep state code to translate and transmit
+ *      odd [in]           Link bit of the ACK
  *
  * RETURNS
  *      Nothing
  *----------------------------------------------------------------------------*/
-static void protocolHandler()
-{
-
-    readSerialNo();
-      
-    if(!error){
-  /*   TimeDelayUSec(50000);*/
-         sendAck(TRUE);
-     }
-   /* TimeDelayUSec(50000);*/
-    readNoOfRecords();
-   if(!error){
-   /* TimeDelayUSec(50000);*/
-    sendAck(TRUE);
-}
- /*TimeDelayUSec(50000); */
-    uint16 recordCounter;
-  for (recordCounter=0;recordCounter<recordNo&&(!error);recordCounter++) {
-   readRecords(recordCounter);
-   sendAck(recordCounter%2);
-}
-    
-}
-void printForDebug(char string[]){
-    
-    
-    const uint8  message_len = (sizeof(string))/sizeof(uint8);
-    BQForceQueueBytes((uint8 *)string, message_len);
-    sendPendingData();
-}
-
-static void readSerialNo(void){
-    rxflag=0;
-    
-    uint8 message[]= {0x02, 0x12, 0x00, 0x05, 0x0b, 0x02, 0x00, 0x00, 0x00, 0x00, 0x84, 0x6a, 0xe8, 0x73, 0x00, 0x03, 0x9b, 0xea}; 
-    const uint8  message_len = (sizeof(message))/sizeof(uint8);
-  
-    /* Add opening message to byte queue */
-    BQForceQueueBytes(message, message_len);
-    status=READ_SERIAL_NO;
-    /* Add translated sleep state to byte queue */
-/*    BQForceQueueBytes(p_state_msg, state_msg_len);*/
-    
-    /* Send byte queue over UART */
-    sendPendingData();
-    TimeDelayUSec(50000); 
-    
-    }
-static void readNoOfRecords(void){
-    rxflag=0;
-    uint8 message[]= {0x02, 0x0A, 0x00, 0x05, 0x1F, 0xF5, 0x01, 0x03, 0x38, 0xAA};
-    const uint8  message_len = (sizeof(message))/sizeof(uint8);
-  
-    /* Add opening message to byte queue */
-    BQForceQueueBytes(message, message_len);
-    status=READ_RECORD_NO;
-  
-    
-    /* Send byte queue over UART */
-    sendPendingData();
-    TimeDelayUSec(50000); 
-    TimeDelayUSec(50000); 
-    
-    }
-static void readRecords(/*uint16 startRecord,*/uint16 noOfRecords ){
-   rxflag=0;
-    uint16 recordCounter=noOfRecords;
-  
-    
-    uint8 rL=(uint8)(recordCounter);
-    uint8 rH=(uint8)(recordCounter>>8);
-    
-    uint8 link=ackFlag?0x03:0x00;
-    uint8 messageCRC[]= {0x02,0x0A,link,0x05,0x1F, rL, rH, 0x03};    
-    uint16 crcrtn=crc_calculate_crc(CRC_SEED,messageCRC,sizeof(messageCRC)/sizeof(uint8));
-    uint8 message[]= {0x02,0x0A,link,0x05,0x1F, rL, rH, 0x03, crcrtn, crcrtn>>8};
-    const uint8  message_len = (sizeof(message))/sizeof(uint8);
-  
-    /* Add opening message to byte queue */
-    BQForceQueueBytes(message, message_len);
-    status=READ_RECORDS;
-   
-    
-    /* Send byte queue over UART */
-        sendPendingData();
-        TimeDelayUSec(50000); 
-        TimeDelayUSec(50000);
-/*}*/
-    
-    }
 static void sendAck(bool odd)
 {
-    uint8 message[]= {0x02, 0x06, 0x07, 0x03, 0xFC, 0x72};/*odd*/
-    if(!odd){
-            message[2]=0x04;
-            message[4]=0xAF;
-            message[5]=0x27;/*even*/
-        }
-
-        const uint8  message_len = (sizeof(message))/sizeof(uint8);
-        BQForceQueueBytes(message, message_len);
-        status=SEND_ACK;
-   
-    
-    /* Send byte queue over UART */
-    sendPendingData();
-    
-    TimeDelayUSec(50000); 
-    TimeDelayUSec(50000); 
+    BQForceQueueBytes(odd ? ack_odd_frame : ack_even_frame, 
+                      METER_ACK_FRAME_LEN);
 }
+
 void uartHandle(void)
 {
     /* Initialise UART and configure with default baud rate and port
@@ -517,7 +1190,7 @@ void uartHandle(void)
      */
     UartInit(uartRxDataCallback,
              uartTxDataCallback,
-             rx_buffer, UART_BUF_SIZE_BYTES_128,
+             rx_buffer, UART_BUF_SIZE_BYTES_64,
              tx_buffer, UART_BUF_SIZE_BYTES_64,
              uart_data_unpacked);
     /*Set the baud rate and configuration*/   
@@ -526,25 +1199,112 @@ void uartHandle(void)
     /* Enable UART */
     UartEnable(TRUE);
 
-    /* UART receive threshold is set to 1 byte, so that every single byte
-     * received will trigger the receiver callback */
-    UartRead(9, 0);
+    /* UART receive threshold is set to 1 byte for the start of the first 
+     * frame, the receiver callback then asks for the rest of the frame */
+    UartRead(1, 0);
 
-    
+    /* Start downloading the records of the meter. The download is driven by
+     * the replies of the meter and the reply timer, so it runs alongside
+     * advertising and connections. AppInit also runs after an HCI reset,
+     * which does not clear the memory, so no download is left in progress.
+     */
+    g_meter_data.state = meter_state_idle;
+    g_meter_data.reply_tid = TIMER_INVALID;
+    g_meter_data.rx_len = 0;
+    g_meter_data.rx_crc_len = 0;
+    MeterSync();
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      MeterSync
+ *
+ *  DESCRIPTION
+ *      Start downloading the records of the meter which have not been 
+ *      downloaded yet. Nothing is done if a download is in progress.
+ *
+ * PARAMETERS
+ *      None
+ *
+ * RETURNS
+ *      Nothing
+ *----------------------------------------------------------------------------*/
+extern void MeterSync(void)
+{
+    if(g_meter_data.state == meter_state_idle)
+    {
+        meterSetState(meter_state_read_serial_no);
+    }
+}
 
-    /* Display the last sleep state */
-    protocolHandler();
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      MeterReadDataFromNVM
+ *
+ *  DESCRIPTION
+ *      Read the serial number of the meter and the newest record downloaded
+ *      from it from NVM, so that only newer records are downloaded.
+ *
+ * PARAMETERS
+ *      p_offset [in/out]  NVM offset of the meter link data, increased by 
+ *                         the number of words used
+ *
+ * RETURNS
+ *      Nothing
+ *----------------------------------------------------------------------------*/
+extern void MeterReadDataFromNVM(uint16 *p_offset)
+{
+    uint16 sync_data[3];
 
-    /* Construct welcome message */
-   /* const uint8 message[] = "\r\nType something: ";*/
-    
-    /* Add message to the byte queue */
-   /* BQForceQueueBytes(OneTouchEasySN, (sizeof(OneTouchEasySN)-1)/sizeof(uint8));*/
-    
-    /* Transmit the byte queue over UART */
-   /* sendPendingData();*/
+    g_meter_data.nvm_offset = *p_offset;
+
+    /* Typecast of uint8 to uint16 or vice-versa shall not have any side 
+     * affects as both types (uint8 and uint16) take one word memory on XAP
+     */
+    Nvm_Read((uint16 *)g_meter_data.serial_no, 
+             UINT8_ARRAY_WORDS(METER_SERIAL_NO_LEN),
+             *p_offset + METER_NVM_SERIAL_NO_OFFSET);
+
+    Nvm_Read(sync_data, 3, *p_offset + METER_NVM_LAST_EPOCH_OFFSET);
+
+    g_meter_data.last_epoch = (uint32)sync_data[0] | 
+                              ((uint32)sync_data[1] << 16);
+    g_meter_data.synced_count = sync_data[2];
+
+    *p_offset += METER_NVM_MEMORY_WORDS;
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      MeterInitWriteDataToNVM
+ *
+ *  DESCRIPTION
+ *      Write the meter link data to NVM for the first time during 
+ *      application initialisation. No record has been downloaded yet.
+ *
+ * PARAMETERS
+ *      p_offset [in/out]  NVM offset of the meter link data, increased by 
+ *                         the number of words used
+ *
+ * RETURNS
+ *      Nothing
+ *----------------------------------------------------------------------------*/
+extern void MeterInitWriteDataToNVM(uint16 *p_offset)
+{
+    g_meter_data.nvm_offset = *p_offset;
+
+    MemSet(g_meter_data.serial_no, 0, METER_SERIAL_NO_LEN);
+    g_meter_data.last_epoch = 0;
+    g_meter_data.synced_count = 0;
+
+    Nvm_Write((uint16 *)g_meter_data.serial_no, 
+              UINT8_ARRAY_WORDS(METER_SERIAL_NO_LEN),
+              *p_offset + METER_NVM_SERIAL_NO_OFFSET);
+    meterWriteSyncToNvm();
+
+    *p_offset += METER_NVM_MEMORY_WORDS;
 }
-void AddGlucoseMeasData(uint16 result)
+void AddGlucoseMeasData(uint16 result, uint32 epoch)
 {
   
     uint8 mFlag = 0;
@@ -553,7 +1313,6 @@ void AddGlucoseMeasData(uint16 result)
     uint8 cData[MAX_LEN_CONTEXT_OPTIONAL_FIELDS];
     uint16 mLen = 0;
     uint16 cLen = 0;
-    uint16 random_val = 0;
 
     /* Fill glucose measurement data */
     mFlag = TIME_OFFSET_PRESENT |
@@ -601,17 +1360,17 @@ void AddGlucoseMeasData(uint16 result)
     }
     mData[mLen ++] = LE8_H(0);
 
+#ifdef ENABLE_PTS_WORKAROUNDS
     /* If some PTS test case is running which requires glucose context to be in
      * every record/last record/first record and project keyr file has been 
      * configured accordingly, then following boolean variable will be TRUE and
-     * glucose context will be generated for every record.
-     * OR
-     * Add context information once in every 
-     * GLUCOSE_CONTEXT_REPEAT_CYCLE_LENGTH measurements.
+     * glucose context will be generated for every record. The meter records
+     * carry no context otherwise.
      */
-   /* if(g_pts_generate_context_every_record == TRUE || num == 2)*/
-    if(TRUE)
+    if(g_pts_generate_context_every_record)
     {
+        uint16 random_val;
+
         /* Fill glucose context information data */
         mFlag |= CONTEXT_INFORMATION_PRESENT;
 
@@ -672,80 +1431,149 @@ void AddGlucoseMeasData(uint16 result)
         cData[cLen ++] = LE8_L(10); /* Range - 0 to 100 % */
         cData[cLen ++] = LE8_H(10);
     }
+#endif /* ENABLE_PTS_WORKAROUNDS */
 
     AddGlucoseMeasurementToQueue(mFlag, mData, mLen,
-                                 cFlag, cData, cLen, &timeMeter);
+                                 cFlag, cData, cLen, epoch);
 }
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      calcDate
+ *
+ *  DESCRIPTION
+ *      Convert seconds since 1970 to date and time. The date is calculated
+ *      in constant time from the number of days since 1970, counting years
+ *      from March so that the leap day comes last, and is cached for the
+ *      next record of the same day.
+ *
+ * PARAMETERS
+ *      tm [out]           Date and time
+ *      meterEpoch [in]    Seconds since 1970
+ *
+ * RETURNS
+ *      Nothing
+ *----------------------------------------------------------------------------*/
 void calcDate(TIME_UNIX_CONV  *tm,uint32 meterEpoch)
 {
-  uint32 seconds, minutes, hours, days, year, month;
-  uint32 dayOfWeek;
-  seconds = meterEpoch;
-
-  /* calculate minutes */
-  minutes  = seconds / 60;
-  seconds -= minutes * 60;
-  /* calculate hours */
-  hours    = minutes / 60;
-  minutes -= hours   * 60;
-  /* calculate days */
-  days     = hours   / 24;
-  hours   -= days    * 24;
-
-  /* Unix time starts in 1970 on a Thursday */
-  year      = 1970;
-  dayOfWeek = 4;
-
-  while(1)
-  {
-    bool     leapYear   = (year % 4 == 0 && (year % 100 != 0 || year % 400 == 0));
-    uint16 daysInYear = leapYear ? 366 : 365;
-    if (days >= daysInYear)
+    /* Days since 1970 fit in 16 bits up to the year 2149. This is the only
+     * 32 bit divide, the rest is done in 16 bits.
+     */
+    uint16 days = (uint16)(meterEpoch / 86400UL);
+    uint32 seconds = meterEpoch - (uint32)days * 86400UL;
+    uint16 hour;
+    uint16 rem;
+
+    if(!g_date_cache.valid || g_date_cache.day != days)
+    {
+        uint16 doe;        /* Day from the 1st March of the base year */
+        uint16 yoe;        /* Years from the base year */
+        uint16 doy;        /* Day of the year from 1st March */
+        uint16 mp;         /* Month from March, 0 to 11 */
+        uint16 year;
+        bool   leapYear;
+
+        /* Days are counted from 1968-03-01 up to 2000-02-29, and from 
+         * 2000-03-01 (day 11017 since 1970) onwards, so that they stay 
+         * within 16 bits. 1970-01-01 is day 671 from 1968-03-01. Every 
+         * 4 years end with a leap day, but for 2100 which is not a leap
+         * year.
+         */
+        if(days < 11017)
+        {
+            doe = days + 671;
+            year = 1968;
+        }
+        else
+        {
+            doe = days - 11017;
+            year = 2000;
+        }
+
+        yoe = (doe - doe / 1460 + doe / 36524) / 365;
+        doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        mp = (5 * doy + 2) / 153;
+        year += yoe;
+
+        g_date_cache.date.tm_mday = doy - (153 * mp + 2) / 5 + 1;
+
+        if(mp < 10)
+        {
+            g_date_cache.date.tm_mon = mp + 3;
+        }
+        else
+        {
+            /* January and February belong to the next year */
+            g_date_cache.date.tm_mon = mp - 9;
+            year++;
+        }
+
+        leapYear = (year % 4 == 0 && (year % 100 != 0 || year % 400 == 0));
+
+        /* Day of the year from 1st January */
+        g_date_cache.date.tm_yday = (mp < 10) ? doy + 59 + leapYear 
+                                              : doy - 306;
+        g_date_cache.date.tm_year = year;
+
+        /* Unix time starts in 1970 on a Thursday */
+        g_date_cache.date.tm_wday = (days + 4) % 7;
+
+        g_date_cache.day = days;
+        g_date_cache.valid = TRUE;
+    }
+
+    *tm = g_date_cache.date;
+
+    /* Halving the seconds of the day brings them within 16 bits */
+    hour = (uint16)(seconds >> 1) / 1800;
+    rem = (uint16)(seconds - (uint32)hour * 3600UL);
+    tm->tm_hour = (uint8)hour;
+    tm->tm_min  = (uint8)(rem / 60);
+    tm->tm_sec  = (uint8)(rem % 60);
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      calcEpoch
+ *
+ *  DESCRIPTION
+ *      Convert a date and time from 1970 onwards to seconds since 1970, the
+ *      inverse of calcDate. Only the year, month, day of the month and the
+ *      time of day are used.
+ *
+ * PARAMETERS
+ *      tm [in]            Date and time
+ *
+ * RETURNS
+ *      Seconds since 1970
+ *----------------------------------------------------------------------------*/
+uint32 calcEpoch(const TIME_UNIX_CONV *tm)
+{
+    uint32 days;
+    uint16 year = tm->tm_year;
+    uint16 yoe;        /* Year of the 400 year era */
+    uint16 doy;        /* Day of the year from 1st March */
+    uint16 mp;         /* Month from March, 0 to 11 */
+
+    /* January and February belong to the previous year */
+    if(tm->tm_mon <= 2)
     {
-      dayOfWeek += leapYear ? 2 : 1;
-      days      -= daysInYear;
-      if (dayOfWeek >= 7)
-        dayOfWeek -= 7;
-      ++year;
+        year--;
+        mp = tm->tm_mon + 9;
     }
     else
     {
-      tm->tm_yday = days;
-      dayOfWeek  += days;
-      dayOfWeek  %= 7;
-
-      /* calculate the month and day */
-      static const uint8 daysInMonth[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
-      for(month = 0; month < 12; ++month)
-      {
-        uint8 dim = daysInMonth[month];
-
-        /* add a day to feburary if this is a leap year */
-        if (month == 1 && leapYear)
-          ++dim;
-
-        if (days >= dim)
-          days -= dim;
-        else
-          break;
-      }
-      break;
+        mp = tm->tm_mon - 3;
     }
-  }
-    
-  tm->tm_sec  = seconds%60;
-  tm->tm_min  = minutes%3600;
-  tm->tm_hour = hours%216000;
-  tm->tm_mday = (days + 1);
-  tm->tm_mon  = month+1;
-  tm->tm_year = year;
-  tm->tm_wday = dayOfWeek;
-  /*
-  uint8 message[]= {0x99, tm->tm_sec, tm->tm_min, tm->tm_hour,tm->tm_mon,tm->tm_mday,tm->tm_year,tm->tm_year>>8,0x99}; 
-    const uint8  message_len = (sizeof(message))/sizeof(uint8);
-  
-   
-    BQForceQueueBytes(message, message_len);
-    sendPendingData();
-    */
+
+    yoe = year % 400;
+    doy = (153 * mp + 2) / 5 + tm->tm_mday - 1;
+
+    /* Day of the era, from which 1970-01-01 (day 719468 of the era starting 
+     * at 0000-03-01) is taken
+     */
+    days = 146097UL * (year / 400) + 365UL * yoe + yoe / 4 - yoe / 100 + doy 
+           - 719468UL;
+
+    return days * 86400UL + (uint32)tm->tm_hour * 3600UL + 
+           (uint16)tm->tm_min * 60 + tm->tm_sec;
 }
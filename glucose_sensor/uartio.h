@@ -70,6 +70,20 @@ extern void uartHandle(void);
  *      Nothing
  *----------------------------------------------------------------------------*/
 /*void ProcessSystemEvent(sys_event_id id, void *pData);*/
-extern void printForDebug(char *string);
+
+/* This function starts downloading the new records of the meter */
+extern void MeterSync(void);
+
+/* This function reads the meter sync state from NVM */
+extern void MeterReadDataFromNVM(uint16 *p_offset);
+
+/* This function writes the meter sync state to NVM for the first time */
+extern void MeterInitWriteDataToNVM(uint16 *p_offset);
+
+/* This function converts seconds since 1970 to date and time */
+extern void calcDate(TIME_UNIX_CONV *tm, uint32 meterEpoch);
+
+/* This function converts a date and time to seconds since 1970 */
+extern uint32 calcEpoch(const TIME_UNIX_CONV *tm);
 
 #endif /* __UARTIO_H__ */
\ No newline at end of file